@@ -0,0 +1,259 @@
+#include "linker.h"
+#include "../engine/decode.h"
+#include "../engine/opcode.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+// 오브젝트 코드의 한 조각. 마지막 조각은 코드 끝의 빈 조각으로, 남으면 halt 하나가 됩니다.
+struct piece {
+    uint64_t start;
+    uint64_t end;
+    bool live = false;
+    uint64_t address = 0;          // 링크된 코드에서의 시작 주소
+    std::vector<size_t> relocations;
+};
+
+struct link_target {
+    size_t unit;
+    uint64_t address;              // 대상 오브젝트 안의 주소
+};
+
+struct link_unit {
+    const link_input* input;
+    std::vector<piece> pieces;
+    std::vector<link_target> targets;  // 재배치마다 하나
+};
+
+__uint128_t read_wide(const uint16_t* words) {
+    __uint128_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 16) | words[i];
+    }
+    return value;
+}
+
+void write_wide(uint16_t* words, __uint128_t value) {
+    for (int i = 0; i < 8; i++) {
+        words[i] = static_cast<uint16_t>(value >> (16 * i));
+    }
+}
+
+// 서로 다른 오브젝트의 데이터가 같은 전역 메모리 칸을 초기화하는지 확인합니다.
+// 시작 주소 순으로 훑으며 지금까지 가장 멀리 뻗은 범위를 오브젝트가 다른 것끼리 두 개 기억합니다.
+bool check_data_overlap(const std::vector<link_unit>& units, std::string& error) {
+    struct range {
+        uint64_t start;
+        uint64_t end;
+        size_t unit;
+    };
+    std::vector<range> ranges;
+    for (size_t i = 0; i < units.size(); i++) {
+        for (const DataSegment& segment : units[i].input->object.data) {
+            if (!segment.values.empty()) {
+                uint64_t end = segment.address + segment.values.size();
+                ranges.push_back({segment.address, end < segment.address ? UINT64_MAX : end, i});
+            }
+        }
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const range& a, const range& b) { return a.start < b.start; });
+    const range* first = nullptr;   // 끝이 가장 먼 범위
+    const range* second = nullptr;  // first와 오브젝트가 다른 범위 중 끝이 가장 먼 것
+    for (const range& r : ranges) {
+        const range* other = first != nullptr && first->unit != r.unit ? first : second;
+        if (other != nullptr && other->end > r.start) {
+            error = "data at " + std::to_string(r.start) + " in " + units[r.unit].input->name + " overlaps data in " +
+                    units[other->unit].input->name;
+            return false;
+        }
+        if (first == nullptr || r.end > first->end) {
+            if (first != nullptr && first->unit != r.unit) {
+                second = first;
+            }
+            first = &r;
+        } else if (r.unit != first->unit && (second == nullptr || r.end > second->end)) {
+            second = &r;
+        }
+    }
+    return true;
+}
+
+// address를 담은 조각. 코드 끝은 마지막 빈 조각입니다.
+size_t piece_of(const std::vector<piece>& pieces, uint64_t address) {
+    auto it = std::upper_bound(pieces.begin(), pieces.end(), address,
+                               [](uint64_t value, const piece& p) { return value < p.start; });
+    return static_cast<size_t>(it - pieces.begin()) - 1;
+}
+
+// 조각의 마지막 명령어 다음으로 실행이 이어질 수 있는지 확인합니다.
+bool falls_through(const std::vector<uint16_t>& code, const piece& p) {
+    size_t last = p.start;
+    size_t at = p.start;
+    while (at < p.end) {
+        last = at;
+        at += instruction_width(code[at] >> 10);
+    }
+    uint8_t opcode = code[last] >> 10;
+    return at != p.end || !(opcode == OP_JMP || opcode == OP_RET || opcode == OP_HALT);
+}
+
+} // namespace
+
+bool link_objects(const std::vector<link_input>& inputs, object_file& out, std::string& error, link_stats* stats) {
+    out = object_file();
+    std::vector<link_unit> units(inputs.size());
+    std::unordered_map<std::string, link_target> global_table;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const object_file& object = inputs[i].object;
+        units[i].input = &inputs[i];
+        for (const object_symbol& symbol : object.symbols) {
+            if (!symbol.global) {
+                continue;
+            }
+            auto inserted = global_table.emplace(symbol.name, link_target{i, symbol.address});
+            if (!inserted.second) {
+                error = "duplicate global symbol " + symbol.name + " in " + inputs[inserted.first->second.unit].name +
+                        " and " + inputs[i].name;
+                return false;
+            }
+        }
+    }
+
+    if (!check_data_overlap(units, error)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < units.size(); i++) {
+        link_unit& unit = units[i];
+        const object_file& object = unit.input->object;
+        const uint64_t size = object.code.size();
+
+        std::vector<uint64_t> boundaries;
+        if (size != 0) {
+            boundaries.push_back(0);
+        }
+        for (const object_symbol& symbol : object.symbols) {
+            if (symbol.global && symbol.address < size) {
+                boundaries.push_back(symbol.address);
+            }
+        }
+        std::sort(boundaries.begin(), boundaries.end());
+        boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+        for (size_t b = 0; b < boundaries.size(); b++) {
+            unit.pieces.push_back({boundaries[b], b + 1 < boundaries.size() ? boundaries[b + 1] : size, false, 0, {}});
+        }
+        unit.pieces.push_back({size, size, false, 0, {}});
+
+        unit.targets.reserve(object.relocations.size());
+        for (size_t r = 0; r < object.relocations.size(); r++) {
+            const object_relocation& relocation = object.relocations[r];
+            link_target target{i, 0};
+            if (relocation.symbol.empty()) {
+                __uint128_t address = read_wide(&object.code[relocation.offset]);
+                if (address > size) {
+                    error = "branch at " + std::to_string(relocation.offset - 1) + " in " + unit.input->name +
+                            " leaves the object";
+                    return false;
+                }
+                target.address = static_cast<uint64_t>(address);
+            } else {
+                auto global = global_table.find(relocation.symbol);
+                if (global == global_table.end()) {
+                    error = "undefined symbol " + relocation.symbol + " referenced from " + unit.input->name;
+                    return false;
+                }
+                target = global->second;
+            }
+            unit.targets.push_back(target);
+            unit.pieces[piece_of(unit.pieces, relocation.offset)].relocations.push_back(r);
+        }
+    }
+
+    // 진입 조각에서 분기, 호출과 이어지는 실행을 따라 닿는 조각을 표시합니다.
+    std::vector<std::pair<size_t, size_t>> work;
+    auto mark = [&](size_t unit, size_t index) {
+        piece& p = units[unit].pieces[index];
+        if (!p.live) {
+            p.live = true;
+            work.emplace_back(unit, index);
+        }
+    };
+    for (size_t i = 0; i < units.size(); i++) {
+        if (!units[i].input->object.code.empty()) {
+            mark(i, 0);
+            break;
+        }
+    }
+    while (!work.empty()) {
+        size_t unit = work.back().first;
+        size_t index = work.back().second;
+        work.pop_back();
+        const piece& p = units[unit].pieces[index];
+        if (p.start == p.end) {
+            continue;
+        }
+        for (size_t r : p.relocations) {
+            const link_target& target = units[unit].targets[r];
+            mark(target.unit, piece_of(units[target.unit].pieces, target.address));
+        }
+        if (falls_through(units[unit].input->object.code, p)) {
+            mark(unit, index + 1);
+        }
+    }
+
+    // 남는 조각을 입력 순서대로 놓고 주소 자리를 다시 씁니다.
+    link_stats counts;
+    for (link_unit& unit : units) {
+        const std::vector<uint16_t>& code = unit.input->object.code;
+        counts.words += code.size();
+        for (piece& p : unit.pieces) {
+            if (p.start != p.end) {
+                counts.functions++;
+            }
+            if (!p.live) {
+                continue;
+            }
+            p.address = out.code.size();
+            if (p.start == p.end) {
+                out.code.push_back(static_cast<uint16_t>(OP_HALT << 10));
+                continue;
+            }
+            counts.kept_functions++;
+            counts.kept_words += p.end - p.start;
+            out.code.insert(out.code.end(), code.begin() + p.start, code.begin() + p.end);
+        }
+    }
+    for (link_unit& unit : units) {
+        const object_file& object = unit.input->object;
+        for (const piece& p : unit.pieces) {
+            if (!p.live) {
+                continue;
+            }
+            for (size_t r : p.relocations) {
+                const link_target& target = unit.targets[r];
+                const std::vector<piece>& pieces = units[target.unit].pieces;
+                const piece& destination = pieces[piece_of(pieces, target.address)];
+                uint64_t offset = p.address + (object.relocations[r].offset - p.start);
+                write_wide(&out.code[offset], destination.address + (target.address - destination.start));
+            }
+        }
+        for (const object_symbol& symbol : object.symbols) {
+            if (symbol.address > object.code.size()) {
+                continue;
+            }
+            const piece& p = unit.pieces[piece_of(unit.pieces, symbol.address)];
+            if (p.live) {
+                // 지역 라벨은 여러 오브젝트에 같은 이름이 있을 수 있으므로 오브젝트 이름을 붙입니다.
+                std::string name = symbol.global ? symbol.name : unit.input->name + ":" + symbol.name;
+                out.symbols.push_back({std::move(name), p.address + (symbol.address - p.start), symbol.global});
+            }
+        }
+        out.data.insert(out.data.end(), object.data.begin(), object.data.end());
+    }
+    if (stats != nullptr) {
+        *stats = counts;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "object_file.h"
+
+struct link_input {
+    std::string name;     // 오류 메시지에 쓰는 이름 (보통 소스 파일 이름)
+    object_file object;
+};
+
+struct link_stats {
+    size_t functions = 0;       // 오브젝트의 첫 조각과 .global 라벨마다 하나
+    size_t kept_functions = 0;
+    size_t words = 0;
+    size_t kept_words = 0;
+};
+
+// 오브젝트들을 입력 순서대로 이어 붙이고 재배치를 풀어 재배치 없는 오브젝트 하나로 만듭니다.
+//
+// 각 오브젝트의 코드는 .global 라벨에서 잘린 함수 조각들입니다. 실행은 코드가 있는 첫 오브젝트의
+// 첫 조각에서 시작하고, 거기서 분기나 호출로 닿거나 이어서 실행되는(마지막 명령어가 jmp/ret/halt가
+// 아닌) 조각만 남깁니다. 오브젝트 끝으로 분기하거나 끝까지 실행되면 그 자리에 halt를 두어
+// 소스 하나를 어셈블했을 때처럼 멈춥니다. 데이터는 절대 주소로 쓰여 어느 코드가 읽는지 알 수
+// 없으므로, 남는 코드가 없는 오브젝트의 것까지 모두 입력 순서대로 담습니다. 링크된 심볼 표에는
+// 전역 심볼을 그대로, 지역 심볼을 "<오브젝트 이름>:<라벨>"로 담습니다.
+//
+// 전역 심볼이 겹치거나, 어느 오브젝트도 내보내지 않는 심볼을 쓰거나, 오브젝트 밖의 주소로
+// 분기하거나, 서로 다른 오브젝트의 데이터가 같은 주소를 초기화하면 false와 오류 메시지를 반환합니다.
+bool link_objects(const std::vector<link_input>& inputs, object_file& out, std::string& error,
+                  link_stats* stats = nullptr);
+
+#endif // LINKER_H
@@ -0,0 +1,164 @@
+#include "object_file.h"
+
+#include <cstring>
+
+namespace {
+
+size_t align8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+bool section_in_file(const module_section& section, size_t file_size) {
+    return section.offset % 8 == 0 && section.offset <= file_size && section.size <= file_size - section.offset;
+}
+
+void put(std::vector<uint8_t>& out, const void* bytes, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(bytes);
+    out.insert(out.end(), p, p + size);
+}
+
+void pad8(std::vector<uint8_t>& out) {
+    out.resize(align8(out.size()), 0);
+}
+
+} // namespace
+
+bool is_object_file(const uint8_t* bytes, size_t size) {
+    return size >= sizeof(object_header) && std::memcmp(bytes, OBJECT_MAGIC, sizeof(OBJECT_MAGIC)) == 0;
+}
+
+std::vector<module_data> module_data_of(const std::vector<DataSegment>& data) {
+    std::vector<module_data> records;
+    records.reserve(data.size());
+    for (const DataSegment& segment : data) {
+        records.push_back({segment.address, segment.width == 1 ? D_TYPE::BIT_8 : D_TYPE::BIT_16,
+                           std::vector<__uint128_t>(segment.values.begin(), segment.values.end())});
+    }
+    return records;
+}
+
+std::vector<uint8_t> write_object(const object_file& object) {
+    std::vector<module_symbol> symbols;
+    std::vector<uint32_t> globals;
+    symbols.reserve(object.symbols.size());
+    for (const object_symbol& symbol : object.symbols) {
+        if (symbol.global) {
+            globals.push_back(static_cast<uint32_t>(symbols.size()));
+        }
+        symbols.push_back({symbol.name, symbol.address});
+    }
+    std::vector<uint8_t> image = build_module(object.code, module_data_of(object.data), symbols);
+
+    std::vector<relocation_entry> entries;
+    std::string names;
+    entries.reserve(object.relocations.size());
+    for (const object_relocation& relocation : object.relocations) {
+        entries.push_back({relocation.offset, static_cast<uint32_t>(names.size()),
+                           static_cast<uint32_t>(relocation.symbol.size())});
+        names += relocation.symbol;
+    }
+
+    object_header header = {};
+    std::memcpy(header.magic, OBJECT_MAGIC, sizeof(OBJECT_MAGIC));
+    header.version = OBJECT_VERSION;
+    header.module = {sizeof(header), image.size()};
+    header.relocations = {align8(header.module.offset + image.size()),
+                          entries.size() * sizeof(relocation_entry) + names.size()};
+    header.globals = {align8(header.relocations.offset + header.relocations.size), globals.size() * sizeof(uint32_t)};
+    header.relocation_count = static_cast<uint32_t>(entries.size());
+    header.global_count = static_cast<uint32_t>(globals.size());
+
+    std::vector<uint8_t> out;
+    out.reserve(header.globals.offset + header.globals.size);
+    put(out, &header, sizeof(header));
+    put(out, image.data(), image.size());
+    pad8(out);
+    put(out, entries.data(), entries.size() * sizeof(relocation_entry));
+    put(out, names.data(), names.size());
+    pad8(out);
+    put(out, globals.data(), globals.size() * sizeof(uint32_t));
+    return out;
+}
+
+bool read_object(const uint8_t* bytes, size_t size, object_file& out, std::string& error) {
+    out = object_file();
+    if (!is_object_file(bytes, size)) {
+        error = "not an object file";
+        return false;
+    }
+    object_header header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (header.version != OBJECT_VERSION) {
+        error = "unsupported object version " + std::to_string(header.version);
+        return false;
+    }
+    if (!section_in_file(header.module, size) || !section_in_file(header.relocations, size) ||
+        !section_in_file(header.globals, size) ||
+        header.relocations.size / sizeof(relocation_entry) < header.relocation_count ||
+        header.globals.size != size_t(header.global_count) * sizeof(uint32_t)) {
+        error = "object section out of range";
+        return false;
+    }
+
+    module_view module;
+    if (!parse_module(bytes + header.module.offset, header.module.size, module, error)) {
+        return false;
+    }
+    if (module.legacy) {
+        error = "object has no module header";
+        return false;
+    }
+    out.code.assign(module.code, module.code + module.code_size);
+    bool wide_data = false;
+    module.for_each_data([&](const data_record& record, const uint8_t* values) {
+        // 어셈블러는 8비트와 16비트 셀만 만듭니다.
+        if (record.d_type > BIT_16) {
+            wide_data = true;
+            return;
+        }
+        DataSegment segment{record.address, static_cast<uint8_t>(data_width(record.d_type)), {}};
+        segment.values.resize(record.count);
+        for (uint32_t i = 0; i < record.count; i++) {
+            segment.values[i] = segment.width == 1 ? values[i] : static_cast<uint16_t>(values[2 * i] | values[2 * i + 1] << 8);
+        }
+        out.data.push_back(std::move(segment));
+    });
+    if (wide_data) {
+        error = "object data wider than 16 bits";
+        return false;
+    }
+    for (const module_symbol& symbol : module.symbol_table()) {
+        out.symbols.push_back({symbol.name, symbol.address, false});
+    }
+
+    const uint8_t* globals = bytes + header.globals.offset;
+    for (uint32_t i = 0; i < header.global_count; i++) {
+        uint32_t index;
+        std::memcpy(&index, globals + i * sizeof(index), sizeof(index));
+        if (index >= out.symbols.size()) {
+            error = "global symbol index out of range";
+            return false;
+        }
+        out.symbols[index].global = true;
+    }
+
+    const uint8_t* relocations = bytes + header.relocations.offset;
+    size_t names_offset = size_t(header.relocation_count) * sizeof(relocation_entry);
+    size_t names_size = header.relocations.size - names_offset;
+    out.relocations.reserve(header.relocation_count);
+    for (uint32_t i = 0; i < header.relocation_count; i++) {
+        relocation_entry entry;
+        std::memcpy(&entry, relocations + i * sizeof(entry), sizeof(entry));
+        if (entry.name_offset > names_size || entry.name_size > names_size - entry.name_offset) {
+            error = "relocation name out of range";
+            return false;
+        }
+        if (entry.offset == 0 || entry.offset > out.code.size() || out.code.size() - entry.offset < 8) {
+            error = "relocation outside the code section";
+            return false;
+        }
+        const char* name = reinterpret_cast<const char*>(relocations + names_offset + entry.name_offset);
+        out.relocations.push_back({entry.offset, std::string(name, entry.name_size)});
+    }
+    return true;
+}
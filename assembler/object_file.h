@@ -0,0 +1,77 @@
+#ifndef OBJECT_FILE_H
+#define OBJECT_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "../engine/module_file.h"
+
+// .string, .bytes, .words가 만드는 초기화 데이터. 코드로 변환하지 않고
+// 모듈의 데이터 섹션에 담아 로더가 실행 전에 전역 메모리로 한 번에 복사합니다.
+struct DataSegment {
+    uint64_t address;
+    uint8_t width;                  // 값 하나의 바이트 수 (.string/.bytes: 1, .words: 2)
+    std::vector<uint16_t> values;
+};
+
+// 분기 피연산자의 주소 자리(128비트, 분기 명령어 다음 워드부터). 링커가 최종 주소를 씁니다.
+struct object_relocation {
+    uint64_t offset;     // 주소 자리의 워드 위치
+    std::string symbol;  // 비어 있으면 자리에 든 값이 오브젝트 시작 기준의 주소입니다.
+};
+
+struct object_symbol {
+    std::string name;
+    uint64_t address;    // 오브젝트 코드의 워드 주소
+    bool global;         // .global로 내보낸 심볼. 나머지는 이 오브젝트 안에서만 보입니다.
+};
+
+// 소스 하나를 어셈블한 결과. 코드는 주소 0에서 시작한다고 보고 만들어져 있습니다.
+struct object_file {
+    std::vector<uint16_t> code;
+    std::vector<DataSegment> data;
+    std::vector<object_symbol> symbols;
+    std::vector<object_relocation> relocations;
+};
+
+// dirtvm 오브젝트 파일 형식 (리틀 엔디언, 모든 섹션은 8바이트 정렬)
+//
+//   object_header            64 bytes
+//   module section           코드, 데이터와 모든 라벨을 담은 모듈 이미지 (module_file.h)
+//   relocation section       relocation_entry 배열 + 이름 문자열
+//   global section           내보내는 심볼의 모듈 심볼 인덱스 (uint32 배열)
+
+static const char OBJECT_MAGIC[4] = {'D', 'O', 'B', 'J'};
+static const uint32_t OBJECT_VERSION = 1;
+
+struct object_header {
+    char magic[4];
+    uint32_t version;
+    module_section module;
+    module_section relocations;
+    module_section globals;
+    uint32_t relocation_count;
+    uint32_t global_count;
+};
+
+static_assert(sizeof(object_header) == 64, "object_header layout");
+
+// name_size가 0이면 오브젝트 안의 주소를 가리키는 재배치입니다.
+struct relocation_entry {
+    uint64_t offset;
+    uint32_t name_offset;
+    uint32_t name_size;
+};
+
+static_assert(sizeof(relocation_entry) == 16, "relocation_entry layout");
+
+bool is_object_file(const uint8_t* bytes, size_t size);
+std::vector<uint8_t> write_object(const object_file& object);
+bool read_object(const uint8_t* bytes, size_t size, object_file& out, std::string& error);
+
+// 데이터 지시어의 결과를 모듈 데이터 섹션의 레코드로 바꿉니다.
+std::vector<module_data> module_data_of(const std::vector<DataSegment>& data);
+
+#endif // OBJECT_FILE_H
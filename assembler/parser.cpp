@@ -1,466 +1,659 @@
 #include "parser.h"
-#include <sstream>   // For std::stringstream
-#include <algorithm> // For std::find_if
-#include <cctype>    // For std::isspace
-#include <stdexcept> // For std::out_of_range, std::invalid_argument
-#include <iostream>  // For std::cerr
-#include <vector>    // For std::vector
-#include <string>    // For std::string
-#include <cstdint>
-#include <map>
-#include <variant>
-
-__uint128_t string_to_uint128(const std::string &s) {
-    __uint128_t res = 0;
-    size_t i = 0;
-    bool is_hex = false;
-
-    if (s.rfind("0x", 0) == 0) {
-        is_hex = true;
-        i = 2;
-    }
-
-    for (; i < s.length(); ++i) {
-        char c = s[i];
-        if (is_hex) {
-            if (c >= '0' && c <= '9') {
-                res = res * 16 + (c - '0');
-            } else if (c >= 'a' && c <= 'f') {
-                res = res * 16 + (c - 'a' + 10);
-            } else if (c >= 'A' && c <= 'F') {
-                res = res * 16 + (c - 'A' + 10);
+#include "../engine/opcode.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// 이 스레드가 어셈블하고 있는 소스의 이름 (Parser::parse()의 name)
+thread_local std::string_view source_name;
+
+[[noreturn]] void fail(size_t line, const std::string& message) {
+    // 여러 스레드가 동시에 실패해도 한 번만 보고하고 종료합니다.
+    static std::mutex failing;
+    failing.lock();
+    std::cerr << "Error: ";
+    if (!source_name.empty()) {
+        std::cerr << source_name << ": ";
+    }
+    std::cerr << "line " << line << ": " << message << std::endl;
+    exit(1);
+}
+
+struct token {
+    std::string_view text;  // 비어 있으면 소스의 끝
+    size_t line;
+};
+
+// 소스를 가리키는 토큰을 하나씩 꺼냅니다. 공백과 쉼표가 구분자이고 ';'부터 줄 끝까지는 주석입니다.
+// "..."와 '...'는 공백을 담을 수 있는 한 토큰이며 줄을 넘을 수 없습니다.
+class lexer {
+public:
+    explicit lexer(std::string_view source) : source(source) {}
+
+    token next() {
+        if (has_peeked) {
+            has_peeked = false;
+            return peeked;
+        }
+        return scan();
+    }
+
+    const token& peek() {
+        if (!has_peeked) {
+            peeked = scan();
+            has_peeked = true;
+        }
+        return peeked;
+    }
+
+private:
+    std::string_view source;
+    size_t position = 0;
+    size_t line = 1;
+    token peeked;
+    bool has_peeked = false;
+
+    static bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' || c == ',';
+    }
+
+    token scan() {
+        const size_t size = source.size();
+        while (position < size) {
+            char c = source[position];
+            if (c == '\n') {
+                line++;
+                position++;
+            } else if (is_space(c)) {
+                position++;
+            } else if (c == ';') {
+                while (position < size && source[position] != '\n') {
+                    position++;
+                }
+            } else {
+                break;
+            }
+        }
+        size_t begin = position;
+        if (position >= size) {
+            return {source.substr(size), line};
+        }
+        char quote = source[position];
+        if (quote == '"' || quote == '\'') {
+            position++;
+            while (position < size && source[position] != quote && source[position] != '\n') {
+                if (source[position] == '\\' && position + 1 < size && source[position + 1] != '\n') {
+                    position++;
+                }
+                position++;
+            }
+            if (position >= size || source[position] != quote) {
+                fail(line, quote == '"' ? "Unterminated string literal." : "Unterminated character literal.");
             }
+            position++;
         } else {
-            if (c >= '0' && c <= '9') {
-                res = res * 10 + (c - '0');
+            while (position < size && !is_space(source[position]) && source[position] != '\n' &&
+                   source[position] != ';') {
+                position++;
             }
         }
+        return {source.substr(begin, position - begin), line};
     }
-    return res;
-}
+};
 
-// Opcodes map
-const std::map<std::string, uint16_t> opcodes = {
-    {"add", 0b0000010000000000},
-    {"sub", 0b0000100000000000},
-    {"mul", 0b0000110000000000},
-    {"div", 0b0001000000000000},
-    {"pop", 0b0001100000000000},
-    {"dup", 0b0001110000000000},
-    {"jmp", 0b0010000000000000},
-    {"jz", 0b0010010000000000},
-    {"jnz", 0b0010100000000000},
-    {"call", 0b0010110000000000},
-    {"ret", 0b0011000000000000},
-    {"eq", 0b0011010000000000},
-    {"lt", 0b0011100000000000},
-    {"gt", 0b0011110000000000},
-    {"gload", 0b0100000000000000},
-    {"gstore", 0b0100010000000000},
-    {"lload", 0b0100100000000000},
-    {"lstore", 0b0100110000000000},
-    {"pushd8", 0b0101000000000000},
-    {"pushd16", 0b0101010000000000},
-    {"pushd32", 0b0101100000000000},
-    {"pushd64", 0b0101110000000000},
-    {"pushd128", 0b0110000000000000},
-    {"syscall", 0b0110010000000000},
+// 피연산자의 종류. 명령어 워드의 10비트 필드에 들어가는 것(FIELD)과 뒤따르는 워드에 들어가는 것이 있습니다.
+enum class operand_kind : uint8_t {
+    NONE,
+    U8,       // pushd8: 숫자나 문자 리터럴, 데이터 워드 하나
+    U16,      // pushd16, addi, gloadi, gstorei
+    U32,
+    U64,
+    U128,
+    FIELD,    // syscall, lload, lstore, shli, shri
+    ADDRESS,  // 분기: 라벨이나 128비트 주소
 };
 
-std::string unescape_string(const std::string& s) {
-    std::string res;
-    for (size_t i = 0; i < s.length(); ++i) {
-        if (s[i] == '\\' && i + 1 < s.length()) {
-            switch (s[++i]) {
-                case 'n': res += '\n'; break;
-                case 't': res += '\t'; break;
-                case 'r': res += '\r'; break;
-                case '0': res += '\0'; break;
-                case '\\': res += '\\'; break;
-                case '\'': res += '\''; break;
-                case '"': res += '"'; break;
-                default: res += s[i]; break;
+struct mnemonic {
+    uint8_t opcode;
+    operand_kind operand;
+};
+
+// 길이와 첫 글자로 후보를 좁힌 뒤 비교합니다.
+bool find_mnemonic(std::string_view name, mnemonic& out) {
+#define MNEMONIC(text, op, kind)                  \
+    if (name == text) {                           \
+        out = {op, operand_kind::kind};           \
+        return true;                              \
+    }
+    switch (name.size()) {
+        case 2:
+            MNEMONIC("eq", OP_EQ, NONE)
+            MNEMONIC("lt", OP_LT, NONE)
+            MNEMONIC("gt", OP_GT, NONE)
+            MNEMONIC("jz", OP_JZ, ADDRESS)
+            break;
+        case 3:
+            switch (name[0]) {
+                case 'a': MNEMONIC("add", OP_ADD, NONE) break;
+                case 's': MNEMONIC("sub", OP_SUB, NONE) break;
+                case 'm': MNEMONIC("mul", OP_MUL, NONE) break;
+                case 'd':
+                    MNEMONIC("div", OP_DIV, NONE)
+                    MNEMONIC("dup", OP_DUP, NONE)
+                    break;
+                case 'p': MNEMONIC("pop", OP_POP, NONE) break;
+                case 'r': MNEMONIC("ret", OP_RET, NONE) break;
+                case 'j':
+                    MNEMONIC("jmp", OP_JMP, ADDRESS)
+                    MNEMONIC("jnz", OP_JNZ, ADDRESS)
+                    MNEMONIC("jeq", OP_JEQ, ADDRESS)
+                    MNEMONIC("jne", OP_JNE, ADDRESS)
+                    MNEMONIC("jlt", OP_JLT, ADDRESS)
+                    MNEMONIC("jge", OP_JGE, ADDRESS)
+                    MNEMONIC("jgt", OP_JGT, ADDRESS)
+                    MNEMONIC("jle", OP_JLE, ADDRESS)
+                    MNEMONIC("jzk", OP_JZK, ADDRESS)
+                    break;
             }
-        } else {
-            res += s[i];
-        }
+            break;
+        case 4:
+            switch (name[0]) {
+                case 'h': MNEMONIC("halt", OP_HALT, NONE) break;
+                case 'c': MNEMONIC("call", OP_CALL, ADDRESS) break;
+                case 'j':
+                    MNEMONIC("jnzk", OP_JNZK, ADDRESS)
+                    MNEMONIC("join", OP_JOIN, NONE)
+                    break;
+                case 'a': MNEMONIC("addi", OP_ADDI, U16) break;
+                case 's':
+                    MNEMONIC("shli", OP_SHLI, FIELD)
+                    MNEMONIC("shri", OP_SHRI, FIELD)
+                    break;
+                case 'g': MNEMONIC("gcmp", OP_GCMP, NONE) break;
+            }
+            break;
+        case 5:
+            switch (name[0]) {
+                case 'g':
+                    MNEMONIC("gload", OP_GLOAD, NONE)
+                    MNEMONIC("gcopy", OP_GCOPY, NONE)
+                    MNEMONIC("gfill", OP_GFILL, NONE)
+                    break;
+                case 'l': MNEMONIC("lload", OP_LLOAD, FIELD) break;
+                case 's': MNEMONIC("spawn", OP_SPAWN, ADDRESS) break;
+                case 'y': MNEMONIC("yield", OP_YIELD, NONE) break;
+            }
+            break;
+        case 6:
+            MNEMONIC("pushd8", OP_PUSHD8, U8)
+            MNEMONIC("gstore", OP_GSTORE, NONE)
+            MNEMONIC("lstore", OP_LSTORE, FIELD)
+            MNEMONIC("gloadi", OP_GLOADI, U16)
+            break;
+        case 7:
+            if (name[0] == 'p') {
+                MNEMONIC("pushd16", OP_PUSHD16, U16)
+                MNEMONIC("pushd32", OP_PUSHD32, U32)
+                MNEMONIC("pushd64", OP_PUSHD64, U64)
+            }
+            MNEMONIC("syscall", OP_SYSCALL, FIELD)
+            MNEMONIC("gstorei", OP_GSTOREI, U16)
+            break;
+        case 8:
+            MNEMONIC("pushd128", OP_PUSHD128, U128)
+            break;
     }
-    return res;
+#undef MNEMONIC
+    return false;
 }
 
-
-// Helper function to trim whitespace from a string
-static inline void trim(std::string &s) {
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }));
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }).base(), s.end());
+uint16_t opcode_word(uint8_t opcode) {
+    return static_cast<uint16_t>(opcode << 10);
 }
 
-// Helper to parse a character literal like 'a' or '\n'
-// Returns true on success, false on failure. Stores result in 'out_char'.
-bool parseCharLiteral(const std::string& s, uint8_t& out_char) {
-    if (s.length() < 3 || s.front() != '\'' || s.back() != '\'') {
-        return false; // Must start and end with single quote, and have at least one character content (e.g., 'x')
+// strtoul(text, 0)처럼 0x는 16진수, 0으로 시작하면 8진수, 그 밖에는 10진수로 읽습니다.
+bool parse_unsigned(std::string_view text, uint64_t& out) {
+    int base = 10;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        text.remove_prefix(2);
+    } else if (text.size() > 1 && text[0] == '0') {
+        base = 8;
+        text.remove_prefix(1);
     }
+    const char* end = text.data() + text.size();
+    std::from_chars_result result = std::from_chars(text.data(), end, out, base);
+    return !text.empty() && result.ec == std::errc() && result.ptr == end;
+}
 
-    std::string content = s.substr(1, s.length() - 2);
+// 128비트 값. 0x로 시작하면 16진수, 그 밖에는 10진수입니다.
+bool parse_wide(std::string_view text, __uint128_t& out) {
+    unsigned base = 10;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        text.remove_prefix(2);
+    }
+    out = 0;
+    for (char c : text) {
+        unsigned digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (base == 16 && c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        out = out * base + digit;
+    }
+    return !text.empty();
+}
 
-    if (content.empty()) {
-        return false; // Empty character literal like '' is invalid
+char unescape(char c) {
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case '0': return '\0';
+        default: return c;  // \\, \', \" 와 그 밖의 문자는 그대로
     }
+}
 
-    if (content.length() == 1) {
-        // Simple single character literal, e.g., 'a' or ''' (if content is just '\'')
-        out_char = static_cast<uint8_t>(content[0]);
+// 'a'나 '\n' 같은 문자 리터럴
+bool parse_char(std::string_view text, uint8_t& out) {
+    if (text.size() < 3 || text.front() != '\'' || text.back() != '\'') {
+        return false;
+    }
+    std::string_view content = text.substr(1, text.size() - 2);
+    if (content.size() == 1) {
+        out = static_cast<uint8_t>(content[0]);
         return true;
-    } else  {
-        std::cout << "Escape" << std::endl;
-        // Escape sequence
-        char escape_char = content[1];
-        switch (escape_char) {
-            case 'n': out_char = '\n'; return true;
-            case 't': out_char = '\t'; return true;
-            case 'r': out_char = '\r'; return true;
-            case '0': out_char = '\0'; return true;
-            case '\\': out_char = '\\'; return true;
-            case '\'': out_char = '\''; return true;
-            case '"': out_char = '"'; return true;
-            default: return false;
-        }
     }
+    if (content.size() == 2 && content[0] == '\\') {
+        out = static_cast<uint8_t>(unescape(content[1]));
+        return true;
+    }
+    return false;
+}
 
-    return false; // Not a recognized character literal format
+// 명령어 뒤의 피연산자 토큰. 없으면 what을 담아 실패합니다.
+token operand(lexer& lex, const token& instruction, const char* what) {
+    token t = lex.next();
+    if (t.text.empty()) {
+        fail(instruction.line, std::string("Expected ") + what + " after " + std::string(instruction.text) + ".");
+    }
+    return t;
 }
 
+uint64_t unsigned_operand(const token& t) {
+    uint64_t value;
+    if (!parse_unsigned(t.text, value)) {
+        fail(t.line, "Invalid number " + std::string(t.text));
+    }
+    return value;
+}
 
-void Parser::split_token(std::string input) {
-    trim(input);
-    size_t comment_pos = input.find(';');
-    if (comment_pos != std::string::npos) {
-        input = input.substr(0, comment_pos);
-        trim(input);
+__uint128_t wide_operand(const token& t) {
+    __uint128_t value;
+    if (!parse_wide(t.text, value)) {
+        fail(t.line, "Invalid number " + std::string(t.text));
     }
-    if (input.empty()) {
-        return;
+    return value;
+}
+
+// 데이터 지시어의 전역 주소. 64비트 주소 공간 안이어야 합니다.
+uint64_t data_address(const token& t) {
+    __uint128_t address = wide_operand(t);
+    if ((address >> 64) != 0) {
+        fail(t.line, "Data address " + std::string(t.text) + " is outside the 64-bit global memory.");
     }
+    return static_cast<uint64_t>(address);
+}
 
-    std::string current_token;
-    bool in_string = false;
-    for (size_t i = 0; i < input.length(); ++i) {
-        char c = input[i];
+// .bytes/.words 뒤에 이어지는 값인지 확인합니다. 명령어는 숫자로 시작하지 않고, 숫자 라벨은 ':'로 끝납니다.
+bool is_data_literal(std::string_view text) {
+    return !text.empty() && ((text[0] >= '0' && text[0] <= '9') || text[0] == '\'') && text.back() != ':';
+}
 
-        if (c == '"' && (i == 0 || input[i-1] != '\\')) {
-            if (in_string) {
-                // End of string
-                current_token += c;
-                tokens.push_back(current_token);
-                current_token.clear();
-                in_string = false;
-            } else {
-                // Start of string
-                if (!current_token.empty()) {
-                    tokens.push_back(current_token);
-                    current_token.clear();
-                }
-                current_token += c;
-                in_string = true;
-            }
-        } else if ((std::isspace(c) || c == ',') && !in_string) {
-            if (!current_token.empty()) {
-                tokens.push_back(current_token);
-                current_token.clear();
-            }
-        } else {
-            current_token += c;
-        }
+__uint128_t read_wide(const uint16_t* words) {
+    __uint128_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 16) | words[i];
     }
+    return value;
+}
 
-    if (!current_token.empty()) {
-        if (in_string) {
-            std::cerr << "Error: Unterminated string literal." << std::endl;
-            exit(1);
-        }
-        tokens.push_back(current_token);
+void write_wide(uint16_t* words, __uint128_t value) {
+    for (int i = 0; i < 8; i++) {
+        words[i] = static_cast<uint16_t>(value >> (16 * i));
+    }
+}
+
+// 인접한 두 명령어를 하나의 슈퍼 명령어로 합칠 수 있으면 out에 덧붙이고 true를 반환합니다.
+bool fuse_pair(const uint16_t* first, const uint16_t* second, std::vector<uint16_t>& out) {
+    if (first[0] == opcode_word(OP_PUSHD8) || first[0] == opcode_word(OP_PUSHD16)) {
+        uint8_t fused;
+        if (second[0] == opcode_word(OP_GSTORE)) fused = OP_GSTOREI;
+        else if (second[0] == opcode_word(OP_ADD)) fused = OP_ADDI;
+        else if (second[0] == opcode_word(OP_GLOAD)) fused = OP_GLOADI;
+        else return false;
+        out.push_back(opcode_word(fused));
+        out.push_back(first[1]);
+        return true;
+    }
+
+    if (second[0] != opcode_word(OP_JZ) && second[0] != opcode_word(OP_JNZ)) {
+        return false;
     }
+    bool on_zero = second[0] == opcode_word(OP_JZ);
+    uint8_t fused;
+    if (first[0] == opcode_word(OP_EQ)) fused = on_zero ? OP_JNE : OP_JEQ;
+    else if (first[0] == opcode_word(OP_LT)) fused = on_zero ? OP_JGE : OP_JLT;
+    else if (first[0] == opcode_word(OP_GT)) fused = on_zero ? OP_JLE : OP_JGT;
+    else if (first[0] == opcode_word(OP_DUP)) fused = on_zero ? OP_JZK : OP_JNZK;
+    else return false;
+    out.push_back(opcode_word(fused));
+    out.insert(out.end(), second + 1, second + 9);
+    return true;
 }
 
+} // namespace
+
 Parser::Parser() {}
 Parser::~Parser() {}
-std::map<std::string, __uint128_t> label_addresses;
 
-void Parser::parse(std::string input_assembly_code) {
-    this->tokens.clear();
-    this->instructions.clear();
+const std::vector<DataSegment>& Parser::get_data() const {
+    return data;
+}
+
+std::map<std::string, __uint128_t> Parser::get_labels() const {
+    return labels;
+}
 
-    std::stringstream ss(input_assembly_code);
-    std::string line;
-    while (std::getline(ss, line)) {
-        split_token(line);
+std::vector<uint16_t> Parser::get_bytecode() const {
+    return bytecode;
+}
+
+void Parser::set_optimization_level(int level) {
+    optimization_level = level;
+}
+
+void Parser::set_relocatable(bool enabled) {
+    relocatable = enabled;
+}
+
+object_file Parser::get_object() const {
+    object_file object{bytecode, data, {}, relocations};
+    object.symbols.reserve(labels.size());
+    for (const auto& label : labels) {
+        bool global = std::binary_search(globals.begin(), globals.end(), label.first);
+        object.symbols.push_back({label.first, static_cast<uint64_t>(label.second), global});
     }
-    first_pass();
-    token_to_data();
+    return object;
 }
 
-void Parser::token_to_data() {
-    instructions.clear(); // 두 번째 패스를 위해 비웁니다.
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        const std::string& token = tokens[i];
-        if (token == ".string") {
-            if (i + 2 >= tokens.size()) { std::cerr << "Error: .string requires an address and a string literal." << std::endl; exit(1); }
-            
-            uint16_t address = std::stoul(tokens[++i]);
-            std::string str_literal = tokens[++i];
-
-            if (str_literal.front() != '"' || str_literal.back() != '"') { std::cerr << "Error: Expected string literal for .string." << std::endl; exit(1); }
-            
-            Instruction instr;
-            instr.type = InstructionType::STRING;
-            String s;
-            s.address = address;
-            s.value = unescape_string(str_literal.substr(1, str_literal.length() - 2));
-            instr.args = s;
-            instructions.push_back(instr);
-        } else if (token == "pushd8") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 8-bit data after pushd8." << std::endl; exit(1); }
-            uint8_t val;
-            if (parseCharLiteral(tokens[i], val)) {
-                instructions.push_back({InstructionType::PUSH8, Pushd8{val}});
-            } else {
-                instructions.push_back({InstructionType::PUSH8, Pushd8{(uint8_t)std::stoul(tokens[i], nullptr, 0)}});
+// 128비트 주소를 낮은 워드부터 씁니다.
+void Parser::emit_address(__uint128_t address) {
+    size_t offset = bytecode.size();
+    bytecode.resize(offset + 8);
+    write_wide(&bytecode[offset], address);
+}
+
+void Parser::parse(std::string_view source, std::string_view name) {
+    bytecode.clear();
+    starts.clear();
+    data.clear();
+    label_table.clear();
+    fixups.clear();
+    labels.clear();
+    global_names.clear();
+    globals.clear();
+    relocations.clear();
+    source_name = name;
+    bytecode.reserve(source.size() / 4);
+
+    lexer lex(source);
+    for (token t = lex.next(); !t.text.empty(); t = lex.next()) {
+        std::string_view text = t.text;
+
+        if (text.back() == ':') {
+            std::string_view name = text.substr(0, text.size() - 1);
+            if (name.empty()) {
+                fail(t.line, "Empty label name.");
             }
-        } else if (token == "pushd16") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 16-bit data after pushd16." << std::endl; exit(1); }
-            instructions.push_back({InstructionType::PUSH16, Pushd16{(uint16_t)std::stoul(tokens[i], nullptr, 0)}});
-        } else if (token == "pushd128") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 128-bit data after pushd128." << std::endl; exit(1); }
-            instructions.push_back({InstructionType::PUSH128, Pushd128{string_to_uint128(tokens[i])}});
-        } else if (token == "pushd32") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 32-bit data after pushd32." << std::endl; exit(1); }
-            instructions.push_back({InstructionType::PUSH32, Pushd32{(uint32_t)std::stoul(tokens[i], nullptr, 0)}});
-        } else if (token == "pushd64") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 64-bit data after pushd64." << std::endl; exit(1); }
-            instructions.push_back({InstructionType::PUSH64, Pushd64{(uint64_t)string_to_uint128(tokens[i])}});
-        } else if (token == "jmp") { 
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 128-bit data after jmp." << std::endl; exit(1); }
-            if (label_addresses.count(tokens[i])) {
-                instructions.push_back({InstructionType::JMP, Pushd128{label_addresses.at(tokens[i])}});
-            } else {
-                instructions.push_back({InstructionType::JMP, Pushd128{string_to_uint128(tokens[i])}});
+            if (!label_table.emplace(name, bytecode.size()).second) {
+                fail(t.line, "Duplicate label " + std::string(name));
             }
-        } else if (token == "gstore") {
-            instructions.push_back({InstructionType::GSTORE, Gstore{}});
-        } else if (token == "syscall") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected syscall number after syscall." << std::endl; exit(1); }
-            instructions.push_back({InstructionType::SYSCALL, Syscall{(uint8_t)std::stoul(tokens[i], nullptr, 0)}});
-        } else if (token == "lload") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 10-bit tag after lload." << std::endl; exit(1); }
-            instructions.push_back({InstructionType::LLOAD, Lload{(uint16_t)std::stoul(tokens[i], nullptr, 0)}});
-        } else if (token == "lstore") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected 10-bit tag after lstore." << std::endl; exit(1); }
-            instructions.push_back({InstructionType::LSTORE, Lstore{(uint16_t)std::stoul(tokens[i], nullptr, 0)}});
-        } else if (token == "call" || token == "jz" || token == "jnz") {
-            if (++i >= tokens.size()) { std::cerr << "Error: Expected address after " << token << std::endl; exit(1); }
-            __uint128_t address;
-            if (label_addresses.count(tokens[i])) {
-                address = label_addresses.at(tokens[i]);
-            } else {
-                address = string_to_uint128(tokens[i]);
+            continue;
+        }
+
+        if (text == ".global") {
+            token label = operand(lex, t, "a label name");
+            global_names.emplace_back(label.text, label.line);
+            continue;
+        }
+        if (text == ".string") {
+            uint64_t address = data_address(operand(lex, t, "an address"));
+            token literal = operand(lex, t, "a string literal");
+            if (literal.text.front() != '"') {
+                fail(literal.line, "Expected string literal for .string.");
             }
-            if (token == "call") instructions.push_back({InstructionType::CALL, Pushd128{address}});
-            else if (token == "jz") instructions.push_back({InstructionType::JZ, Pushd128{address}});
-            else if (token == "jnz") instructions.push_back({InstructionType::JNZ, Pushd128{address}});
-        } else {
-             if (opcodes.count(token)) {
-                Instruction instr;
-                instr.type = InstructionType::OPCODE;
-                instr.args = Opcode{opcodes.at(token)};
-                instructions.push_back(instr);
-             } else if (token.back() == ':') {
-                // 라벨 정의는 두 번째 패스에서 무시합니다.
-                continue;
-             } else {
-                std::cerr << "Unknown token: " << token << std::endl;
-                exit(1);
+            DataSegment segment{address, 1, {}};
+            std::string_view content = literal.text.substr(1, literal.text.size() - 2);
+            segment.values.reserve(content.size());
+            for (size_t i = 0; i < content.size(); i++) {
+                char c = content[i] == '\\' && i + 1 < content.size() ? unescape(content[++i]) : content[i];
+                segment.values.push_back(static_cast<uint8_t>(c));
             }
+            data.push_back(std::move(segment));
+            continue;
         }
-    }
-}
-
-void Parser::first_pass() {
-    label_addresses.clear();
-    __uint128_t current_address = 0;
-
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        const std::string& token = tokens[i];
-
-        if (token.back() == ':') {
-            std::string label = token.substr(0, token.length() - 1);
-            label_addresses[label] = current_address;
-        } else if (token == ".string") {
-            if (i + 2 >= tokens.size()) { std::cerr << "Error: .string requires an address and a string literal." << std::endl; exit(1); }
-            std::string str_literal = tokens[i+2];
-            std::string unescaped = unescape_string(str_literal.substr(1, str_literal.length() - 2));
-            current_address += unescaped.length() * 5; // pushd8(2) + pushd16(2) + gstore(1) = 5 words per char
-            i += 2;
-        } else if (token == "pushd8") {
-            current_address += 2; // Instruction word + data word
-            i += 1;
-        } else if (token == "pushd16") {
-            current_address += 2;
-            i += 1;
-        } else if (token == "pushd32") {
-            current_address += 3;
-            i += 1;
-        } else if (token == "pushd64") {
-            current_address += 5;
-            i += 1;
-        } else if (token == "pushd128") {
-            current_address += 9;
-            i += 1;
-        } else if (token == "jmp" || token == "call" || token == "jz" || token == "jnz") {
-            current_address += 9; // opcode + 8-word address
-            i += 1;
-        } else if (token == "syscall") {
-            current_address += 1;
-            i += 1;
-        } else if (token == "lload" || token == "lstore") {
-            current_address += 1;
-            i += 1;
-        } else if (opcodes.count(token)) {
-            current_address += 1;
-        } else {
-            // Unknown token or already handled (like label value)
+        if (text == ".bytes" || text == ".words") {
+            bool bytes = text == ".bytes";
+            DataSegment segment{data_address(operand(lex, t, "an address")), static_cast<uint8_t>(bytes ? 1 : 2), {}};
+            uint64_t limit = bytes ? 0xFF : 0xFFFF;
+            while (is_data_literal(lex.peek().text)) {
+                token literal = lex.next();
+                uint8_t c;
+                if (parse_char(literal.text, c)) {
+                    segment.values.push_back(c);
+                    continue;
+                }
+                uint64_t value = unsigned_operand(literal);
+                if (value > limit) {
+                    fail(literal.line, "Value " + std::string(literal.text) + " does not fit in " + std::string(text));
+                }
+                segment.values.push_back(static_cast<uint16_t>(value));
+            }
+            data.push_back(std::move(segment));
+            continue;
         }
-    }
-}
-
 
-std::vector<uint16_t> Parser::get_bytecode() {
-    std::vector<uint16_t> bytecode;
-    for (const auto& instr : instructions) {
-        switch (instr.type) {
-            case InstructionType::PUSH8:
-                bytecode.push_back(opcodes.at("pushd8"));
-                bytecode.push_back(std::get<Pushd8>(instr.args).value);
-                break;
-            case InstructionType::PUSH16:
-                bytecode.push_back(opcodes.at("pushd16"));
-                bytecode.push_back(std::get<Pushd16>(instr.args).value);
-                break;
-            case InstructionType::PUSH32:
-                {
-                    bytecode.push_back(opcodes.at("pushd32"));
-                    uint32_t value = std::get<Pushd32>(instr.args).value;
-                    bytecode.push_back(value & 0xFFFF);
-                    bytecode.push_back((value >> 16) & 0xFFFF);
-                }
+        mnemonic m;
+        if (!find_mnemonic(text, m)) {
+            fail(t.line, "Unknown token: " + std::string(text));
+        }
+        starts.push_back(static_cast<uint32_t>(bytecode.size()));
+        uint16_t word = opcode_word(m.opcode);
+        switch (m.operand) {
+            case operand_kind::NONE:
+                bytecode.push_back(word);
                 break;
-            case InstructionType::PUSH64:
-                {
-                    bytecode.push_back(opcodes.at("pushd64"));
-                    uint64_t value = std::get<Pushd64>(instr.args).value;
-                    bytecode.push_back(value & 0xFFFF);
-                    bytecode.push_back((value >> 16) & 0xFFFF);
-                    bytecode.push_back((value >> 32) & 0xFFFF);
-                    bytecode.push_back((value >> 48) & 0xFFFF);
+            case operand_kind::U8: {
+                token value = operand(lex, t, "8-bit data");
+                uint8_t c;
+                if (!parse_char(value.text, c)) {
+                    c = static_cast<uint8_t>(unsigned_operand(value));
                 }
+                bytecode.push_back(word);
+                bytecode.push_back(c);
                 break;
-            case InstructionType::PUSH128:
-                {
-                    bytecode.push_back(opcodes.at("pushd128"));
-                    __uint128_t value = std::get<Pushd128>(instr.args).value;
-                    uint64_t low = (uint64_t)value;
-                    uint64_t high = (uint64_t)(value >> 64);
-                    bytecode.push_back(low & 0xFFFF);
-                    bytecode.push_back((low >> 16) & 0xFFFF);
-                    bytecode.push_back((low >> 32) & 0xFFFF);
-                    bytecode.push_back((low >> 48) & 0xFFFF);
-                    bytecode.push_back(high & 0xFFFF);
-                    bytecode.push_back((high >> 16) & 0xFFFF);
-                    bytecode.push_back((high >> 32) & 0xFFFF);
-                    bytecode.push_back((high >> 48) & 0xFFFF);
-                }
+            }
+            case operand_kind::U16:
+                bytecode.push_back(word);
+                bytecode.push_back(static_cast<uint16_t>(unsigned_operand(operand(lex, t, "16-bit data"))));
                 break;
-            case InstructionType::CALL:
-            case InstructionType::JZ:
-            case InstructionType::JNZ:
-                {
-                    if (instr.type == InstructionType::CALL) bytecode.push_back(opcodes.at("call"));
-                    else if (instr.type == InstructionType::JZ) bytecode.push_back(opcodes.at("jz"));
-                    else if (instr.type == InstructionType::JNZ) bytecode.push_back(opcodes.at("jnz"));
-
-                    __uint128_t value = std::get<Pushd128>(instr.args).value;
-                    uint64_t low = (uint64_t)value;
-                    uint64_t high = (uint64_t)(value >> 64);
-                    bytecode.push_back(low & 0xFFFF);
-                    bytecode.push_back((low >> 16) & 0xFFFF);
-                    bytecode.push_back((low >> 32) & 0xFFFF);
-                    bytecode.push_back((low >> 48) & 0xFFFF);
-                    bytecode.push_back(high & 0xFFFF);
-                    bytecode.push_back((high >> 16) & 0xFFFF);
-                    bytecode.push_back((high >> 32) & 0xFFFF);
-                    bytecode.push_back((high >> 48) & 0xFFFF);
-                }
+            case operand_kind::U32: {
+                uint32_t value = static_cast<uint32_t>(unsigned_operand(operand(lex, t, "32-bit data")));
+                bytecode.insert(bytecode.end(), {word, static_cast<uint16_t>(value), static_cast<uint16_t>(value >> 16)});
                 break;
-            case InstructionType::JMP:
-                {
-                bytecode.push_back(opcodes.at("jmp"));
-                __uint128_t value = std::get<Pushd128>(instr.args).value;
-                uint64_t jlow = (uint64_t)value;
-                uint64_t jhigh = (uint64_t)(value >> 64);
-                bytecode.push_back(jlow & 0xFFFF);
-                bytecode.push_back((jlow >> 16) & 0xFFFF);
-                bytecode.push_back((jlow >> 32) & 0xFFFF);
-                bytecode.push_back((jlow >> 48) & 0xFFFF);
-                bytecode.push_back(jhigh & 0xFFFF);
-                bytecode.push_back((jhigh >> 16) & 0xFFFF);
-                bytecode.push_back((jhigh >> 32) & 0xFFFF);
-                bytecode.push_back((jhigh >> 48) & 0xFFFF);
+            }
+            case operand_kind::U64: {
+                uint64_t value = static_cast<uint64_t>(wide_operand(operand(lex, t, "64-bit data")));
+                bytecode.push_back(word);
+                for (int i = 0; i < 4; i++) {
+                    bytecode.push_back(static_cast<uint16_t>(value >> (16 * i)));
                 }
                 break;
-            case InstructionType::GSTORE:
-                bytecode.push_back(opcodes.at("gstore"));
-                break;
-            case InstructionType::SYSCALL:
-                // syscall opcode와 syscall 번호를 하나의 16비트 명령어로 합칩니다.
-                // Opcode: 6 bits, Syscall number: 10 bits
-                bytecode.push_back(opcodes.at("syscall") | (std::get<Syscall>(instr.args).value & 0x03FF));
+            }
+            case operand_kind::U128:
+                bytecode.push_back(word);
+                emit_address(wide_operand(operand(lex, t, "128-bit data")));
                 break;
-            case InstructionType::LLOAD:
-                {
-                    uint16_t tag = std::get<Lload>(instr.args).tag;
-                    bytecode.push_back(opcodes.at("lload") | (tag & 0x3FF));
-                }
+            case operand_kind::FIELD:
+                bytecode.push_back(word | (unsigned_operand(operand(lex, t, "a 10-bit operand")) & 0x3FF));
                 break;
-            case InstructionType::LSTORE:
-                {
-                    uint16_t tag = std::get<Lstore>(instr.args).tag;
-                    bytecode.push_back(opcodes.at("lstore") | (tag & 0x3FF));
-                }
-                break;
-            case InstructionType::STRING:
-                {
-                    const auto& s = std::get<String>(instr.args);
-                    uint16_t current_address = s.address;
-                    for (char c : s.value) {
-                        // pushd8 'c'
-                        bytecode.push_back(opcodes.at("pushd8"));
-                        bytecode.push_back(static_cast<uint8_t>(c));
-                        // pushd16 address
-                        bytecode.push_back(opcodes.at("pushd16"));
-                        bytecode.push_back(current_address++);
-                        // gstore
-                        bytecode.push_back(opcodes.at("gstore"));
+            case operand_kind::ADDRESS: {
+                token target = operand(lex, t, "an address");
+                bytecode.push_back(word);
+                auto label = label_table.find(target.text);
+                if (label != label_table.end()) {
+                    if (relocatable) {
+                        relocations.push_back({bytecode.size(), {}});
                     }
+                    emit_address(label->second);
+                    break;
                 }
+                // 아직 나오지 않은 라벨. 끝에서 채웁니다. 숫자는 그런 라벨이 없을 때 주소로 씁니다.
+                bool numeric = target.text[0] >= '0' && target.text[0] <= '9';
+                fixups.push_back({bytecode.size(), target.text, target.line, numeric, numeric ? wide_operand(target) : 0});
+                emit_address(0);
                 break;
-            case InstructionType::OPCODE:
-                bytecode.push_back(std::get<Opcode>(instr.args).code);
-                break;
+            }
         }
     }
-    return bytecode;
+
+    resolve_fixups();
+    if (optimization_level >= 1) {
+        peephole();
+    }
+    for (const auto& label : label_table) {
+        labels.emplace(std::string(label.first), label.second);
+    }
+    for (const auto& global : global_names) {
+        if (label_table.find(global.first) == label_table.end()) {
+            fail(global.second, "Undefined global label " + std::string(global.first));
+        }
+        globals.emplace_back(global.first);
+    }
+    std::sort(globals.begin(), globals.end());
+    globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+    std::sort(relocations.begin(), relocations.end(),
+              [](const object_relocation& a, const object_relocation& b) { return a.offset < b.offset; });
+    // 이름이 소스를 가리키므로 parse()가 끝나면 버립니다.
+    label_table.clear();
+    fixups.clear();
+    global_names.clear();
+    source_name = {};
+}
+
+void Parser::resolve_fixups() {
+    for (const label_fixup& fixup : fixups) {
+        auto label = label_table.find(fixup.name);
+        if (label != label_table.end()) {
+            write_wide(&bytecode[fixup.offset], label->second);
+        } else if (fixup.numeric) {
+            write_wide(&bytecode[fixup.offset], fixup.address);
+        } else if (relocatable) {
+            // 다른 오브젝트가 내보내는 심볼. 주소 자리는 링커가 채웁니다.
+            relocations.push_back({fixup.offset, std::string(fixup.name)});
+            continue;
+        } else {
+            fail(fixup.line, "Undefined label " + std::string(fixup.name));
+        }
+        if (relocatable) {
+            relocations.push_back({fixup.offset, {}});
+        }
+    }
+}
+
+// 자주 나오는 명령어 쌍을 슈퍼 명령어로 바꾸고 라벨과 분기 주소를 다시 계산합니다.
+// 분기 대상이 되는 명령어는 쌍의 두 번째 자리에 올 수 없습니다.
+void Parser::peephole() {
+    const size_t old_end = bytecode.size();
+    std::vector<bool> is_start(old_end + 1, false);
+    std::vector<bool> is_target(old_end + 1, false);
+    for (uint32_t start : starts) {
+        is_start[start] = true;
+    }
+    is_start[old_end] = true;
+    for (uint32_t start : starts) {
+        if (is_branch_opcode(bytecode[start] >> 10)) {
+            __uint128_t address = read_wide(&bytecode[start + 1]);
+            // 명령어 중간으로 뛰는 프로그램은 워드 배치에 의존하므로 건드리지 않습니다.
+            if (address < old_end && !is_start[address]) {
+                return;
+            }
+            if (address <= old_end) {
+                is_target[address] = true;
+            }
+        }
+    }
+    for (const auto& label : label_table) {
+        is_target[label.second] = true;
+    }
+
+    const uint64_t UNMAPPED = UINT64_MAX;
+    std::vector<uint64_t> address_map(old_end + 1, UNMAPPED);
+    std::vector<uint16_t> optimized;
+    std::vector<uint32_t> optimized_starts;
+    optimized.reserve(old_end);
+    optimized_starts.reserve(starts.size());
+    for (size_t i = 0; i < starts.size(); i++) {
+        size_t start = starts[i];
+        size_t next = i + 1 < starts.size() ? starts[i + 1] : old_end;
+        address_map[start] = optimized.size();
+        optimized_starts.push_back(static_cast<uint32_t>(optimized.size()));
+        if (i + 1 < starts.size() && !is_target[next] && fuse_pair(&bytecode[start], &bytecode[next], optimized)) {
+            ++i;
+        } else {
+            optimized.insert(optimized.end(), bytecode.begin() + start, bytecode.begin() + next);
+        }
+    }
+    address_map[old_end] = optimized.size();
+    const size_t new_end = optimized.size();
+
+    // 프로그램 밖을 가리키는 주소는 끝에서의 거리를 유지합니다.
+    auto remap = [&](__uint128_t address) -> __uint128_t {
+        if (address <= old_end && address_map[static_cast<size_t>(address)] != UNMAPPED) {
+            return address_map[static_cast<size_t>(address)];
+        }
+        return address - old_end + new_end;
+    };
+    for (uint32_t start : optimized_starts) {
+        if (is_branch_opcode(optimized[start] >> 10)) {
+            write_wide(&optimized[start + 1], remap(read_wide(&optimized[start + 1])));
+        }
+    }
+    for (auto& label : label_table) {
+        label.second = remap(label.second);
+    }
+    // 주소 자리는 분기 명령어를 따라 옮깁니다. 쌍의 두 번째로 합쳐진 분기는 쌍의 첫 명령어 자리로 갑니다.
+    for (object_relocation& relocation : relocations) {
+        size_t start = relocation.offset - 1;
+        if (address_map[start] == UNMAPPED) {
+            start = *(std::lower_bound(starts.begin(), starts.end(), start) - 1);
+        }
+        relocation.offset = address_map[start] + 1;
+    }
+    bytecode = std::move(optimized);
+    starts = std::move(optimized_starts);
 }
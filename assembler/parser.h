@@ -1,95 +1,59 @@
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 #include <cstdint>
-#include <variant>
+#include <map>
+#include <unordered_map>
 
-enum class InstructionType {
-    PUSH8,
-    PUSH16,
-    PUSH32,
-    PUSH64,
-    PUSH128,
-    LLOAD,
-    LSTORE,
-    GSTORE,
-    SYSCALL,
-    JMP,
-    JZ,
-    JNZ,
-    CALL,
-    STRING,
-    OPCODE,
-};
-
-struct Pushd8 {
-    uint8_t value;
-};
-
-struct Pushd16 {
-    uint16_t value;
-};
-
-struct Pushd32 {
-    uint32_t value;
-};
-
-struct Pushd64 {
-    uint64_t value;
-};
-
-struct Pushd128 {
-    __uint128_t value;
-};
-
-struct Jmp {
-    __uint128_t address;
-};
-
-struct Opcode {
-    uint16_t code;
-};
-
-struct Gstore {};
-
-struct Syscall {
-    uint16_t value;
-};
-
-struct String {
-    uint16_t address;
-    std::string value;
-};
-
-struct Lload {
-    uint16_t tag;
-};
-
-struct Lstore {
-    uint16_t tag;
-};
-
-
-struct Instruction {
-    InstructionType type;
-    std::variant<Pushd8, Pushd16, Pushd32, Pushd64, Pushd128, Lload, Lstore, Gstore, Syscall, String, Opcode> args;
-};
+#include "object_file.h"
 
+// 한 번의 패스로 소스를 읽으며 바이트코드를 바로 씁니다. 토큰은 소스를 가리키는 string_view라
+// 토큰마다 할당하지 않고, 아직 정의되지 않은 라벨로의 분기는 주소 자리를 남겨 두었다가 끝에서 채웁니다.
 class Parser {
 private:
-    std::vector<std::string> tokens;
-    std::vector<uint16_t> bytecode;
-    std::vector<Instruction> instructions;
+    // 아직 정의되지 않은 라벨을 가리키는 분기의 주소 자리.
+    // 라벨은 숫자여도 되며("200:"), 분기의 피연산자는 같은 이름의 라벨이 있으면 라벨, 없으면 주소입니다.
+    struct label_fixup {
+        size_t offset;          // 주소를 채울 워드 위치 (분기 명령어 다음 워드)
+        std::string_view name;
+        size_t line;
+        bool numeric;           // 같은 이름의 라벨이 없으면 address를 씁니다.
+        __uint128_t address;
+    };
 
-    void split_token(std::string input);
-    void token_to_data();
-    void first_pass();
-    std::vector<uint16_t> token_to_data(std::string input, size_t size);
+    std::vector<uint16_t> bytecode;
+    std::vector<uint32_t> starts;   // 명령어마다 시작 워드 위치 (-O1 피프홀용)
+    std::vector<DataSegment> data;
+    // 라벨 이름 -> 워드 주소. 이름은 parse()에 넘긴 소스를 가리키므로 parse() 안에서만 씁니다.
+    std::unordered_map<std::string_view, __uint128_t> label_table;
+    std::vector<label_fixup> fixups;
+    std::map<std::string, __uint128_t> labels;
+    std::vector<std::pair<std::string_view, size_t>> global_names;  // .global의 이름과 줄
+    std::vector<std::string> globals;   // .global로 내보낸 라벨 (정렬됨)
+    // 재배치 가능 모드에서 분기 피연산자마다 하나씩 남깁니다.
+    std::vector<object_relocation> relocations;
+    int optimization_level = 0;
+    bool relocatable = false;
+
+    void emit_address(__uint128_t address);
+    void resolve_fixups();
+    void peephole();
 
 public:
     Parser();
     ~Parser();
 
-    void parse(std::string input);
-    std::vector<uint16_t> get_bytecode();
-};
\ No newline at end of file
+    // 0: 소스 그대로 변환, 1: 피프홀 최적화로 슈퍼 명령어를 만듭니다.
+    void set_optimization_level(int level);
+    // 켜면 정의되지 않은 라벨로의 분기를 오류 대신 가져오는 심볼로 남기고, 모든 분기 주소에 재배치를 기록합니다.
+    void set_relocatable(bool enabled);
+    // name은 오류 메시지에 붙는 소스 이름입니다.
+    void parse(std::string_view source, std::string_view name = {});
+    std::vector<uint16_t> get_bytecode() const;
+    const std::vector<DataSegment>& get_data() const;
+    // 마지막으로 parse()한 소스의 라벨과 워드 주소
+    std::map<std::string, __uint128_t> get_labels() const;
+    // 마지막으로 parse()한 소스를 오브젝트로 만듭니다. 재배치는 재배치 가능 모드에서만 담깁니다.
+    object_file get_object() const;
+};
@@ -0,0 +1,76 @@
+// bench/dispatch_bench.cpp
+// 루프 위주의 바이트코드로 디스패치 엔진의 초당 명령어 수를 측정합니다.
+// make bench-dispatch 로 threaded/switch 두 엔진을 각각 빌드해 실행합니다.
+// threaded 빌드는 같은 워크로드를 JIT으로도 실행합니다.
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include "../engine/vm.h"
+#include "../engine/opcode.h"
+
+#define OPC(op) (uint16_t)((op) << 10)
+
+static void emit_address(std::vector<uint16_t>& code, uint64_t address) {
+    for (int i = 0; i < 8; i++) {
+        code.push_back(i < 4 ? (address >> (16 * i)) & 0xFFFF : 0);
+    }
+}
+
+// counter = n; do { counter = counter - 1 } while (counter != 0)
+// 반복당 4개 명령어 (pushd16, sub, dup, jnz)
+static std::vector<uint16_t> countdown_loop(uint32_t n) {
+    std::vector<uint16_t> code = { OPC(OP_PUSHD32), (uint16_t)(n & 0xFFFF), (uint16_t)(n >> 16) };
+    uint64_t loop = code.size();
+    code.insert(code.end(), { OPC(OP_PUSHD16), 1, OPC(OP_SUB), OPC(OP_DUP), OPC(OP_JNZ) });
+    emit_address(code, loop);
+    return code;
+}
+
+// acc = 0; for (i = n; i != 0; i--) acc += i  (acc는 전역 메모리 0번지)
+// 반복당 10개 명령어
+static std::vector<uint16_t> accumulate_loop(uint32_t n) {
+    std::vector<uint16_t> code = {
+        OPC(OP_PUSHD16), 0, OPC(OP_PUSHD16), 0, OPC(OP_GSTORE),
+        OPC(OP_PUSHD32), (uint16_t)(n & 0xFFFF), (uint16_t)(n >> 16),
+    };
+    uint64_t loop = code.size();
+    code.insert(code.end(), {
+        OPC(OP_DUP), OPC(OP_PUSHD16), 0, OPC(OP_GLOAD), OPC(OP_ADD), OPC(OP_PUSHD16), 0, OPC(OP_GSTORE),
+        OPC(OP_PUSHD16), 1, OPC(OP_SUB), OPC(OP_DUP), OPC(OP_JNZ),
+    });
+    emit_address(code, loop);
+    return code;
+}
+
+static void run_case(const std::string& name, const std::vector<uint16_t>& code, uint64_t instructions,
+                     bool jit = false) {
+    vm_options options;
+    options.enable_jit = jit;
+    options.jit_threshold = 0;
+    vm machine(code, options);
+    auto start = std::chrono::steady_clock::now();
+    machine.run();
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << (jit ? "jit" : vm::dispatch_name()) << "\t" << name << "\t"
+              << instructions << " insns\t"
+              << seconds * 1000.0 << " ms\t"
+              << (instructions / seconds) / 1e6 << " Minsn/s" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t n = argc > 1 ? (uint32_t)std::strtoul(argv[1], nullptr, 0) : 10000000;
+
+    // 루프 앞의 설정 명령어까지 포함한 실행 명령어 수
+    run_case("countdown", countdown_loop(n), 1 + 4ull * n);
+    run_case("accumulate", accumulate_loop(n), 4 + 10ull * n);
+#ifdef DIRTVM_THREADED_DISPATCH
+    // JIT은 디스패치 방식과 무관하므로 한 번만 측정합니다.
+    run_case("countdown", countdown_loop(n), 1 + 4ull * n, true);
+    run_case("accumulate", accumulate_loop(n), 4 + 10ull * n, true);
+#endif
+    return 0;
+}
@@ -0,0 +1,100 @@
+// bench/scheduler_bench.cpp
+// vm_scheduler로 짧은 작업과 긴 작업이 섞인 부하를 실행해 처리량과 짧은 작업의
+// 지연 시간 분포(제출부터 완료까지)를 측정합니다. 시간 조각 없이 끝까지 실행하는 경우와
+// 명령어 수로 조각을 나누는 경우를 비교합니다. make bench-scheduler 로 실행합니다.
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include "../engine/scheduler.h"
+#include "../engine/opcode.h"
+
+#define OPC(op) (uint16_t)((op) << 10)
+
+typedef std::chrono::steady_clock bench_clock;
+
+// throughput_bench와 같은 프로그램: 실행 전에 넣은 n에 대해 1..n의 합을 남깁니다.
+// 반복당 7개 명령어
+static std::vector<uint16_t> sum_program() {
+    return {
+        OPC(OP_DUP), OPC(OP_GLOADI), 0, OPC(OP_ADD), OPC(OP_GSTOREI), 0,
+        OPC(OP_PUSHD16), 1, OPC(OP_SUB), OPC(OP_JNZK), 0, 0, 0, 0, 0, 0, 0, 0,
+        OPC(OP_POP), OPC(OP_GLOADI), 0
+    };
+}
+
+static double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[index];
+}
+
+static void run_mix(const std::shared_ptr<const vm_module>& module, unsigned workers, uint64_t slice,
+                    uint32_t jobs, uint32_t long_every, uint32_t short_n, uint32_t long_n) {
+    vm_options options;
+    options.stack_capacity = 64;
+
+    std::mutex lock;
+    std::vector<double> short_latency;  // 마이크로초
+    short_latency.reserve(jobs);
+    uint32_t wrong = 0;
+    double instructions = 0;
+
+    auto start = bench_clock::now();
+    {
+        vm_scheduler scheduler(workers, slice);
+        for (uint32_t i = 0; i < jobs; i++) {
+            bool is_long = long_every != 0 && i % long_every == 0;
+            uint64_t n = is_long ? long_n : short_n;
+            instructions += 7.0 * n + 2;
+            std::unique_ptr<vm> machine(new vm(module, options));
+            machine->push(stack_data(D_TYPE::BIT_64, n));
+            auto submitted = bench_clock::now();
+            scheduler.submit(std::move(machine), [&, n, is_long, submitted](vm& done, vm_status) {
+                double micros = std::chrono::duration<double, std::micro>(bench_clock::now() - submitted).count();
+                bool ok = done.depth() == 1 && done.pop().get_data() == n * (n + 1) / 2;
+                std::lock_guard<std::mutex> guard(lock);
+                if (!ok) wrong++;
+                if (!is_long) short_latency.push_back(micros);
+            });
+        }
+        scheduler.wait();
+        vm_scheduler::stats stats = scheduler.statistics();
+        double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        std::sort(short_latency.begin(), short_latency.end());
+        std::cout << "workers=" << scheduler.worker_count() << "\t"
+                  << "slice=" << (slice == vm::UNLIMITED ? std::string("none") : std::to_string(slice)) << "\t"
+                  << jobs / seconds << " jobs/s\t"
+                  << instructions / seconds / 1e6 << " Minsn/s\t"
+                  << "short p50=" << percentile(short_latency, 0.50) / 1000.0 << " ms "
+                  << "p99=" << percentile(short_latency, 0.99) / 1000.0 << " ms "
+                  << "p99.9=" << percentile(short_latency, 0.999) / 1000.0 << " ms\t"
+                  << "slices=" << stats.slices << " steals=" << stats.steals
+                  << (wrong ? "\tWRONG RESULTS" : "") << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t jobs = argc > 1 ? (uint32_t)std::strtoul(argv[1], nullptr, 0) : 20000;
+    unsigned workers = argc > 2 ? (unsigned)std::strtoul(argv[2], nullptr, 0) : 0;
+
+    std::shared_ptr<const vm_module> module = vm_module::create(sum_program());
+
+    // 짧은 작업만 있을 때의 처리량
+    std::cout << "# short jobs only (n=200)" << std::endl;
+    run_mix(module, workers, vm::UNLIMITED, jobs, 0, 200, 0);
+    run_mix(module, workers, 10000, jobs, 0, 200, 0);
+
+    // 100개 중 하나가 긴 작업일 때 짧은 작업의 꼬리 지연 시간
+    std::cout << "# 1% long jobs (n=200 / n=1000000)" << std::endl;
+    run_mix(module, workers, vm::UNLIMITED, jobs, 100, 200, 1000000);
+    run_mix(module, workers, 100000, jobs, 100, 200, 1000000);
+    run_mix(module, workers, 10000, jobs, 100, 200, 1000000);
+    return 0;
+}
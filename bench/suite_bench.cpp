@@ -0,0 +1,493 @@
+// bench/suite_bench.cpp
+// 명령어별 마이크로 벤치마크와 큰 워크로드(재귀 fib, jnz 루프와 그 실행 추적, 전역 메모리 순회, .string 출력,
+// 수 MB 소스 어셈블)를 -O2로 실행해 결과를 JSON으로 쓰고, 저장해 둔 기준 결과보다 threshold 이상
+// 느려진 항목이 있으면 실패합니다. make bench 로 실행하고 make bench-baseline 으로 기준을 새로 씁니다.
+//
+//   suite_bench [--json <file>] [--baseline <file>] [--threshold <ratio>] [--repeat <n>] [--filter <text>]
+//
+// 각 항목은 한 번 예열한 뒤 모든 항목을 번갈아 repeat번 실행한 시간의 중앙값을 씁니다. 기준 파일은
+// --json이 쓴 파일이며 한 줄에 결과 하나입니다. VM 코드를 쓰지 않는 보정 루프(calibrate/host_loop)도
+// 함께 재어, 기준을 잰 기계와 이번 기계의 빠르기 차이만큼 시간을 맞춘 뒤 비교합니다.
+// 기준 파일이 없으면 이번 결과를 기준으로 써 둡니다.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../assembler/parser.h"
+#include "../engine/vm.h"
+#include "../engine/module_file.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static const char* const CALIBRATION = "calibrate/host_loop";
+static volatile uint64_t calibration_sink;  // 보정 루프가 지워지지 않도록 결과를 씁니다.
+
+struct bench_result {
+    std::string name;
+    double ms;                  // repeat번 실행한 시간의 중앙값
+    double min_ms;              // 그중 가장 짧은 시간
+    uint64_t instructions;      // 실행한 명령어 수 (어셈블 항목은 0)
+    uint64_t bytes;             // 어셈블한 소스 크기 (실행 항목은 0)
+};
+
+// 어셈블리 소스를 모듈로 만듭니다. 데이터 섹션(.string)도 함께 담습니다.
+static std::shared_ptr<const vm_module> assemble(const std::string& source) {
+    Parser parser;
+    parser.parse(source);
+    std::vector<module_data> data;
+    for (const DataSegment& segment : parser.get_data()) {
+        data.push_back({segment.address, segment.width == 1 ? D_TYPE::BIT_8 : D_TYPE::BIT_16,
+                        std::vector<__uint128_t>(segment.values.begin(), segment.values.end())});
+    }
+    std::vector<uint8_t> image = build_module(parser.get_bytecode(), data);
+    module_view view;
+    std::string error;
+    if (!parse_module(image.data(), image.size(), view, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        exit(1);
+    }
+    return vm_module::create(view);
+}
+
+// 중앙값. 가장 짧은 시간과 달리 우연히 빨랐던 한 번에 끌려가지 않습니다.
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 != 0 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+// 프로그램의 stdout 출력을 /dev/null로 돌리는 동안 body를 실행합니다.
+static void with_null_stdout(const std::function<void()>& body) {
+    std::cout.flush();
+    int saved = dup(1);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    close(null);
+    body();
+    dup2(saved, 1);
+    close(saved);
+}
+
+static std::string repeat_text(const std::string& text, int count) {
+    std::string out;
+    for (int i = 0; i < count; i++) {
+        out += text;
+    }
+    return out;
+}
+
+// --- 명령어별 마이크로 벤치마크 ---
+// 스택을 바꾸지 않는 본문을 UNROLL번 펼친 루프를 n번 돕니다. 반복마다 카운터에 4개 명령어가 더 듭니다.
+static const int UNROLL = 8;
+
+struct micro_case {
+    const char* name;
+    const char* setup;    // 루프 전에 한 번 (지역 메모리 준비 등)
+    const char* body;     // 스택 중립인 본문. %는 반복 번호로 바뀝니다 (라벨용).
+    int body_length;      // 본문의 명령어 수
+};
+
+static const micro_case micro_cases[] = {
+    {"push8", "", "pushd8 1 pop", 2},
+    {"push128", "", "pushd128 1 pop", 2},
+    {"dup", "", "dup pop", 2},
+    {"add", "", "pushd8 3 pushd8 5 add pop", 4},
+    {"sub", "", "pushd8 5 pushd8 3 sub pop", 4},
+    {"mul", "", "pushd8 3 pushd8 5 mul pop", 4},
+    {"div", "", "pushd8 15 pushd8 5 div pop", 4},
+    {"eq", "", "pushd8 3 pushd8 5 eq pop", 4},
+    {"lt", "", "pushd8 3 pushd8 5 lt pop", 4},
+    {"gt", "", "pushd8 3 pushd8 5 gt pop", 4},
+    {"gload", "", "pushd8 9 gload pop", 3},
+    {"gstore", "", "pushd8 7 pushd8 9 gstore", 3},
+    {"lload", "pushd8 7 pushd8 0 lstore 1", "pushd8 0 lload 1 pop", 3},
+    {"lstore", "", "pushd8 7 pushd8 0 lstore 1", 3},
+    {"addi", "", "pushd8 3 addi 5 pop", 3},
+    {"gloadi", "", "gloadi 9 pop", 2},
+    {"jmp", "", "jmp next_% next_%:", 1},
+    {"call_ret", "", "call leaf", 2},
+};
+
+static std::string micro_source(const micro_case& c, uint32_t n) {
+    std::string body;
+    for (int i = 0; i < UNROLL; i++) {
+        std::string copy = c.body;
+        for (size_t p = copy.find('%'); p != std::string::npos; p = copy.find('%')) {
+            copy.replace(p, 1, std::to_string(i));
+        }
+        body += copy + "\n";
+    }
+    return std::string(c.setup) + "\npushd32 " + std::to_string(n) + "\nloop:\n" + body +
+           "pushd8 1 sub dup jnz loop\nhalt\nleaf:\nret\n";
+}
+
+// --- 큰 워크로드 ---
+
+// 지역 메모리에 n을 두고 fib(n-1) + fib(n-2)를 재귀 호출로 계산합니다.
+static const char* fib_source =
+    "pushd8 %\ncall fib\nhalt\n"
+    "fib:\ndup pushd8 2 lt jnz base\n"
+    "pushd8 0 lstore 0\n"
+    "pushd8 0 lload 0 pushd8 1 sub call fib\n"
+    "pushd8 0 lload 0 pushd8 2 sub call fib\n"
+    "add ret\n"
+    "base:\nret\n";
+
+static uint64_t fib_instructions(uint32_t n) {
+    // fib(n)의 호출 수는 2F(n+1)-1이고 그중 F(n+1)번이 n < 2 (5개 명령어), 나머지가 18개 명령어입니다.
+    uint64_t a = 0, b = 1;
+    for (uint32_t i = 0; i < n + 1; i++) {
+        uint64_t t = a + b;
+        a = b;
+        b = t;
+    }
+    return 5 * a + 18 * (a - 1) + 3;
+}
+
+static std::string replace_all(std::string text, const std::string& from, const std::string& to) {
+    for (size_t p = text.find(from); p != std::string::npos; p = text.find(from, p + to.size())) {
+        text.replace(p, from.size(), to);
+    }
+    return text;
+}
+
+// 전역 메모리 0..n-1에 값을 쓰고 다시 모두 읽습니다. 페이지 n/4096개를 지나갑니다.
+static std::string memory_source(uint32_t n) {
+    return "pushd32 " + std::to_string(n) + "\nfill:\ndup dup gstore pushd8 1 sub dup jnz fill\n"
+           "pop pushd32 " + std::to_string(n) + "\nsweep:\ndup gload pop pushd8 1 sub dup jnz sweep\nhalt\n";
+}
+
+// 여러 .string을 번갈아 n번씩 stdout으로 씁니다.
+static std::string output_source(uint32_t n) {
+    const int STRINGS = 8;
+    std::string source;
+    for (int i = 0; i < STRINGS; i++) {
+        source += ".string " + std::to_string(i * 64) + " \"" + repeat_text(std::to_string(i), 63) + "\"\n";
+    }
+    source += "pushd32 " + std::to_string(n) + "\nloop:\n";
+    for (int i = 0; i < STRINGS; i++) {
+        source += "pushd8 63 pushd16 " + std::to_string(i * 64) + " pushd8 1 syscall 1 pop\n";
+    }
+    return source + "pushd8 1 sub dup jnz loop\nhalt\n";
+}
+
+// 라벨, 분기, 여러 폭의 push가 섞인 큰 소스
+static std::string large_source(size_t target_bytes) {
+    std::string source;
+    source.reserve(target_bytes + 256);
+    for (size_t block = 0; source.size() < target_bytes; block++) {
+        std::string label = "block_" + std::to_string(block);
+        source += label + ":\n"
+                  "    pushd8 1\n    pushd16 513\n    add\n    pushd32 70000\n    mul\n"
+                  "    pushd64 5000000000\n    lt\n    jz " + label + "\n"
+                  "    pushd8 0\n    lstore 3\n    pushd8 0\n    lload 3\n    pop\n"
+                  "    dup\n    jnz block_" + std::to_string(block / 2) + "\n"
+                  "    call " + label + "\n    ret\n";
+    }
+    return source;
+}
+
+// --- 실행과 기록 ---
+
+// 항목을 모두 등록한 뒤 measure()가 한 바퀴에 모든 항목을 한 번씩 돌리며 repeat바퀴를 잽니다.
+// 기계의 부하나 클럭이 실행 중에 바뀌어도 모든 항목이 비슷하게 영향을 받으므로 항목 사이의 비율이 덜 흔들립니다.
+class suite {
+public:
+    suite(int repeat, const std::string& filter) : repeat(repeat), filter(filter) {}
+
+    // trace_capacity가 0이 아니면 그만큼의 실행 추적 링 버퍼를 켭니다.
+    void run_program(const std::string& name, const std::string& source, uint64_t instructions,
+                     bool jit = false, bool null_stdout = false, size_t trace_capacity = 0) {
+        if (!selected(name)) {
+            return;
+        }
+        std::shared_ptr<const vm_module> module = assemble(source);
+        vm_options options;
+        options.enable_jit = jit;
+        options.jit_threshold = 0;
+        options.trace_capacity = trace_capacity;
+        auto body = [name, module, options]() {
+            vm machine(module, options);
+            if (machine.run() != vm_status::HALTED) {
+                std::cerr << "Error: " << name << " did not halt" << std::endl;
+                exit(1);
+            }
+        };
+        cases.push_back({{name, 0, 0, instructions, 0}, body, null_stdout, {}});
+    }
+
+    // 기계의 빠르기를 재는 보정 항목. VM과 어셈블러 코드를 전혀 쓰지 않으므로 VM이 느려져도 바뀌지 않습니다.
+    // 필터와 상관없이 항상 잽니다.
+    void run_calibration() {
+        auto body = []() {
+            uint64_t x = 88172645463325252ull;
+            for (uint32_t i = 0; i < 20000000; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+            }
+            calibration_sink = x;
+        };
+        cases.push_back({{CALIBRATION, 0, 0, 0, 0}, body, false, {}});
+    }
+
+    void run_assembler(const std::string& name, const std::string& source) {
+        if (!selected(name)) {
+            return;
+        }
+        auto body = [name, source]() {
+            Parser parser;
+            parser.parse(source);
+            if (parser.get_bytecode().empty()) {
+                std::cerr << "Error: " << name << " produced no code" << std::endl;
+                exit(1);
+            }
+        };
+        cases.push_back({{name, 0, 0, 0, source.size()}, body, false, {}});
+    }
+
+    // 각 항목을 한 번씩 예열한 뒤 repeat바퀴를 재고 중앙값을 기록합니다.
+    void measure() {
+        for (bench_case& c : cases) {
+            run_once(c);
+        }
+        for (int round = 0; round < repeat; round++) {
+            for (bench_case& c : cases) {
+                c.times.push_back(run_once(c));
+            }
+        }
+        for (bench_case& c : cases) {
+            c.result.ms = median(c.times);
+            c.result.min_ms = *std::min_element(c.times.begin(), c.times.end());
+            record(c.result);
+        }
+    }
+
+    // 두 항목의 명령어당 시간 차이를 보여 줍니다 (실행 추적의 비용 등).
+    void report_overhead(const std::string& base, const std::string& variant) const {
+        const bench_result* a = find(base);
+        const bench_result* b = find(variant);
+        if (a != nullptr && b != nullptr) {
+            std::cout << variant << "\t+" << (b->ms - a->ms) * 1e6 / b->instructions << " ns/insn over " << base
+                      << std::endl;
+        }
+    }
+
+    const std::vector<bench_result>& results() const { return list; }
+
+private:
+    struct bench_case {
+        bench_result result;
+        std::function<void()> body;
+        bool null_stdout;            // 프로그램의 stdout 출력을 /dev/null로 돌립니다.
+        std::vector<double> times;
+    };
+
+    int repeat;
+    std::string filter;
+    std::vector<bench_case> cases;
+    std::vector<bench_result> list;
+
+    static double run_once(const bench_case& c) {
+        double ms = 0;
+        auto timed = [&]() {
+            auto start = bench_clock::now();
+            c.body();
+            ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        };
+        if (c.null_stdout) {
+            with_null_stdout(timed);
+        } else {
+            timed();
+        }
+        return ms;
+    }
+
+    const bench_result* find(const std::string& name) const {
+        for (const bench_result& r : list) {
+            if (r.name == name) {
+                return &r;
+            }
+        }
+        return nullptr;
+    }
+
+    bool selected(const std::string& name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    void record(const bench_result& result) {
+        std::cout << result.name << "\t" << result.ms << " ms";
+        if (result.instructions != 0) {
+            std::cout << "\t" << result.instructions / result.ms / 1e3 << " Minsn/s";
+        }
+        if (result.bytes != 0) {
+            std::cout << "\t" << result.bytes / result.ms / 1e3 << " MB/s";
+        }
+        std::cout << std::endl;
+        list.push_back(result);
+    }
+};
+
+static void write_json(const std::string& path, const std::vector<bench_result>& results, int repeat) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not write " << path << std::endl;
+        exit(1);
+    }
+    out << "{\n  \"dispatch\": \"" << vm::dispatch_name() << "\",\n  \"repeat\": " << repeat << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"ms\": " << r.ms << ", \"min_ms\": " << r.min_ms;
+        if (r.instructions != 0) {
+            out << ", \"instructions\": " << r.instructions << ", \"minsn_per_s\": " << r.instructions / r.ms / 1e3;
+        }
+        if (r.bytes != 0) {
+            out << ", \"bytes\": " << r.bytes << ", \"mb_per_s\": " << r.bytes / r.ms / 1e3;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// 기준 결과 하나. min_ms가 없는 예전 파일이면 ms를 씁니다.
+struct baseline_entry {
+    double ms;
+    double min_ms;
+};
+
+// write_json이 쓴 파일에서 이름 -> 시간을 읽습니다.
+static std::map<std::string, baseline_entry> read_baseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "Error: Could not read baseline " << path << std::endl;
+        exit(1);
+    }
+    std::map<std::string, baseline_entry> baseline;
+    std::string line;
+    const std::string name_key = "\"name\": \"", ms_key = "\"ms\": ", min_key = "\"min_ms\": ";
+    while (std::getline(in, line)) {
+        size_t name = line.find(name_key);
+        size_t ms = line.find(ms_key);
+        size_t min = line.find(min_key);
+        if (name == std::string::npos || ms == std::string::npos) {
+            continue;
+        }
+        name += name_key.size();
+        baseline_entry entry;
+        entry.ms = std::strtod(line.c_str() + ms + ms_key.size(), nullptr);
+        entry.min_ms = min == std::string::npos ? entry.ms : std::strtod(line.c_str() + min + min_key.size(), nullptr);
+        baseline[line.substr(name, line.find('"', name) - name)] = entry;
+    }
+    return baseline;
+}
+
+// 기준보다 threshold 비율 이상 느려진 항목 수를 반환합니다.
+//
+// 시간은 보정 루프가 기준보다 빨라지거나 느려진 만큼(scale)으로 나눈 뒤 비교합니다. 보정 루프는 VM 코드를
+// 쓰지 않으므로 디스패치 루프처럼 모든 항목을 함께 느리게 하는 변화도 그대로 회귀로 잡힙니다.
+// 잡음은 대부분 느려지는 쪽이므로 중앙값과 가장 짧은 시간이 모두 threshold 이상 느려졌을 때만 셉니다.
+static int compare(const std::vector<bench_result>& results, const std::map<std::string, baseline_entry>& baseline,
+                   double threshold) {
+    double scale = 1, min_scale = 1;
+    auto calibration = baseline.find(CALIBRATION);
+    for (const bench_result& r : results) {
+        if (r.name == CALIBRATION && calibration != baseline.end()) {
+            scale = r.ms / calibration->second.ms;
+            min_scale = r.min_ms / calibration->second.min_ms;
+        }
+    }
+    int regressions = 0;
+    std::cout << "\ncompared with baseline (threshold +" << threshold * 100 << "%, machine speed "
+              << (scale >= 1 ? "+" : "") << (scale - 1) * 100 << "% from " << CALIBRATION << ")\n";
+    for (const bench_result& r : results) {
+        if (r.name == CALIBRATION) {
+            continue;
+        }
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            std::cout << r.name << "\tnew\n";
+            continue;
+        }
+        double change = r.ms / it->second.ms / scale - 1;
+        double min_change = r.min_ms / it->second.min_ms / min_scale - 1;
+        bool regressed = change > threshold && min_change > threshold;
+        regressions += regressed;
+        std::cout << r.name << "\t" << it->second.ms << " -> " << r.ms << " ms\t" << (change >= 0 ? "+" : "")
+                  << change * 100 << "% (fastest " << (min_change >= 0 ? "+" : "") << min_change * 100 << "%)"
+                  << (regressed ? "\tREGRESSION" : "") << "\n";
+    }
+    return regressions;
+}
+
+int main(int argc, char* argv[]) {
+    std::string json_file, baseline_file, filter;
+    double threshold = 0.15;
+    int repeat = 11;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << arg << " requires an argument" << std::endl;
+            return 2;
+        }
+        if (arg == "--json") json_file = argv[++i];
+        else if (arg == "--baseline") baseline_file = argv[++i];
+        else if (arg == "--threshold") threshold = std::strtod(argv[++i], nullptr);
+        else if (arg == "--repeat") repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--filter") filter = argv[++i];
+        else {
+            std::cerr << "Error: unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    suite s(repeat, filter);
+    s.run_calibration();
+    const uint32_t micro_n = 1000000;
+    for (const micro_case& c : micro_cases) {
+        uint64_t instructions = (uint64_t)micro_n * (UNROLL * c.body_length + 4) + 2;
+        s.run_program(std::string("op/") + c.name, micro_source(c, micro_n), instructions);
+    }
+
+    const uint32_t fib_n = 27;
+    std::string fib = replace_all(fib_source, "%", std::to_string(fib_n));
+    s.run_program("macro/fib", fib, fib_instructions(fib_n));
+    s.run_program("macro/fib_jit", fib, fib_instructions(fib_n), true);
+    const uint32_t loop_n = 10000000;
+    std::string loop = "pushd32 " + std::to_string(loop_n) + "\nloop:\npushd8 1 sub dup jnz loop\nhalt\n";
+    s.run_program("macro/jnz_loop", loop, 4ull * loop_n + 2);
+    s.run_program("macro/jnz_loop_jit", loop, 4ull * loop_n + 2, true);
+    s.run_program("macro/jnz_loop_trace", loop, 4ull * loop_n + 2, false, false, 4096);
+    const uint32_t cells = 1 << 20;
+    s.run_program("macro/memory_sweep", memory_source(cells), 14ull * cells + 4);
+    const uint32_t writes = 50000;
+    s.run_program("macro/string_output", output_source(writes), (uint64_t)writes * (8 * 5 + 4) + 2, false, true);
+    s.run_assembler("asm/large_source", large_source(4 << 20));
+    s.measure();
+    s.report_overhead("macro/jnz_loop", "macro/jnz_loop_trace");
+
+    if (!json_file.empty()) {
+        write_json(json_file, s.results(), repeat);
+    }
+    if (!baseline_file.empty() && access(baseline_file.c_str(), F_OK) != 0) {
+        write_json(baseline_file, s.results(), repeat);
+        std::cout << "\nno baseline yet; wrote " << baseline_file << std::endl;
+    } else if (!baseline_file.empty()) {
+        int regressions = compare(s.results(), read_baseline(baseline_file), threshold);
+        if (regressions != 0) {
+            std::cout << regressions << " benchmark(s) regressed" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+// bench/throughput_bench.cpp
+// 한 번 디코딩한 vm_module을 여러 스레드가 공유하며 짧은 작업을 반복 실행해
+// 스레드 수에 따른 초당 작업 수를 측정합니다. make bench-throughput 으로 실행합니다.
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include "../engine/vm.h"
+#include "../engine/opcode.h"
+
+#define OPC(op) (uint16_t)((op) << 10)
+
+// engine/test.cpp의 프로그램과 같은 꼴: 실행 전에 넣은 n에 대해 1..n의 합을 g[0]에 모아 남깁니다.
+// 반복당 7개 명령어 (dup, gloadi, add, gstorei, pushd16, sub, jnzk)
+static std::vector<uint16_t> sum_program() {
+    return {
+        OPC(OP_DUP), OPC(OP_GLOADI), 0, OPC(OP_ADD), OPC(OP_GSTOREI), 0,
+        OPC(OP_PUSHD16), 1, OPC(OP_SUB), OPC(OP_JNZK), 0, 0, 0, 0, 0, 0, 0, 0,
+        OPC(OP_POP), OPC(OP_GLOADI), 0
+    };
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t jobs = argc > 1 ? (uint32_t)std::strtoul(argv[1], nullptr, 0) : 20000;
+    uint32_t n = argc > 2 ? (uint32_t)std::strtoul(argv[2], nullptr, 0) : 1000;
+
+    std::shared_ptr<const vm_module> module = vm_module::create(sum_program());
+    vm_options options;
+    options.stack_capacity = 64; // 짧은 작업은 큰 스택이 필요 없습니다.
+
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        std::atomic<uint32_t> next(0);
+        std::atomic<uint32_t> wrong(0);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; t++) {
+            pool.emplace_back([&]() {
+                while (next.fetch_add(1, std::memory_order_relaxed) < jobs) {
+                    vm machine(module, options);
+                    machine.push(stack_data(D_TYPE::BIT_64, n));
+                    machine.run();
+                    if (machine.pop().get_data() != (uint64_t)n * (n + 1) / 2) {
+                        wrong.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : pool) {
+            thread.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double instructions = (double)jobs * (7.0 * n + 2);
+        std::cout << "threads=" << threads << "\t" << jobs << " jobs\t"
+                  << seconds * 1000.0 << " ms\t"
+                  << jobs / seconds << " jobs/s\t"
+                  << instructions / seconds / 1e6 << " Minsn/s"
+                  << (wrong ? "\tWRONG RESULTS" : "") << std::endl;
+        if (threads * 2 > max_threads && threads != max_threads) {
+            threads = max_threads / 2; // 마지막으로 전체 코어 수도 측정합니다.
+        }
+    }
+    return 0;
+}
@@ -4,24 +4,64 @@
 #include <iterator>
 #include <string>
 #include <map>
+#include <cctype>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <iomanip>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 #include "../assembler/parser.h"
+#include "../assembler/object_file.h"
+#include "../assembler/linker.h"
 #include "../engine/vm.h"
+#include "../engine/module_file.h"
+#include "../engine/profile.h"
+#include "../engine/trace.h"
+#include "../engine/disassemble.h"
+#include "../optimizer/optimizer.h"
 
 enum class CliMode {
     NONE,
     ASSEMBLE,
+    COMPILE,
     RUN,
-    ASSEMBLE_AND_RUN
+    ASSEMBLE_AND_RUN,
+    RESUME,
+    SHOW_TRACE
 };
 
 void print_help() {
-    std::cout << "Usage: dirtvm_cli [options] <input_file>" << std::endl;
+    std::cout << "Usage: dirtvm_cli [options] <input_file>..." << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "  -a, --assemble       Assemble the input assembly file and output bytecode to <output_file> (default: a.out)" << std::endl;
-    std::cout << "  -r, --run            Run the input bytecode file" << std::endl;
+    std::cout << "  -a, --assemble       Assemble the input assembly file and write a module to <output_file> (default: a.out)" << std::endl;
+    std::cout << "                       With several inputs (sources or object files), links them and drops" << std::endl;
+    std::cout << "                       functions that execution cannot reach" << std::endl;
+    std::cout << "  -c, --compile        Assemble each input source into an object file (<input>.o, or -o for one input)" << std::endl;
+    std::cout << "  -r, --run            Run the input module (or headerless bytecode) file" << std::endl;
     std::cout << "  -ar, --assemble-run  Assemble and immediately run the input assembly file" << std::endl;
-    std::cout << "  -o <file>            Specify output file for assembly (used with -a)" << std::endl;
+    std::cout << "  -o <file>            Specify output file for assembly (used with -a) or for the snapshot" << std::endl;
+    std::cout << "                       (used with --snapshot-at, default: a.snap)" << std::endl;
+    std::cout << "  -j <n>               Assemble up to n sources in parallel (default: number of cores)" << std::endl;
+    std::cout << "  -O0, -O1, -O2        Optimization level (default: -O0)" << std::endl;
+    std::cout << "                       -O1 fuses common pairs into superinstructions" << std::endl;
+    std::cout << "                       -O2 also folds constants and strength-reduces per basic block" << std::endl;
+    std::cout << "  --stack-size <n>     Operand stack capacity in elements (default: 16384)" << std::endl;
+    std::cout << "  --stream-stdin [n]   Read stdin through a fixed n-byte buffer (default: 65536)" << std::endl;
+    std::cout << "  --jit                Compile hot functions to native code (Linux x86-64)" << std::endl;
+    std::cout << "  --jit-threshold <n>  Calls before a function is compiled (default: 1000)" << std::endl;
+    std::cout << "  --snapshot-at <label> Stop when execution reaches <label> and save a snapshot of the VM" << std::endl;
+    std::cout << "  --resume <file>      Continue a VM from a snapshot file instead of running an input file" << std::endl;
+    std::cout << "  --profile <prefix>   Sample the running program and write <prefix>.txt (hot blocks and" << std::endl;
+    std::cout << "                       functions) and <prefix>.folded (collapsed stacks for flame graphs)" << std::endl;
+    std::cout << "  --profile-interval <n> Mean instructions between samples (default: 10007)" << std::endl;
+    std::cout << "  --trace <n>          Record the last n instructions and write them to the trace file on a trap" << std::endl;
+    std::cout << "  --trace-file <file>  Trace file (default: dirtvm.trace); when given, the trace is always written" << std::endl;
+    std::cout << "                       (records the last 1024 instructions unless --trace is given)" << std::endl;
+    std::cout << "  --show-trace <file>  Print a trace file against the disassembled program" << std::endl;
     std::cout << "  -h, --help           Display this help message" << std::endl;
 }
 
@@ -35,55 +75,306 @@ std::string read_source_file(const std::string& filename) {
     return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
 }
 
-// 바이트코드 파일에서 바이트코드를 읽어옵니다.
-std::vector<uint16_t> read_bytecode_file(const std::string& filename) {
-    std::ifstream ifs(filename, std::ios::binary);
-    if (!ifs.is_open()) {
-        std::cerr << "Error: Could not open input bytecode file " << filename << std::endl;
+// 바이트코드 모듈을 mmap으로 엽니다. 헤더 없는 예전 바이트코드 파일도 받아들입니다.
+mapped_module open_module_file(const std::string& filename) {
+    mapped_module module;
+    std::string error;
+    if (!module.open(filename, error)) {
+        std::cerr << "Error: Could not load bytecode file " << filename << ": " << error << std::endl;
         exit(1);
     }
-    std::vector<uint16_t> bytecode;
-    uint16_t instruction;
-    while (ifs.read(reinterpret_cast<char*>(&instruction), sizeof(instruction))) {
-        bytecode.push_back(instruction);
+    return module;
+}
+
+// 어셈블하거나 링크한 프로그램을 모듈 파일 이미지로 변환합니다.
+std::vector<uint8_t> build_program(const object_file& program, int optimization_level) {
+    if (optimization_level >= 2) {
+        // 최적화기는 주소를 다시 매기므로 라벨 주소를 내보내지 않습니다.
+        return build_module(optimize_bytecode(program.code), module_data_of(program.data));
+    }
+    std::vector<module_symbol> symbols;
+    for (const object_symbol& symbol : program.symbols) {
+        symbols.push_back({symbol.name, symbol.address});
+    }
+    return build_module(program.code, module_data_of(program.data), symbols);
+}
+
+void configure_parser(Parser& parser, int optimization_level) {
+    // -O2에서는 최적화기가 슈퍼 명령어도 만들므로 파서는 소스 그대로 변환합니다.
+    parser.set_optimization_level(optimization_level == 1 ? 1 : 0);
+}
+
+// 입력마다 오브젝트를 만듭니다. 소스는 jobs개의 스레드가 나눠 어셈블하고 오브젝트 파일은 그대로 읽습니다.
+// 오류가 나면 어느 스레드에서든 메시지를 쓰고 종료합니다.
+std::vector<link_input> load_objects(const std::vector<std::string>& files, int optimization_level, unsigned jobs) {
+    std::vector<link_input> inputs(files.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        Parser parser;
+        configure_parser(parser, optimization_level);
+        parser.set_relocatable(true);
+        for (size_t i = next++; i < files.size(); i = next++) {
+            inputs[i].name = files[i];
+            std::string bytes = read_source_file(files[i]);
+            const uint8_t* image = reinterpret_cast<const uint8_t*>(bytes.data());
+            if (!is_object_file(image, bytes.size())) {
+                parser.parse(bytes, files[i]);
+                inputs[i].object = parser.get_object();
+                continue;
+            }
+            std::string error;
+            if (!read_object(image, bytes.size(), inputs[i].object, error)) {
+                std::cerr << "Error: Could not load object file " << files[i] << ": " << error << std::endl;
+                exit(1);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min<size_t>(jobs, files.size()); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
     }
-    return bytecode;
+    return inputs;
 }
 
-// 어셈블리 코드를 바이트코드로 변환합니다.
-std::vector<uint16_t> assemble(const std::string& assembly_code) {
-    Parser parser;
-    parser.parse(assembly_code);
-    return parser.get_bytecode();
+// 입력들을 모듈 파일 이미지로 변환합니다. 소스 하나는 그대로 어셈블하고,
+// 여럿이거나 오브젝트 파일이 섞여 있으면 오브젝트로 어셈블한 뒤 링크합니다.
+std::vector<uint8_t> assemble(const std::vector<std::string>& files, int optimization_level, unsigned jobs,
+                              bool report) {
+    if (files.size() == 1) {
+        std::string assembly_code = read_source_file(files[0]);
+        if (!is_object_file(reinterpret_cast<const uint8_t*>(assembly_code.data()), assembly_code.size())) {
+            Parser parser;
+            configure_parser(parser, optimization_level);
+            parser.parse(assembly_code);
+            return build_program(parser.get_object(), optimization_level);
+        }
+    }
+
+    std::vector<link_input> inputs = load_objects(files, optimization_level, jobs);
+    object_file program;
+    link_stats stats;
+    std::string error;
+    if (!link_objects(inputs, program, error, &stats)) {
+        std::cerr << "Error: " << error << std::endl;
+        exit(1);
+    }
+    if (report) {
+        std::cout << "Linked " << inputs.size() << " objects: kept " << stats.kept_functions << " of "
+                  << stats.functions << " functions (" << stats.kept_words << " of " << stats.words << " words)"
+                  << std::endl;
+    }
+    return build_program(program, optimization_level);
 }
 
-// 바이트코드를 파일에 씁니다.
-void write_bytecode(const std::string& filename, const std::vector<uint16_t>& bytecode) {
+void write_file(const std::string& filename, const std::vector<uint8_t>& bytes) {
     std::ofstream ofs(filename, std::ios::binary);
     if (!ofs.is_open()) {
         std::cerr << "Error: Could not open output file " << filename << std::endl;
         exit(1);
     }
-    for (uint16_t instruction : bytecode) {
-        ofs.write(reinterpret_cast<const char*>(&instruction), sizeof(instruction));
-    }
+    ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+// 모듈을 파일로 씁니다.
+void write_module(const std::string& filename, const std::vector<uint8_t>& module) {
+    write_file(filename, module);
     std::cout << "Assembly successful. Bytecode written to " << filename << std::endl;
 }
 
-// VM을 실행합니다.
-void run_vm(const std::vector<uint16_t>& bytecode) {
-    vm dirt_vm(bytecode);
-    dirt_vm.run();
+void print_inputs(const std::vector<std::string>& files) {
+    if (files.size() == 1) {
+        std::cout << "Input file: " << files[0] << std::endl;
+    } else {
+        std::cout << "Input files: " << files.size() << std::endl;
+    }
+}
+
+// a/b.asm -> a/b.o
+std::string object_file_name(const std::string& source) {
+    size_t slash = source.find_last_of('/');
+    size_t dot = source.find_last_of('.');
+    size_t base = slash == std::string::npos ? 0 : slash + 1;
+    if (dot == std::string::npos || dot <= base) {
+        return source + ".o";
+    }
+    return source.substr(0, dot) + ".o";
+}
+
+// 옵션 인자를 [min, max] 범위의 10진수로 읽습니다. 부호나 공백, 뒤에 붙은 문자가 있거나
+// 범위를 벗어나면 false를 반환합니다.
+bool parse_number(const char* text, unsigned long long min, unsigned long long max, unsigned long long& value) {
+    if (!std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(text, &end, 10);
+    return *end == '\0' && errno != ERANGE && value >= min && value <= max;
+}
+
+struct trace_settings {
+    static const size_t DEFAULT_CAPACITY = 1024;  // --trace 없이 --trace-file만 준 경우의 기록 수
+    std::string file = "dirtvm.trace";
+    bool always = false;  // 오류가 없어도 씁니다 (--trace-file을 준 경우).
+};
+
+// run()의 결과를 보고하고 종료 코드를 정합니다. 추적 중이면 종료하기 전에 추적 파일을 씁니다.
+void finish_vm(vm& dirt_vm, vm_status status, const trace_settings& trace, const std::vector<module_symbol>& symbols) {
+    if (dirt_vm.tracing() && (status == vm_status::TRAPPED || trace.always)) {
+        std::string error;
+        if (dirt_vm.write_trace(trace.file, symbols, error)) {
+            std::cerr << "Trace written to " << trace.file << std::endl;
+        } else {
+            std::cerr << "Error: Could not write trace: " << error << std::endl;
+        }
+    }
+    if (status == vm_status::TRAPPED) {
+        std::cerr << "Error: " << trap_message(dirt_vm.trap()) << " (at address " << dirt_vm.pc_address() << ")" << std::endl;
+        exit(1);
+    }
+    if (dirt_vm.exited()) {
+        exit(dirt_vm.exit_code());
+    }
     std::cout << "Execution finished." << std::endl;
 }
 
+// 프로파일을 <prefix>.txt와 <prefix>.folded로 씁니다.
+void write_profile(const vm_profiler& profiler, const std::string& prefix, const std::vector<module_symbol>& symbols) {
+    std::ofstream report(prefix + ".txt");
+    std::ofstream collapsed(prefix + ".folded");
+    if (!report.is_open() || !collapsed.is_open()) {
+        std::cerr << "Error: Could not write profile " << prefix << ".txt / .folded" << std::endl;
+        exit(1);
+    }
+    profiler.write_report(report, symbols);
+    profiler.write_collapsed(collapsed, symbols);
+    std::cerr << "Profile: " << profiler.samples() << " samples written to " << prefix << ".txt and " << prefix
+              << ".folded" << std::endl;
+}
+
+struct profile_settings {
+    std::string prefix;  // 비어 있으면 프로파일하지 않습니다.
+    uint32_t interval = vm_profiler::DEFAULT_INTERVAL;
+};
+
+// VM을 끝까지 실행하고 결과를 보고합니다. 프로파일은 오류나 SYS_exit으로 끝나도 씁니다.
+void run_to_end(vm& dirt_vm, const profile_settings& profile, const trace_settings& trace,
+                const std::vector<module_symbol>& symbols) {
+    if (profile.prefix.empty()) {
+        finish_vm(dirt_vm, dirt_vm.run(), trace, symbols);
+        return;
+    }
+    vm_profiler profiler(profile.interval);
+    dirt_vm.set_profiler(&profiler);
+    vm_status status = dirt_vm.run();
+    dirt_vm.set_profiler(nullptr);
+    write_profile(profiler, profile.prefix, symbols);
+    finish_vm(dirt_vm, status, trace, symbols);
+}
+
+// 모듈을 실행합니다. snapshot_label이 있으면 그 라벨에 닿을 때 멈추고 스냅샷을 씁니다.
+void run_module(const module_view& view, const vm_options& options, const profile_settings& profile,
+                const trace_settings& trace, const std::string& snapshot_label, const std::string& snapshot_file) {
+    std::shared_ptr<const vm_module> module = vm_module::create(view);
+    std::vector<module_symbol> symbols = view.symbol_table();
+    if (!snapshot_label.empty()) {
+        const module_symbol* label = nullptr;
+        for (const module_symbol& symbol : symbols) {
+            if (symbol.name == snapshot_label) {
+                label = &symbol;
+            }
+        }
+        if (label == nullptr) {
+            std::cerr << "Error: Unknown label " << snapshot_label << " (labels are not kept at -O2)" << std::endl;
+            exit(1);
+        }
+        module = module->with_breakpoint(label->address);
+        if (!module) {
+            std::cerr << "Error: Label " << snapshot_label << " is not at an instruction" << std::endl;
+            exit(1);
+        }
+
+        vm dirt_vm(module, options);
+        vm_status status = dirt_vm.run();
+        if (status != vm_status::BREAKPOINT) {
+            std::cerr << "Warning: Execution finished before reaching " << snapshot_label << "; no snapshot written" << std::endl;
+            finish_vm(dirt_vm, status, trace, symbols);
+            return;
+        }
+        std::string error;
+        if (!dirt_vm.save_snapshot(snapshot_file, error)) {
+            std::cerr << "Error: Could not save snapshot: " << error << std::endl;
+            exit(1);
+        }
+        std::cout << "Snapshot written to " << snapshot_file << std::endl;
+        return;
+    }
+
+    vm dirt_vm(module, options);
+    run_to_end(dirt_vm, profile, trace, symbols);
+}
+
+// 추적 파일을 기록마다 한 줄씩, 파일에 담긴 프로그램을 디스어셈블해 보여 줍니다.
+void show_trace(const std::string& filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open()) {
+        std::cerr << "Error: Could not open trace file " << filename << std::endl;
+        exit(1);
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    trace_view trace;
+    std::string error;
+    if (!parse_trace(bytes.data(), bytes.size(), trace, error)) {
+        std::cerr << "Error: Could not read trace " << filename << ": " << error << std::endl;
+        exit(1);
+    }
+
+    std::map<uint64_t, std::string> labels = address_labels(trace.module.symbol_table());
+    std::cout << "# " << trace.count << " of " << trace.total << " instructions";
+    if (trace.trap != 0) {
+        std::cout << ", stopped by: " << trap_message(static_cast<vm_trap>(trace.trap));
+    }
+    std::cout << "\n";
+    std::cout << std::setw(12) << "index" << std::setw(9) << "address" << "  " << std::left << std::setw(20)
+              << "location" << std::setw(28) << "instruction" << std::right << std::setw(6) << "depth"
+              << "  tos\n";
+    for (size_t i = 0; i < trace.count; i++) {
+        const trace_record& record = trace.records[i];
+        std::string text;
+        if (record.pc < trace.module.code_size) {
+            disassemble(trace.module.code, trace.module.code_size, record.pc, labels, text);
+        } else {
+            text = "halt";  // 코드 끝 (암묵적인 halt)
+        }
+        std::cout << std::setw(12) << trace.total - trace.count + i << std::setw(9) << record.pc << "  " << std::left
+                  << std::setw(20) << address_location(labels, record.pc) << std::setw(28) << text << std::right
+                  << std::setw(6) << record.depth << "  ";
+        if (record.depth == 0) {
+            std::cout << "-";
+        } else {
+            std::cout << record.tos << " (" << (8u << record.d_type) << "-bit)";
+        }
+        std::cout << "\n";
+    }
+}
+
 int main(int argc, char* argv[]) {
     // C++ 스트림과 C 표준 스트림의 동기화를 비활성화하여 입출력 성능을 향상시킵니다.
     std::ios_base::sync_with_stdio(false);
 
     CliMode mode = CliMode::NONE;
-    std::string input_file;
-    std::string output_file = "a.out"; // Default output file for assembly
+    std::vector<std::string> input_files;
+    std::string output_file; // 기본값은 -a에서 a.out, --snapshot-at에서 a.snap, -c에서 입력마다 <input>.o
+    std::string snapshot_label;
+    profile_settings profile;
+    trace_settings trace;
+    vm_options options;
+    int optimization_level = 0;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
 
     // Parse command-line arguments
     for (int i = 1; i < argc; ++i) {
@@ -91,12 +382,16 @@ int main(int argc, char* argv[]) {
         if (arg == "-h" || arg == "--help") {
             print_help();
             return 0;
-        } else if (arg == "-a" || arg == "--assemble") {
-            mode = CliMode::ASSEMBLE;
-        } else if (arg == "-r" || arg == "--run") {
-            mode = CliMode::RUN;
-        } else if (arg == "-ar" || arg == "--assemble-run") {
-            mode = CliMode::ASSEMBLE_AND_RUN;
+        } else if (arg == "-a" || arg == "--assemble" || arg == "-r" || arg == "--run" ||
+                   arg == "-ar" || arg == "--assemble-run" || arg == "-c" || arg == "--compile") {
+            if (mode == CliMode::RESUME || mode == CliMode::SHOW_TRACE) {
+                std::cerr << "Error: --resume and --show-trace cannot be combined with -a, -c, -r or -ar." << std::endl;
+                return 1;
+            }
+            mode = arg == "-a" || arg == "--assemble" ? CliMode::ASSEMBLE
+                 : arg == "-c" || arg == "--compile" ? CliMode::COMPILE
+                 : arg == "-r" || arg == "--run" ? CliMode::RUN
+                 : CliMode::ASSEMBLE_AND_RUN;
         } else if (arg == "-o") {
             if (i + 1 < argc) {
                 output_file = argv[++i];
@@ -104,54 +399,235 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Error: -o option requires an argument." << std::endl;
                 return 1;
             }
-        } else {
-            // Assume it's the input file
-            if (input_file.empty()) {
-                input_file = arg;
+        } else if (arg == "-j") {
+            if (i + 1 < argc) {
+                unsigned long long count;
+                if (!parse_number(argv[++i], 1, UINT_MAX, count)) {
+                    std::cerr << "Error: -j option requires a positive thread count, got " << argv[i] << "." << std::endl;
+                    return 1;
+                }
+                jobs = static_cast<unsigned>(count);
+            } else {
+                std::cerr << "Error: -j option requires a thread count." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--snapshot-at") {
+            if (i + 1 < argc) {
+                snapshot_label = argv[++i];
+            } else {
+                std::cerr << "Error: --snapshot-at option requires a label." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--profile") {
+            if (i + 1 < argc) {
+                profile.prefix = argv[++i];
+            } else {
+                std::cerr << "Error: --profile option requires an output prefix." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--profile-interval") {
+            if (i + 1 < argc) {
+                unsigned long long interval;
+                if (!parse_number(argv[++i], 1, UINT32_MAX, interval)) {
+                    std::cerr << "Error: --profile-interval option requires an interval between 1 and "
+                              << UINT32_MAX << ", got " << argv[i] << "." << std::endl;
+                    return 1;
+                }
+                profile.interval = static_cast<uint32_t>(interval);
+            } else {
+                std::cerr << "Error: --profile-interval option requires an argument." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace") {
+            if (i + 1 < argc) {
+                unsigned long long capacity;
+                if (!parse_number(argv[++i], 0, vm::MAX_TRACE_CAPACITY, capacity)) {
+                    std::cerr << "Error: --trace option requires a record count of at most "
+                              << vm::MAX_TRACE_CAPACITY << ", got " << argv[i] << "." << std::endl;
+                    return 1;
+                }
+                options.trace_capacity = static_cast<size_t>(capacity);
+            } else {
+                std::cerr << "Error: --trace option requires a record count." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--trace-file") {
+            if (i + 1 < argc) {
+                trace.file = argv[++i];
+                trace.always = true;
+            } else {
+                std::cerr << "Error: --trace-file option requires a file name." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--show-trace") {
+            if (i + 1 < argc) {
+                if (mode != CliMode::NONE || !input_files.empty()) {
+                    std::cerr << "Error: --show-trace cannot be combined with a mode or an input file." << std::endl;
+                    return 1;
+                }
+                mode = CliMode::SHOW_TRACE;
+                input_files.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: --show-trace option requires a trace file." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--resume") {
+            if (i + 1 < argc) {
+                if (mode != CliMode::NONE || !input_files.empty()) {
+                    std::cerr << "Error: --resume cannot be combined with -a, -c, -r, -ar or an input file." << std::endl;
+                    return 1;
+                }
+                mode = CliMode::RESUME;
+                input_files.push_back(argv[++i]);
+            } else {
+                std::cerr << "Error: --resume option requires a snapshot file." << std::endl;
+                return 1;
+            }
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            optimization_level = arg[2] - '0';
+        } else if (arg == "--stream-stdin") {
+            options.input_stream_size = input_buffer::DEFAULT_STREAM_SIZE;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                const unsigned long long max_size = 1ull << 30;  // 버퍼는 한 번에 할당합니다.
+                unsigned long long size;
+                if (!parse_number(argv[++i], 1, max_size, size)) {
+                    std::cerr << "Error: --stream-stdin buffer size must be between 1 and " << max_size
+                              << " bytes, got " << argv[i] << "." << std::endl;
+                    return 1;
+                }
+                options.input_stream_size = static_cast<size_t>(size);
+            }
+        } else if (arg == "--jit") {
+            options.enable_jit = true;
+        } else if (arg == "--jit-threshold") {
+            if (i + 1 < argc) {
+                unsigned long long threshold;
+                if (!parse_number(argv[++i], 0, UINT32_MAX, threshold)) {
+                    std::cerr << "Error: --jit-threshold option requires a call count of at most "
+                              << UINT32_MAX << ", got " << argv[i] << "." << std::endl;
+                    return 1;
+                }
+                options.jit_threshold = static_cast<uint32_t>(threshold);
             } else {
-                std::cerr << "Error: Multiple input files specified." << std::endl;
+                std::cerr << "Error: --jit-threshold option requires an argument." << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stack-size") {
+            if (i + 1 < argc) {
+                unsigned long long capacity;
+                if (!parse_number(argv[++i], 1, vm::MAX_STACK_CAPACITY, capacity)) {
+                    std::cerr << "Error: --stack-size option requires a capacity between 1 and "
+                              << vm::MAX_STACK_CAPACITY << ", got " << argv[i] << "." << std::endl;
+                    return 1;
+                }
+                options.stack_capacity = static_cast<size_t>(capacity);
+            } else {
+                std::cerr << "Error: --stack-size option requires an argument." << std::endl;
+                return 1;
+            }
+        } else {
+            // Assume it's an input file
+            if (mode == CliMode::RESUME || mode == CliMode::SHOW_TRACE) {
+                std::cerr << "Error: --resume and --show-trace take no input files." << std::endl;
                 return 1;
             }
+            input_files.push_back(arg);
         }
     }
 
-    if (input_file.empty()) {
+    if (input_files.empty()) {
         std::cerr << "Error: No input file specified." << std::endl;
         print_help();
         return 1;
     }
 
     if (mode == CliMode::NONE) {
-        std::cerr << "Error: No mode specified. Please use -a, -r, or -ar." << std::endl;
+        std::cerr << "Error: No mode specified. Please use -a, -c, -r, or -ar." << std::endl;
         print_help();
         return 1;
     }
 
+    // 여러 입력은 어셈블할 때만 받습니다.
+    if (input_files.size() > 1 && mode == CliMode::RUN) {
+        std::cerr << "Error: Multiple input files specified." << std::endl;
+        return 1;
+    }
+    if (mode == CliMode::COMPILE && input_files.size() > 1 && !output_file.empty()) {
+        std::cerr << "Error: -o cannot be used with -c and several input files." << std::endl;
+        return 1;
+    }
+    const std::string& input_file = input_files[0];
+
+    if (trace.always && options.trace_capacity == 0) {
+        options.trace_capacity = trace_settings::DEFAULT_CAPACITY;
+    }
+
+    if (!snapshot_label.empty() && mode != CliMode::RUN && mode != CliMode::ASSEMBLE_AND_RUN) {
+        std::cerr << "Error: --snapshot-at requires -r or -ar." << std::endl;
+        return 1;
+    }
+    if (!snapshot_label.empty() && !profile.prefix.empty()) {
+        std::cerr << "Error: --profile cannot be combined with --snapshot-at." << std::endl;
+        return 1;
+    }
+    if (output_file.empty() && mode != CliMode::COMPILE) {
+        output_file = snapshot_label.empty() ? "a.out" : "a.snap";
+    }
+
     switch (mode) {
         case CliMode::ASSEMBLE: {
             std::cout << "Mode: Assemble" << std::endl;
-            std::cout << "Input file: " << input_file << std::endl;
+            print_inputs(input_files);
             std::cout << "Output file: " << output_file << std::endl;
-            std::string assembly_code = read_source_file(input_file);
-            std::vector<uint16_t> bytecode = assemble(assembly_code);
-            write_bytecode(output_file, bytecode);
+            write_module(output_file, assemble(input_files, optimization_level, jobs, true));
+            break;
+        }
+        case CliMode::COMPILE: {
+            std::cout << "Mode: Compile" << std::endl;
+            print_inputs(input_files);
+            std::vector<link_input> objects = load_objects(input_files, optimization_level, jobs);
+            for (const link_input& object : objects) {
+                write_file(input_files.size() == 1 && !output_file.empty() ? output_file : object_file_name(object.name),
+                           write_object(object.object));
+            }
+            std::cout << "Assembly successful. " << objects.size() << " object file(s) written" << std::endl;
             break;
         }
         case CliMode::RUN: {
             std::cout << "Mode: Run" << std::endl;
             std::cout << "Input file: " << input_file << std::endl;
-            std::vector<uint16_t> bytecode = read_bytecode_file(input_file);
-            run_vm(bytecode);
+            mapped_module module = open_module_file(input_file);
+            run_module(module.view(), options, profile, trace, snapshot_label, output_file);
             break;
         }
         case CliMode::ASSEMBLE_AND_RUN: {
             std::cout << "Mode: Assemble and Run" << std::endl;
-            std::cout << "Input file: " << input_file << std::endl;
-            std::string assembly_code = read_source_file(input_file);
-            std::vector<uint16_t> bytecode = assemble(assembly_code);
-            run_vm(bytecode);
+            print_inputs(input_files);
+            std::vector<uint8_t> module = assemble(input_files, optimization_level, jobs, false);
+            module_view view;
+            std::string error;
+            if (!parse_module(module.data(), module.size(), view, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return 1;
+            }
+            run_module(view, options, profile, trace, snapshot_label, output_file);
             break;
         }
+        case CliMode::RESUME: {
+            std::cout << "Mode: Resume" << std::endl;
+            std::cout << "Snapshot file: " << input_file << std::endl;
+            std::string error;
+            std::unique_ptr<vm> dirt_vm = vm::restore_snapshot(input_file, options, error);
+            if (!dirt_vm) {
+                std::cerr << "Error: Could not restore snapshot " << input_file << ": " << error << std::endl;
+                return 1;
+            }
+            run_to_end(*dirt_vm, profile, trace, {});
+            break;
+        }
+        case CliMode::SHOW_TRACE:
+            show_trace(input_file);
+            break;
         case CliMode::NONE:
             // 이 경우는 이미 위에서 처리되었지만, 안전을 위해 추가합니다.
             break;
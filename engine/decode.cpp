@@ -0,0 +1,223 @@
+#include "decode.h"
+#include "opcode.h"
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+static const uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+
+size_t instruction_width(uint8_t opcode) {
+    if (is_branch_opcode(opcode)) {
+        return 9;
+    }
+    switch (opcode) {
+        case OP_PUSHD128:
+            return 9;
+        case OP_PUSHD8:
+        case OP_PUSHD16:
+        case OP_ADDI:
+        case OP_GLOADI:
+        case OP_GSTOREI:
+            return 2;
+        case OP_PUSHD32:
+            return 3;
+        case OP_PUSHD64:
+            return 5;
+        default:
+            return 1;
+    }
+}
+
+namespace {
+
+class decoder {
+public:
+    decoder(const uint16_t* bytecode, size_t size)
+        : bytecode(bytecode), size(size), word_to_index(size + 1, NO_INDEX) {}
+
+    decoded_program run() {
+        // 1) 0번지부터 순차적으로 디코딩합니다.
+        size_t address = 0;
+        while (address < size) {
+            address += decode_at(address);
+        }
+        program.halt_index = emit(instruction{OP_HALT, 0, 0, 0, 0}, size);
+        word_to_index[size] = program.halt_index;
+
+        // 2) 분기 대상을 인덱스로 바꿉니다. 명령어 경계가 아닌 주소로 분기하는 경우
+        //    원래 인터프리터처럼 그 주소부터 해석한 보조 명령어열을 덧붙입니다.
+        while (!pending.empty()) {
+            auto [index, target] = pending.back();
+            pending.pop_back();
+            program.code[index].target = resolve(target);
+        }
+
+        // 3) 분기 명령어가 자기 블록의 길이를 알 수 있도록 블록 안의 위치를 기록합니다.
+        //    파이버 선점과 연료는 분기마다 이 값만큼 시간 할당량을 줄입니다.
+        split_blocks();
+        return std::move(program);
+    }
+
+private:
+    const uint16_t* bytecode;
+    size_t size;
+    std::vector<uint32_t> word_to_index;
+    std::vector<std::pair<uint32_t, __uint128_t>> pending;
+    decoded_program program;
+
+    // 바이트코드 끝을 넘는 피연산자는 0으로 읽습니다.
+    uint16_t word(size_t address) const {
+        return address < size ? bytecode[address] : 0;
+    }
+
+    uint64_t read_u64(size_t address, int words) const {
+        uint64_t value = 0;
+        for (int i = words - 1; i >= 0; --i) {
+            value = (value << 16) | word(address + i);
+        }
+        return value;
+    }
+
+    uint32_t emit(instruction insn, size_t address) {
+        program.code.push_back(insn);
+        program.addresses.push_back(address);
+        return static_cast<uint32_t>(program.code.size() - 1);
+    }
+
+    // address의 명령어 하나를 디코딩하고 명령어 폭을 반환합니다.
+    size_t decode_at(size_t address) {
+        uint16_t raw = bytecode[address];
+        instruction insn{static_cast<uint8_t>(raw >> 10), 0, static_cast<uint16_t>(raw & 0x03FF), 0, 0};
+
+        switch (insn.opcode) {
+            case OP_PUSHD8:
+                insn.imm = word(address + 1) & 0xFF;
+                break;
+            case OP_PUSHD16:
+            case OP_ADDI:
+            case OP_GLOADI:
+            case OP_GSTOREI:
+                insn.imm = word(address + 1);
+                break;
+            case OP_PUSHD32:
+                insn.imm = read_u64(address + 1, 2);
+                break;
+            case OP_PUSHD64:
+                insn.imm = read_u64(address + 1, 4);
+                break;
+            case OP_PUSHD128: {
+                __uint128_t value = ((__uint128_t)read_u64(address + 5, 4) << 64) | read_u64(address + 1, 4);
+                insn.imm = program.wide_immediates.size();
+                program.wide_immediates.push_back(value);
+                break;
+            }
+            default:
+                break;
+        }
+
+        uint32_t index = emit(insn, address);
+        word_to_index[address] = index;
+        if (is_branch_opcode(insn.opcode)) {
+            __uint128_t target = ((__uint128_t)read_u64(address + 5, 4) << 64) | read_u64(address + 1, 4);
+            pending.push_back({index, target});
+        }
+        return instruction_width(insn.opcode);
+    }
+
+    // 블록이 분기로 끝나는지. 분기가 아닌 명령어 다음으로 이어지는 블록은 그 분기에서 세지 않습니다.
+    static bool ends_block(uint8_t opcode) {
+        return is_branch_opcode(opcode) || opcode == OP_RET || opcode == OP_HALT;
+    }
+
+    // 시간 할당량은 분기에서만 줄이므로, 분기 없이 다음 리더로 이어지는 곳과 255개를 넘는
+    // 직선 코드 안에 바로 다음 명령어로 가는 jmp를 끼워 모든 명령어가 어느 분기에서든 세어지게 합니다.
+    // 끼운 jmp의 주소는 앞 명령어의 것이므로 중단점과 pc_address()는 원래 명령어를 가리킵니다.
+    void split_blocks() {
+        const std::vector<instruction>& code = program.code;
+        std::vector<bool> leader(code.size(), false);
+        leader[0] = true;
+        for (size_t i = 0; i < code.size(); i++) {
+            if (is_branch_opcode(code[i].opcode)) {
+                leader[code[i].target] = true;
+            }
+            if (ends_block(code[i].opcode) && i + 1 < code.size()) {
+                leader[i + 1] = true;
+            }
+        }
+
+        std::vector<bool> charge_before(code.size(), false);
+        std::vector<uint32_t> new_index(code.size());
+        size_t count = 0;
+        unsigned length = 0;
+        for (size_t i = 0; i < code.size(); i++) {
+            if (leader[i]) {
+                charge_before[i] = i > 0 && !ends_block(code[i - 1].opcode);
+                length = 0;
+            } else if (length == 254 && !ends_block(code[i].opcode)) {
+                charge_before[i] = true;
+                length = 0;
+            }
+            count += charge_before[i];
+            new_index[i] = static_cast<uint32_t>(count++);
+            length++;
+        }
+        if (count >= NO_INDEX) {
+            std::cerr << "Bytecode too large to decode" << std::endl;
+            exit(1);
+        }
+
+        std::vector<instruction> split;
+        std::vector<uint64_t> addresses;
+        split.reserve(count);
+        addresses.reserve(count);
+        for (size_t i = 0; i < code.size(); i++) {
+            if (charge_before[i]) {
+                split.push_back(instruction{OP_JMP, 0, CHARGE_OPERAND, new_index[i], 0});
+                addresses.push_back(program.addresses[i - 1]);
+            }
+            instruction insn = code[i];
+            if (is_branch_opcode(insn.opcode)) {
+                insn.target = new_index[insn.target];
+            }
+            split.push_back(insn);
+            addresses.push_back(program.addresses[i]);
+        }
+        program.halt_index = new_index[program.halt_index];
+
+        unsigned block = 0;
+        for (size_t i = 0; i < split.size(); i++) {
+            block = i == 0 || ends_block(split[i - 1].opcode) ? 1 : block + 1;
+            split[i].block_length = static_cast<uint8_t>(block);
+        }
+        program.code = std::move(split);
+        program.addresses = std::move(addresses);
+    }
+
+    uint32_t resolve(__uint128_t target) {
+        if (target >= size) {
+            return program.halt_index;
+        }
+        size_t address = static_cast<size_t>(target);
+        if (word_to_index[address] != NO_INDEX) {
+            return word_to_index[address];
+        }
+
+        uint32_t first = static_cast<uint32_t>(program.code.size());
+        while (address < size && word_to_index[address] == NO_INDEX) {
+            address += decode_at(address);
+        }
+        uint32_t next = address < size ? word_to_index[address] : program.halt_index;
+        emit(instruction{OP_JMP, 0, 0, next, 0}, address);
+        return first;
+    }
+};
+
+} // namespace
+
+decoded_program decode_bytecode(const uint16_t* bytecode, size_t size) {
+    if (size >= NO_INDEX) {
+        std::cerr << "Bytecode too large to decode" << std::endl;
+        exit(1);
+    }
+    return decoder(bytecode, size).run();
+}
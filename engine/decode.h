@@ -0,0 +1,35 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 로드 시점에 한 번 디코딩된 명령어입니다.
+// vm::run()은 이 배열만 읽으며 바이트코드 피연산자를 다시 해석하지 않습니다.
+struct instruction {
+    uint8_t opcode;     // OPCODE 값 (알 수 없는 opcode도 그대로 보존)
+    uint8_t block_length; // 기본 블록 시작부터 이 명령어까지의 명령어 수 (블록은 255개를 넘지 않습니다)
+    uint16_t operand;   // 10-bit 피연산자 (지역 태그, 시스템 콜 번호)
+    uint32_t target;    // 분기 대상의 디코딩된 명령어 인덱스
+    uint64_t imm;       // push 즉시값. pushd128은 wide_immediates의 인덱스
+};
+
+// 디코더가 블록을 닫으려고 끼워 넣은 jmp의 operand. 바이트코드의 operand는 10비트이므로 겹치지 않으며,
+// 바이트코드에 없는 명령어이므로 실행 추적에 기록하지 않습니다.
+static const uint16_t CHARGE_OPERAND = 0x8000;
+
+struct decoded_program {
+    // 마지막 원본 명령어 뒤에 halt가 붙습니다. 모든 블록이 분기로 끝나도록 디코더가 jmp를 끼워 넣기도 합니다.
+    std::vector<instruction> code;
+    std::vector<__uint128_t> wide_immediates;
+    std::vector<uint64_t> addresses;        // 명령어 인덱스 -> 바이트코드 워드 주소
+    uint32_t halt_index;                    // 바이트코드 끝에 해당하는 halt의 인덱스
+};
+
+// 명령어가 차지하는 워드 수 (명령어 워드 포함)
+size_t instruction_width(uint8_t opcode);
+
+decoded_program decode_bytecode(const uint16_t* bytecode, size_t size);
+
+#endif // DECODE_H
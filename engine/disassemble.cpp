@@ -0,0 +1,89 @@
+#include "disassemble.h"
+#include "decode.h"
+#include "opcode.h"
+
+#include <cstdio>
+
+namespace {
+
+// 6비트 opcode -> 니모닉. 비어 있는 자리는 정의되지 않은 opcode입니다.
+const char* const mnemonics[64] = {
+    "halt", "add", "sub", "mul", "div", nullptr, "pop", "dup",
+    "jmp", "jz", "jnz", "call", "ret", "eq", "lt", "gt",
+    "gload", "gstore", "lload", "lstore", "pushd8", "pushd16", "pushd32", "pushd64",
+    "pushd128", "syscall", "addi", "jeq", "jne", "jlt", "jge", "jgt",
+    "jle", "jzk", "jnzk", "gloadi", "gstorei", "shli", "shri", "gcopy",
+    "gfill", "gcmp", "spawn", "yield", "join",
+};
+
+std::string to_string(__uint128_t value) {
+    if (value <= UINT64_MAX) {
+        return std::to_string(static_cast<uint64_t>(value));
+    }
+    char buffer[40];
+    std::snprintf(buffer, sizeof(buffer), "0x%016llx%016llx", static_cast<unsigned long long>(value >> 64),
+                  static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+} // namespace
+
+std::map<uint64_t, std::string> address_labels(const std::vector<module_symbol>& symbols) {
+    std::map<uint64_t, std::string> labels;
+    for (const module_symbol& symbol : symbols) {
+        auto it = labels.find(symbol.address);
+        if (it == labels.end() || symbol.name < it->second) {
+            labels[symbol.address] = symbol.name;
+        }
+    }
+    return labels;
+}
+
+std::string address_location(const std::map<uint64_t, std::string>& labels, uint64_t address) {
+    auto it = labels.upper_bound(address);
+    if (it == labels.begin()) {
+        return std::to_string(address);
+    }
+    --it;
+    return it->first == address ? it->second : it->second + "+" + std::to_string(address - it->first);
+}
+
+size_t disassemble(const uint16_t* code, size_t size, size_t address,
+                   const std::map<uint64_t, std::string>& labels, std::string& text) {
+    auto word = [&](size_t i) -> uint16_t { return address + i < size ? code[address + i] : 0; };
+    // 피연산자 워드는 낮은 워드가 먼저입니다.
+    auto value = [&](size_t words) {
+        __uint128_t v = 0;
+        for (size_t i = words; i > 0; i--) {
+            v = (v << 16) | word(i);
+        }
+        return v;
+    };
+
+    uint16_t raw = word(0);
+    uint8_t opcode = static_cast<uint8_t>(raw >> 10);
+    uint16_t operand = raw & 0x03FF;
+    const char* name = mnemonics[opcode];
+    if (name == nullptr) {
+        char buffer[24];
+        std::snprintf(buffer, sizeof(buffer), ".word 0x%04x", raw);
+        text = buffer;
+        return 1;
+    }
+    text = name;
+
+    size_t width = instruction_width(opcode);
+    if (is_branch_opcode(opcode)) {
+        __uint128_t target = value(8);
+        auto label = target <= UINT64_MAX ? labels.find(static_cast<uint64_t>(target)) : labels.end();
+        text += " " + (label != labels.end() ? label->second : to_string(target));
+    } else if (opcode == OP_PUSHD8) {
+        text += " " + std::to_string(word(1) & 0xFF);
+    } else if (width > 1) {
+        text += " " + to_string(value(width - 1));
+    } else if (opcode == OP_LLOAD || opcode == OP_LSTORE || opcode == OP_SYSCALL || opcode == OP_SHLI ||
+               opcode == OP_SHRI) {
+        text += " " + std::to_string(operand);
+    }
+    return width;
+}
@@ -0,0 +1,23 @@
+#ifndef DISASSEMBLE_H
+#define DISASSEMBLE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "module_file.h"
+
+// 주소 -> 라벨. 같은 주소에 라벨이 여럿이면 이름순으로 첫 번째를 씁니다.
+std::map<uint64_t, std::string> address_labels(const std::vector<module_symbol>& symbols);
+
+// address 앞의 가장 가까운 라벨로 주소를 나타냅니다 ("loop", "loop+3"). 라벨이 없으면 숫자만 씁니다.
+std::string address_location(const std::map<uint64_t, std::string>& labels, uint64_t address);
+
+// address의 명령어 하나를 어셈블러가 읽는 문법으로 text에 쓰고 명령어 폭(워드 수)을 반환합니다.
+// 분기 대상에 라벨이 있으면 라벨 이름을 씁니다. 코드 끝을 넘는 피연산자는 0으로 읽습니다.
+size_t disassemble(const uint16_t* code, size_t size, size_t address,
+                   const std::map<uint64_t, std::string>& labels, std::string& text);
+
+#endif // DISASSEMBLE_H
@@ -0,0 +1,123 @@
+#include "event_loop.h"
+#include "vm.h"
+
+#include <cerrno>
+#include <iostream>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+event_loop::event_loop() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {
+    if (epoll_fd < 0) {
+        std::cerr << "Error: Could not create epoll instance" << std::endl;
+        exit(1);
+    }
+}
+
+event_loop::~event_loop() {
+    close(epoll_fd);
+}
+
+void event_loop::add(vm* machine) {
+    ready.push_back(machine);
+}
+
+size_t event_loop::run(completion done) {
+    size_t halted = 0;
+    epoll_event events[64];
+    while (!ready.empty() || waiting_count != 0) {
+        while (!ready.empty()) {
+            vm* machine = ready.front();
+            ready.pop_front();
+            vm_status status = machine->run();
+            switch (status) {
+                case vm_status::WAITING:
+                    wait_on(machine);
+                    continue;
+                case vm_status::OUT_OF_FUEL:
+                    // 제한 없이 run()하므로 일어나지 않지만, 일어나면 이어서 실행합니다.
+                    ready.push_back(machine);
+                    continue;
+                case vm_status::HALTED:
+                    halted++;
+                    break;
+                case vm_status::TRAPPED:
+                case vm_status::INTERRUPTED:
+                case vm_status::BREAKPOINT:
+                    break;
+            }
+            if (done) {
+                done(*machine, status);
+            }
+        }
+        if (waiting_count == 0) {
+            break;
+        }
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Error: epoll_wait failed" << std::endl;
+            exit(1);
+        }
+        for (int i = 0; i < n; i++) {
+            dispatch(events[i].data.fd, events[i].events);
+        }
+    }
+    return halted;
+}
+
+void event_loop::wait_on(vm* machine) {
+    int fd = machine->waiting_fd();
+    interest& entry = interests[fd];
+    (machine->waiting_for_write() ? entry.writers : entry.readers).push_back(machine);
+    waiting_count++;
+    update(fd, entry);
+}
+
+// 기다리는 VM에 맞춰 등록을 고칩니다. 아무도 기다리지 않으면 등록을 지웁니다.
+void event_loop::update(int fd, interest& entry) {
+    uint32_t wanted = (entry.readers.empty() ? 0u : uint32_t(EPOLLIN)) | (entry.writers.empty() ? 0u : uint32_t(EPOLLOUT));
+    if (wanted == entry.registered) {
+        return;
+    }
+    epoll_event event = {};
+    event.events = wanted;
+    event.data.fd = fd;
+    int op = wanted == 0 ? EPOLL_CTL_DEL : entry.registered == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(epoll_fd, op, fd, &event) != 0) {
+        // epoll로 기다릴 수 없는 fd(일반 파일 등)는 항상 준비된 것으로 보고 바로 다시 실행합니다.
+        for (vm* machine : entry.readers) ready.push_back(machine);
+        for (vm* machine : entry.writers) ready.push_back(machine);
+        waiting_count -= entry.readers.size() + entry.writers.size();
+        interests.erase(fd);
+        return;
+    }
+    entry.registered = wanted;
+}
+
+void event_loop::dispatch(int fd, uint32_t events) {
+    auto it = interests.find(fd);
+    if (it == interests.end()) {
+        return;
+    }
+    interest& entry = it->second;
+    // 오류나 끊김은 양쪽 모두 깨웁니다. 다시 실행된 시스템 콜이 결과를 돌려줍니다.
+    bool wake_readers = events & (EPOLLIN | EPOLLHUP | EPOLLERR);
+    bool wake_writers = events & (EPOLLOUT | EPOLLHUP | EPOLLERR);
+    if (wake_readers) {
+        for (vm* machine : entry.readers) ready.push_back(machine);
+        waiting_count -= entry.readers.size();
+        entry.readers.clear();
+    }
+    if (wake_writers) {
+        for (vm* machine : entry.writers) ready.push_back(machine);
+        waiting_count -= entry.writers.size();
+        entry.writers.clear();
+    }
+    update(fd, entry);
+    it = interests.find(fd);
+    if (it != interests.end() && it->second.registered == 0) {
+        interests.erase(it);
+    }
+}
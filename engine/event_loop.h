@@ -0,0 +1,53 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class vm;
+enum class vm_status;
+
+// 한 스레드에서 여러 호스트 모드 VM(vm_options::nonblocking_io)을 실행하는 epoll 루프.
+// VM이 WAITING으로 돌아오면 기다리는 fd를 epoll에 등록하고, fd가 준비되면 다시 run()합니다.
+// VM의 수명은 호출하는 쪽이 관리하며, run()이 끝날 때까지 살아 있어야 합니다.
+class event_loop {
+public:
+    // VM이 WAITING 말고 다른 상태로 돌아와 루프를 떠날 때 불립니다.
+    typedef std::function<void(vm&, vm_status)> completion;
+
+    event_loop();
+    ~event_loop();
+    event_loop(const event_loop&) = delete;
+    event_loop& operator=(const event_loop&) = delete;
+
+    void add(vm* machine);
+
+    // 추가된 VM이 모두 루프를 떠날 때까지 실행하고, HALTED로 끝난 VM 수를 반환합니다.
+    // TRAPPED, INTERRUPTED, BREAKPOINT로 멈춘 VM도 루프를 떠나며 done으로만 알립니다.
+    // 멈춘 VM은 add()로 다시 넣으면 이어서 실행합니다.
+    size_t run(completion done = completion());
+
+    size_t waiting() const { return waiting_count; }
+
+private:
+    struct interest {
+        std::vector<vm*> readers;
+        std::vector<vm*> writers;
+        uint32_t registered = 0;  // epoll에 등록된 이벤트
+    };
+
+    int epoll_fd;
+    std::deque<vm*> ready;
+    std::unordered_map<int, interest> interests;
+    size_t waiting_count = 0;
+
+    void wait_on(vm* machine);
+    void update(int fd, interest& entry);
+    void dispatch(int fd, uint32_t events);
+};
+
+#endif // EVENT_LOOP_H
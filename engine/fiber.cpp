@@ -0,0 +1,119 @@
+#include "vm.h"
+#include <utility>
+
+// 파이버 스케줄러. 실행 대기열을 라운드 로빈으로 돌며, run()은 yield, join,
+// 파이버의 끝, 시간 할당량 소진 때만 이곳을 부릅니다.
+
+bool vm::spawn_fiber(uint32_t entry, stack_data argument, uint64_t& id) {
+    if (fibers.empty()) {
+        // 지금까지의 실행 흐름이 0번 파이버가 됩니다. 상태는 vm 멤버에 그대로 둡니다.
+        fibers.emplace_back();
+        fibers[0].state = fiber_state::RUNNING;
+        current_fiber = 0;
+    }
+
+    if (fiber_stack_capacity == 0) {
+        return raise(vm_trap::STACK_OVERFLOW);
+    }
+    id = fibers.size();
+    fibers.emplace_back();
+    fiber& f = fibers.back();
+    f.pc = entry;
+    f.stack.reset(new stack_data[fiber_stack_capacity + 1]);
+    f.stack_capacity = fiber_stack_capacity;
+    f.stack[0] = stack_data(D_TYPE::BIT_8, 0);
+    f.stack[++f.stack_size] = argument;
+    run_queue.push_back(id);
+    return true;
+}
+
+void vm::yield_fiber() {
+    if (run_queue.empty()) {
+        return;
+    }
+    fibers[current_fiber].state = fiber_state::READY;
+    run_queue.push_back(current_fiber);
+    schedule_next(); // 대기열이 비어 있지 않으므로 실패하지 않습니다.
+}
+
+bool vm::join_fiber(__uint128_t id) {
+    if (id >= fibers.size() || id == current_fiber) {
+        return raise(vm_trap::BAD_FIBER);
+    }
+    fiber& f = fibers[static_cast<size_t>(id)];
+    if (f.state != fiber_state::DONE && run_queue.empty()) {
+        return raise(vm_trap::DEADLOCK);
+    }
+    // 실패하지 않는 것이 확실해졌으므로 스택 맨 위의 파이버 번호를 내립니다.
+    stack_size--;
+    if (f.state == fiber_state::DONE) {
+        push(f.result);
+        return trap_reason == vm_trap::NONE;
+    }
+    f.joiners.push_back(current_fiber);
+    fibers[current_fiber].state = fiber_state::JOINING;
+    return schedule_next();
+}
+
+bool vm::finish_fiber() {
+    fiber& self = fibers[current_fiber];
+    self.state = fiber_state::DONE;
+    self.result = stack_size > 0 ? stack[stack_size] : stack_data(D_TYPE::BIT_8, 0);
+
+    // 기다리던 파이버들의 스택에 결과를 올려 두고 대기열에 넣습니다.
+    for (uint64_t id : self.joiners) {
+        fiber& waiter = fibers[id];
+        if (waiter.stack_size == waiter.stack_capacity) {
+            return raise(vm_trap::STACK_OVERFLOW);
+        }
+        waiter.stack[++waiter.stack_size] = self.result;
+        waiter.state = fiber_state::READY;
+        run_queue.push_back(id);
+    }
+    self.joiners.clear();
+    return schedule_next();
+}
+
+// 대기열의 다음 파이버로 넘어갑니다. 현재 파이버는 이미 대기열에 넣었거나
+// 기다리는 상태여야 합니다.
+bool vm::schedule_next() {
+    if (run_queue.empty()) {
+        return raise(vm_trap::DEADLOCK);
+    }
+    uint64_t next = run_queue.front();
+    run_queue.pop_front();
+    switch_fiber(next);
+    return true;
+}
+
+void vm::switch_fiber(uint64_t next) {
+    if (next == current_fiber) {
+        fibers[next].state = fiber_state::RUNNING;
+        return;
+    }
+    fiber& from = fibers[current_fiber];
+    std::swap(pc, from.pc);
+    std::swap(stack, from.stack);
+    std::swap(stack_capacity, from.stack_capacity);
+    std::swap(stack_size, from.stack_size);
+    std::swap(call_stack, from.call_stack);
+    std::swap(local_memory, from.local_memory);
+    if (from.state == fiber_state::DONE) {
+        // 끝난 파이버는 결과만 남기고 스택과 지역 메모리를 돌려줍니다.
+        from.stack.reset();
+        from.stack_capacity = 0;
+        from.stack_size = 0;
+        from.call_stack = std::vector<call_frame>();
+        from.local_memory = local_arena();
+    }
+
+    fiber& to = fibers[next];
+    std::swap(pc, to.pc);
+    std::swap(stack, to.stack);
+    std::swap(stack_capacity, to.stack_capacity);
+    std::swap(stack_size, to.stack_size);
+    std::swap(call_stack, to.call_stack);
+    std::swap(local_memory, to.local_memory);
+    to.state = fiber_state::RUNNING;
+    current_fiber = next;
+}
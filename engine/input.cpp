@@ -0,0 +1,49 @@
+#include "input.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+input_buffer::input_buffer(size_t stream_size, int stream_fd)
+    : stream_fd(stream_fd), stream_size(stream_size),
+      stream(stream_size ? new uint8_t[stream_size] : nullptr) {}
+
+long input_buffer::read(int fd, paged_memory& memory, uint64_t address, uint64_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    if (fd != stream_fd || stream_size == 0) {
+        size_t size = static_cast<size_t>(std::min(count, DIRECT_CHUNK));
+        scratch.resize(size);
+        long n = read_some(fd, scratch.data(), size);
+        if (n > 0) {
+            memory.write(address, D_TYPE::BIT_8, scratch.data(), static_cast<uint64_t>(n));
+        }
+        return n;
+    }
+
+    // 버퍼가 비었을 때만 채웁니다. 남은 바이트가 있는데 더 읽으려 하면 파이프나 터미널에서 막힐 수 있습니다.
+    if (begin == end) {
+        long n = read_some(fd, stream.get(), stream_size);
+        if (n <= 0) {
+            return n;
+        }
+        begin = 0;
+        end = static_cast<size_t>(n);
+    }
+    size_t n = static_cast<size_t>(std::min<uint64_t>(count, end - begin));
+    memory.write(address, D_TYPE::BIT_8, stream.get() + begin, n);
+    begin += n;
+    return static_cast<long>(n);
+}
+
+long input_buffer::read_some(int fd, uint8_t* out, size_t size) {
+    for (;;) {
+        syscalls++;
+        ssize_t n = ::read(fd, out, size);
+        if (n >= 0 || errno != EINTR) {
+            return n < 0 ? -1 : static_cast<long>(n);
+        }
+    }
+}
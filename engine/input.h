@@ -0,0 +1,44 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "object.h"
+
+// VM마다 하나씩 가지는 SYS_read 입력 계층.
+// 기본은 요청마다 read 한 번으로 받은 바이트를 전역 메모리에 BIT_8 셀로 바로 채웁니다.
+// 스트리밍 모드에서는 한 fd(보통 stdin)를 고정 크기 버퍼로 읽어, 작은 read 여러 번을
+// 시스템 콜 한 번으로 처리하고 입력 크기와 관계없이 같은 메모리만 사용합니다.
+class input_buffer {
+public:
+    static constexpr size_t DEFAULT_STREAM_SIZE = 64 * 1024;
+    // 버퍼 없이 읽는 read 한 번이 받을 수 있는 최대 바이트 수
+    static constexpr uint64_t DIRECT_CHUNK = 1 << 20;
+
+    // stream_size가 0이면 스트리밍하지 않습니다.
+    explicit input_buffer(size_t stream_size = 0, int stream_fd = 0);
+
+    // fd에서 최대 count 바이트를 memory[address..]로 읽습니다. 범위 검사는 호출하는 쪽에서 합니다.
+    // read(2)처럼 읽은 바이트 수, 끝이면 0, 실패하면 -1을 반환합니다.
+    long read(int fd, paged_memory& memory, uint64_t address, uint64_t count);
+
+    // 스트리밍 버퍼에 남아 있는 바이트 수
+    size_t buffered() const { return end - begin; }
+    size_t syscall_count() const { return syscalls; }
+
+private:
+    int stream_fd;
+    size_t stream_size;
+    std::unique_ptr<uint8_t[]> stream;  // 스트리밍 버퍼. [begin, end)가 아직 읽지 않은 바이트입니다.
+    size_t begin = 0;
+    size_t end = 0;
+    std::vector<uint8_t> scratch;       // 버퍼 없는 read가 받는 곳
+    size_t syscalls = 0;
+
+    long read_some(int fd, uint8_t* out, size_t size);
+};
+
+#endif // INPUT_H
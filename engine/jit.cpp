@@ -0,0 +1,729 @@
+#include "jit.h"
+#include "vm.h"
+#include "opcode.h"
+
+#include <map>
+#include <set>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#ifdef DIRTVM_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// 한 함수로 컴파일할 최대 명령어 수
+static const size_t MAX_REGION_SIZE = 8192;
+
+jit_compiler::jit_compiler(const decoded_program& program, uint32_t threshold)
+    : program(program),
+      threshold(threshold),
+      entries(program.code.size(), nullptr),
+      hotness(program.code.size(), 0),
+      attempted(program.code.size(), false) {}
+
+jit_compiler::~jit_compiler() {
+#ifdef DIRTVM_JIT_SUPPORTED
+    for (auto& region : regions) {
+        munmap(region.first, region.second);
+    }
+#endif
+}
+
+#ifndef DIRTVM_JIT_SUPPORTED
+
+void jit_compiler::compile(uint32_t function_index) {
+    attempted[function_index] = true;
+}
+
+#else
+
+namespace {
+
+// 네이티브 코드에서 부르는 도우미. false를 반환하면 인터프리터로 빠져나갑니다.
+void helper_div(stack_data* top) {
+    stack_data* a = top - 1;
+    *a = stack_data(a->get_d_type(), a->get_data() / top->get_data());
+}
+
+bool helper_gload(vm* machine, stack_data* top) {
+    return machine->load_global(top->get_data(), *top);
+}
+
+bool helper_gstore(vm* machine, stack_data* top) {
+    return machine->store_global(top->get_data(), top[-1]);
+}
+
+// 대량 메모리 연산. 스택: ... top[-2] top[-1] top[0](count)
+bool helper_gcopy(vm* machine, stack_data* top) {
+    return machine->copy_global(top[-2].get_data(), top[-1].get_data(), top->get_data());
+}
+
+bool helper_gfill(vm* machine, stack_data* top) {
+    return machine->fill_global(top[-2].get_data(), top->get_data(), top[-1]);
+}
+
+bool helper_gcmp(vm* machine, stack_data* top) {
+    uint8_t order;
+    if (!machine->compare_global(top[-2].get_data(), top[-1].get_data(), top->get_data(), order)) {
+        return false;
+    }
+    top[-2] = stack_data(D_TYPE::BIT_8, order);
+    return true;
+}
+
+bool helper_lload(vm* machine, stack_data* top, uint32_t tag) {
+    return machine->load_local(tag, top->get_data(), *top);
+}
+
+bool helper_lstore(vm* machine, stack_data* top, uint32_t tag) {
+    return machine->store_local(tag, top->get_data(), top[-1]);
+}
+
+enum reg { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+           R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+// 레지스터 배치: rbx = sp, r12 = base, r13 = limit, r14 = jit_state*, r15 = vm*
+const reg SP = RBX, BASE = R12, LIMIT = R13, STATE = R14, MACHINE = R15;
+const int32_t SLOT = sizeof(stack_data);
+const int32_t LO = 0, HI = 8, TAG = 16;
+
+enum cond : uint8_t { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC };
+
+// 필요한 만큼만 구현한 x86-64 인코더
+class emitter {
+public:
+    std::vector<uint8_t> code;
+
+    size_t size() const { return code.size(); }
+    void byte(uint8_t b) { code.push_back(b); }
+    void u32(uint32_t v) { for (int i = 0; i < 4; i++) byte(v >> (8 * i)); }
+    void u64(uint64_t v) { for (int i = 0; i < 8; i++) byte(v >> (8 * i)); }
+
+    void patch32(size_t at, int32_t v) { std::memcpy(&code[at], &v, 4); }
+
+    // [base + disp] 메모리 피연산자를 쓰는 명령어
+    void op_mem(std::initializer_list<uint8_t> op, int r, int base, int32_t disp, bool wide = true) {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | ((r & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+        if (rex != 0x40) byte(rex);
+        for (uint8_t b : op) byte(b);
+        int mod = (disp == 0 && (base & 7) != RBP) ? 0 : (disp >= -128 && disp <= 127 ? 1 : 2);
+        byte((mod << 6) | ((r & 7) << 3) | (base & 7));
+        if ((base & 7) == RSP) byte(0x24);
+        if (mod == 1) byte(static_cast<uint8_t>(disp));
+        else if (mod == 2) u32(static_cast<uint32_t>(disp));
+    }
+
+    // 레지스터끼리의 명령어 (modrm.reg = r, modrm.rm = rm)
+    void op_reg(std::initializer_list<uint8_t> op, int r, int rm, bool wide = true) {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | ((r & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+        if (rex != 0x40) byte(rex);
+        for (uint8_t b : op) byte(b);
+        byte(0xC0 | ((r & 7) << 3) | (rm & 7));
+    }
+
+    void load(int dst, int base, int32_t disp) { op_mem({0x8B}, dst, base, disp); }
+    void store(int base, int32_t disp, int src) { op_mem({0x89}, src, base, disp); }
+    void load_tag(int dst, int base, int32_t disp) { op_mem({0x0F, 0xB6}, dst, base, disp, false); }
+    void store_tag(int base, int32_t disp, int src) { op_mem({0x88}, src, base, disp, false); }
+    void store_tag_imm(int base, int32_t disp, uint8_t imm) { op_mem({0xC6}, 0, base, disp, false); byte(imm); }
+    void store_imm32(int base, int32_t disp, int32_t imm) { op_mem({0xC7}, 0, base, disp); u32(imm); }
+    void lea(int dst, int base, int32_t disp) { op_mem({0x8D}, dst, base, disp); }
+
+    void add_to_mem(int base, int32_t disp, int src) { op_mem({0x01}, src, base, disp); }
+    void adc_to_mem(int base, int32_t disp, int src) { op_mem({0x11}, src, base, disp); }
+    void sub_from_mem(int base, int32_t disp, int src) { op_mem({0x29}, src, base, disp); }
+    void sbb_from_mem(int base, int32_t disp, int src) { op_mem({0x19}, src, base, disp); }
+    void cmp_mem(int r, int base, int32_t disp) { op_mem({0x3B}, r, base, disp); }
+    void sbb_mem(int r, int base, int32_t disp) { op_mem({0x1B}, r, base, disp); }
+    void xor_mem(int r, int base, int32_t disp) { op_mem({0x33}, r, base, disp); }
+    void or_mem(int r, int base, int32_t disp) { op_mem({0x0B}, r, base, disp); }
+    void cmp_mem_imm32(int base, int32_t disp, int32_t imm) { op_mem({0x81}, 7, base, disp); u32(imm); }
+    void sub_mem_imm32(int base, int32_t disp, int32_t imm) { op_mem({0x81}, 5, base, disp); u32(imm); }
+
+    void mov(int dst, int src) { op_reg({0x89}, src, dst); }
+    void cmp(int a, int b) { op_reg({0x39}, b, a); }
+    void or_(int dst, int src) { op_reg({0x09}, src, dst); }
+    void add(int dst, int src) { op_reg({0x01}, src, dst); }
+    void imul(int dst, int src) { op_reg({0x0F, 0xAF}, dst, src); }
+    void mul(int src) { op_reg({0xF7}, 4, src); }
+    void shl_imm(int dst, uint8_t count) { op_reg({0xC1}, 4, dst); byte(count); }
+    void shr_imm(int dst, uint8_t count) { op_reg({0xC1}, 5, dst); byte(count); }
+    void shld_imm(int dst, int src, uint8_t count) { op_reg({0x0F, 0xA4}, src, dst); byte(count); }
+    void shrd_imm(int dst, int src, uint8_t count) { op_reg({0x0F, 0xAC}, src, dst); byte(count); }
+    void add_imm(int dst, int32_t imm) { op_reg({0x81}, 0, dst); u32(imm); }
+    void sub_imm(int dst, int32_t imm) { op_reg({0x81}, 5, dst); u32(imm); }
+    void mov_imm64(int dst, uint64_t imm) {
+        byte(0x48 | ((dst & 8) ? 1 : 0));
+        byte(0xB8 + (dst & 7));
+        u64(imm);
+    }
+    void mov_imm32(int dst, uint32_t imm) {
+        if (dst & 8) byte(0x41);
+        byte(0xB8 + (dst & 7));
+        u32(imm);
+    }
+    void setcc_al(uint8_t cc) { byte(0x0F); byte(0x90 | cc); byte(0xC0); }
+    void movzx_eax_al() { byte(0x0F); byte(0xB6); byte(0xC0); }
+    void test_al() { byte(0x84); byte(0xC0); }
+    void push(int r) { if (r & 8) byte(0x41); byte(0x50 + (r & 7)); }
+    void pop(int r) { if (r & 8) byte(0x41); byte(0x58 + (r & 7)); }
+    void call_rax() { byte(0xFF); byte(0xD0); }
+    void ret() { byte(0xC3); }
+
+    // rel32 분기. 반환값은 나중에 채울 변위의 위치입니다.
+    size_t jmp() { byte(0xE9); u32(0); return size() - 4; }
+    size_t jcc(uint8_t cc) { byte(0x0F); byte(0x80 | cc); u32(0); return size() - 4; }
+};
+
+// 한 함수 영역을 네이티브 코드로 옮기는 작업 단위
+class region_compiler {
+public:
+    region_compiler(const decoded_program& program) : program(program) {}
+
+    // entry에서 도달 가능한 명령어를 모읍니다. call 다음 명령어도 진입점이 됩니다.
+    bool collect(uint32_t entry) {
+        std::vector<uint32_t> work = {entry};
+        entries.push_back(entry);
+        targets.insert(entry);
+        while (!work.empty()) {
+            uint32_t index = work.back();
+            work.pop_back();
+            if (region.count(index)) continue;
+            if (region.size() >= MAX_REGION_SIZE) return false;
+            region[index] = 0;
+
+            const instruction& insn = program.code[index];
+            if (!supported(insn.opcode)) {
+                if (insn.opcode == OP_CALL) {
+                    entries.push_back(index + 1);
+                    targets.insert(index + 1);
+                    work.push_back(index + 1);
+                }
+                continue;
+            }
+            if (is_branch_opcode(insn.opcode)) {
+                work.push_back(insn.target);
+                if (targets.insert(insn.target).second) {
+                    // 연료가 떨어져 나간 루프로 인터프리터가 다시 들어올 수 있게 합니다.
+                    entries.push_back(insn.target);
+                }
+            }
+            if (insn.opcode != OP_JMP) {
+                work.push_back(index + 1);
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint32_t> entries;
+
+    // 진입점마다 프롤로그를 두고, 영역의 명령어를 인덱스 순서로 내보냅니다.
+    void emit_all(std::vector<size_t>& entry_offsets) {
+        for (uint32_t entry : entries) {
+            entry_offsets.push_back(e.size());
+            e.push(RBX); e.push(R12); e.push(R13); e.push(R14); e.push(R15);
+            e.mov(STATE, RDI);
+            e.load(SP, STATE, offsetof(jit_state, sp));
+            e.load(BASE, STATE, offsetof(jit_state, base));
+            e.load(LIMIT, STATE, offsetof(jit_state, limit));
+            e.load(MACHINE, STATE, offsetof(jit_state, machine));
+            jump_to(e.jmp(), entry);
+        }
+
+        uint32_t previous = UINT32_MAX;
+        for (auto& item : region) {
+            uint32_t index = item.first;
+            if (previous != UINT32_MAX && index != previous + 1 && falls_through(previous)) {
+                jump_to(e.jmp(), previous + 1);
+            }
+            item.second = e.size();
+            if (targets.count(index) || index != previous + 1) {
+                // 다른 곳에서 들어올 수 있는 지점에서는 스택 깊이를 알 수 없습니다.
+                min_depth = 0;
+                headroom = 0;
+            }
+            emit(index);
+            track_stack_effect(program.code[index].opcode);
+            previous = index;
+        }
+        if (previous != UINT32_MAX && falls_through(previous)) {
+            jump_to(e.jmp(), previous + 1);
+        }
+
+        // 인터프리터로 돌아가는 출구. eax에 재개할 명령어 인덱스를 담습니다.
+        for (auto& exit : exits) {
+            exit.second = e.size();
+            e.mov_imm32(RAX, exit.first);
+            jump_fixups.push_back({e.jmp(), SIZE_MAX});
+        }
+        size_t epilogue = e.size();
+        e.store(STATE, offsetof(jit_state, sp), SP);
+        e.pop(R15); e.pop(R14); e.pop(R13); e.pop(R12); e.pop(RBX);
+        e.ret();
+
+        for (auto& fixup : jump_fixups) {
+            size_t target = fixup.second == SIZE_MAX ? epilogue : fixup.second;
+            e.patch32(fixup.first, static_cast<int32_t>(target - (fixup.first + 4)));
+        }
+        for (auto& fixup : label_fixups) {
+            auto it = region.find(fixup.second);
+            size_t target = (it != region.end()) ? it->second : exits.at(fixup.second);
+            e.patch32(fixup.first, static_cast<int32_t>(target - (fixup.first + 4)));
+        }
+        for (auto& fixup : exit_fixups) {
+            e.patch32(fixup.first, static_cast<int32_t>(exits.at(fixup.second) - (fixup.first + 4)));
+        }
+    }
+
+    const std::vector<uint8_t>& code() const { return e.code; }
+
+private:
+    const decoded_program& program;
+    emitter e;
+    std::map<uint32_t, size_t> region;          // 명령어 인덱스 -> 네이티브 오프셋
+    std::map<uint32_t, size_t> exits;           // 재개 인덱스 -> 출구 오프셋
+    std::set<uint32_t> targets;                 // 분기 대상과 진입점
+
+    // 기본 블록 안에서 이미 검사한 스택 깊이의 하한과 남은 공간의 하한.
+    // 이 범위 안의 접근은 검사를 다시 내보내지 않습니다.
+    int min_depth = 0;
+    int headroom = 0;
+    std::vector<std::pair<size_t, uint32_t>> label_fixups;
+    std::vector<std::pair<size_t, uint32_t>> exit_fixups;
+    std::vector<std::pair<size_t, size_t>> jump_fixups;
+
+    static bool supported(uint8_t opcode) {
+        switch (opcode) {
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+            case OP_POP: case OP_DUP:
+            case OP_JMP: case OP_JZ: case OP_JNZ:
+            case OP_EQ: case OP_LT: case OP_GT:
+            case OP_GLOAD: case OP_GSTORE: case OP_LLOAD: case OP_LSTORE:
+            case OP_PUSHD8: case OP_PUSHD16: case OP_PUSHD32: case OP_PUSHD64: case OP_PUSHD128:
+            case OP_ADDI: case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JGE: case OP_JGT: case OP_JLE:
+            case OP_JZK: case OP_JNZK: case OP_GLOADI: case OP_GSTOREI:
+            case OP_SHLI: case OP_SHRI:
+            case OP_GCOPY: case OP_GFILL: case OP_GCMP:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool falls_through(uint32_t index) const {
+        uint8_t opcode = program.code[index].opcode;
+        return supported(opcode) && opcode != OP_JMP;
+    }
+
+    // 영역 안의 명령어로, 없으면 그 인덱스의 출구로 분기합니다.
+    void jump_to(size_t fixup, uint32_t index) {
+        if (!region.count(index)) {
+            exits.emplace(index, 0);
+        }
+        label_fixups.push_back({fixup, index});
+    }
+
+    void exit_to(size_t fixup, uint32_t index) {
+        exits.emplace(index, 0);
+        exit_fixups.push_back({fixup, index});
+    }
+
+    // 깊이가 n 미만이면 이 명령어에서 인터프리터로 나가 오류를 보고하게 합니다.
+    void need(uint32_t index, int n) {
+        if (min_depth >= n) return;
+        e.lea(RAX, BASE, n * SLOT);
+        e.cmp(SP, RAX);
+        exit_to(e.jcc(CC_B), index);
+        min_depth = n;
+    }
+
+    void room(uint32_t index) {
+        if (headroom >= 1) return;
+        e.cmp(SP, LIMIT);
+        exit_to(e.jcc(CC_AE), index);
+        headroom = 1;
+    }
+
+    void track_stack_effect(uint8_t opcode) {
+        int pops = 0, pushes = 0;
+        switch (opcode) {
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+            case OP_EQ: case OP_LT: case OP_GT:
+                pops = 2; pushes = 1; break;
+            case OP_JEQ: case OP_JNE: case OP_JLT: case OP_JGE: case OP_JGT: case OP_JLE:
+                pops = 2; break;
+            case OP_POP: case OP_JZ: case OP_JNZ: case OP_GSTOREI:
+                pops = 1; break;
+            case OP_DUP:
+                pops = 1; pushes = 2; break;
+            case OP_GLOAD: case OP_LLOAD: case OP_ADDI: case OP_JZK: case OP_JNZK:
+            case OP_SHLI: case OP_SHRI:
+                pops = 1; pushes = 1; break;
+            case OP_GSTORE: case OP_LSTORE:
+                pops = 2; break;
+            case OP_GCOPY: case OP_GFILL:
+                pops = 3; break;
+            case OP_GCMP:
+                pops = 3; pushes = 1; break;
+            case OP_PUSHD8: case OP_PUSHD16: case OP_PUSHD32: case OP_PUSHD64: case OP_PUSHD128:
+            case OP_GLOADI:
+                pushes = 1; break;
+            default:
+                break;
+        }
+        min_depth = std::max(0, min_depth - pops) + pushes;
+        headroom = std::max(0, headroom + pops - pushes);
+    }
+
+    // 분기 전에 이 블록의 연료를 냅니다. 모자라면 분기를 실행하지 않고 인터프리터로 나가며,
+    // 인터프리터가 분기를 실행하면서 같은 블록을 청구하고 시간 조각을 끝냅니다.
+    void charge(uint32_t index) {
+        const instruction& insn = program.code[index];
+        e.cmp_mem_imm32(STATE, offsetof(jit_state, fuel), insn.block_length);
+        exit_to(e.jcc(CC_L), index);
+        e.sub_mem_imm32(STATE, offsetof(jit_state, fuel), insn.block_length);
+    }
+
+    void call_helper(void* fn) {
+        e.mov_imm64(RAX, reinterpret_cast<uint64_t>(fn));
+        e.call_rax();
+    }
+
+    void push_constant(uint32_t index, __uint128_t value, D_TYPE type) {
+        room(index);
+        e.add_imm(SP, SLOT);
+        store_u64(LO, static_cast<uint64_t>(value));
+        store_u64(HI, static_cast<uint64_t>(value >> 64));
+        e.store_tag_imm(SP, TAG, type);
+    }
+
+    void store_u64(int32_t disp, uint64_t value) {
+        if (value <= 0x7FFFFFFF) {
+            e.store_imm32(SP, disp, static_cast<int32_t>(value));
+        } else {
+            e.mov_imm64(RAX, value);
+            e.store(SP, disp, RAX);
+        }
+    }
+
+    // eq/lt/gt의 결과(al)를 BIT_8 값으로 a 자리에 씁니다.
+    void store_flag_result() {
+        e.movzx_eax_al();
+        e.sub_imm(SP, SLOT);
+        e.store(SP, LO, RAX);
+        e.store_imm32(SP, HI, 0);
+        e.store_tag_imm(SP, TAG, D_TYPE::BIT_8);
+    }
+
+    // 최상위 값의 128비트 시프트. 128 이상이면 0이 됩니다.
+    void emit_shift(bool left, uint16_t count) {
+        if (count == 0) return;
+        if (count >= 128) {
+            e.store_imm32(SP, LO, 0);
+            e.store_imm32(SP, HI, 0);
+            return;
+        }
+        if (count >= 64) {
+            e.load(RAX, SP, left ? LO : HI);
+            if (left) e.shl_imm(RAX, count - 64); else e.shr_imm(RAX, count - 64);
+            e.store(SP, left ? HI : LO, RAX);
+            e.store_imm32(SP, left ? LO : HI, 0);
+            return;
+        }
+        e.load(RAX, SP, LO);
+        e.load(RDX, SP, HI);
+        if (left) {
+            e.shld_imm(RDX, RAX, count);
+            e.shl_imm(RAX, count);
+        } else {
+            e.shrd_imm(RAX, RDX, count);
+            e.shr_imm(RDX, count);
+        }
+        e.store(SP, LO, RAX);
+        e.store(SP, HI, RDX);
+    }
+
+    void emit(uint32_t index) {
+        const instruction& insn = program.code[index];
+        switch (insn.opcode) {
+            case OP_ADD:
+            case OP_SUB:
+                need(index, 2);
+                e.load(RAX, SP, LO);
+                e.load(RDX, SP, HI);
+                e.sub_imm(SP, SLOT);
+                if (insn.opcode == OP_ADD) {
+                    e.add_to_mem(SP, LO, RAX);
+                    e.adc_to_mem(SP, HI, RDX);
+                } else {
+                    e.sub_from_mem(SP, LO, RAX);
+                    e.sbb_from_mem(SP, HI, RDX);
+                }
+                break;
+            case OP_MUL:
+                // (a_hi:a_lo * b_hi:b_lo)의 하위 128비트
+                need(index, 2);
+                e.load(RCX, SP, LO - SLOT);   // a_lo
+                e.load(RSI, SP, LO);          // b_lo
+                e.load(RAX, SP, HI - SLOT);   // a_hi
+                e.imul(RAX, RSI);             // a_hi * b_lo
+                e.load(RDI, SP, HI);          // b_hi
+                e.imul(RDI, RCX);             // a_lo * b_hi
+                e.add(RDI, RAX);
+                e.mov(RAX, RCX);
+                e.mul(RSI);                   // rdx:rax = a_lo * b_lo
+                e.add(RDX, RDI);
+                e.sub_imm(SP, SLOT);
+                e.store(SP, LO, RAX);
+                e.store(SP, HI, RDX);
+                break;
+            case OP_DIV:
+                need(index, 2);
+                e.load(RAX, SP, LO);
+                e.or_mem(RAX, SP, HI);
+                exit_to(e.jcc(CC_E), index); // 0으로 나누기는 인터프리터가 보고합니다.
+                e.mov(RDI, SP);
+                call_helper(reinterpret_cast<void*>(&helper_div));
+                e.sub_imm(SP, SLOT);
+                break;
+            case OP_POP:
+                need(index, 1);
+                e.sub_imm(SP, SLOT);
+                break;
+            case OP_DUP:
+                need(index, 1);
+                room(index);
+                e.load(RAX, SP, LO);
+                e.load(RDX, SP, HI);
+                e.load_tag(RCX, SP, TAG);
+                e.add_imm(SP, SLOT);
+                e.store(SP, LO, RAX);
+                e.store(SP, HI, RDX);
+                e.store_tag(SP, TAG, RCX);
+                break;
+            case OP_JMP:
+                charge(index);
+                jump_to(e.jmp(), insn.target);
+                break;
+            case OP_JZ:
+            case OP_JNZ:
+                need(index, 1);
+                charge(index);
+                e.load(RAX, SP, LO);
+                e.or_mem(RAX, SP, HI);
+                e.lea(SP, SP, -SLOT);
+                jump_to(e.jcc(insn.opcode == OP_JZ ? CC_E : CC_NE), insn.target);
+                break;
+            case OP_EQ:
+                need(index, 2);
+                e.load(RAX, SP, LO - SLOT);
+                e.load(RDX, SP, HI - SLOT);
+                e.xor_mem(RAX, SP, LO);
+                e.xor_mem(RDX, SP, HI);
+                e.or_(RAX, RDX);
+                e.setcc_al(CC_E);
+                store_flag_result();
+                break;
+            case OP_LT:
+                // a < b: a - b에서 빌림이 생기면 참
+                need(index, 2);
+                e.load(RAX, SP, LO - SLOT);
+                e.load(RDX, SP, HI - SLOT);
+                e.cmp_mem(RAX, SP, LO);
+                e.sbb_mem(RDX, SP, HI);
+                e.setcc_al(CC_B);
+                store_flag_result();
+                break;
+            case OP_GT:
+                need(index, 2);
+                e.load(RAX, SP, LO);
+                e.load(RDX, SP, HI);
+                e.cmp_mem(RAX, SP, LO - SLOT);
+                e.sbb_mem(RDX, SP, HI - SLOT);
+                e.setcc_al(CC_B);
+                store_flag_result();
+                break;
+            case OP_GLOAD:
+                need(index, 1);
+                e.mov(RDI, MACHINE);
+                e.mov(RSI, SP);
+                call_helper(reinterpret_cast<void*>(&helper_gload));
+                e.test_al();
+                exit_to(e.jcc(CC_E), index);
+                break;
+            case OP_GSTORE:
+                need(index, 2);
+                e.mov(RDI, MACHINE);
+                e.mov(RSI, SP);
+                call_helper(reinterpret_cast<void*>(&helper_gstore));
+                e.test_al();
+                exit_to(e.jcc(CC_E), index);
+                e.sub_imm(SP, 2 * SLOT);
+                break;
+            case OP_LLOAD:
+                need(index, 1);
+                e.mov(RDI, MACHINE);
+                e.mov(RSI, SP);
+                e.mov_imm32(RDX, insn.operand);
+                call_helper(reinterpret_cast<void*>(&helper_lload));
+                e.test_al();
+                exit_to(e.jcc(CC_E), index);
+                break;
+            case OP_LSTORE:
+                need(index, 2);
+                e.mov(RDI, MACHINE);
+                e.mov(RSI, SP);
+                e.mov_imm32(RDX, insn.operand);
+                call_helper(reinterpret_cast<void*>(&helper_lstore));
+                e.test_al();
+                exit_to(e.jcc(CC_E), index);
+                e.sub_imm(SP, 2 * SLOT);
+                break;
+            case OP_PUSHD8:
+                push_constant(index, insn.imm, D_TYPE::BIT_8);
+                break;
+            case OP_PUSHD16:
+                push_constant(index, insn.imm, D_TYPE::BIT_16);
+                break;
+            case OP_PUSHD32:
+                push_constant(index, insn.imm, D_TYPE::BIT_32);
+                break;
+            case OP_PUSHD64:
+                push_constant(index, insn.imm, D_TYPE::BIT_64);
+                break;
+            case OP_PUSHD128:
+                push_constant(index, program.wide_immediates[insn.imm], D_TYPE::BIT_128);
+                break;
+            case OP_ADDI:
+                need(index, 1);
+                e.mov_imm32(RAX, static_cast<uint32_t>(insn.imm));
+                e.mov_imm32(RDX, 0);
+                e.add_to_mem(SP, LO, RAX);
+                e.adc_to_mem(SP, HI, RDX);
+                break;
+            case OP_JEQ:
+            case OP_JNE:
+                need(index, 2);
+                charge(index);
+                e.load(RAX, SP, LO - SLOT);
+                e.load(RDX, SP, HI - SLOT);
+                e.xor_mem(RAX, SP, LO);
+                e.xor_mem(RDX, SP, HI);
+                e.or_(RAX, RDX);
+                e.lea(SP, SP, -2 * SLOT); // lea는 플래그를 바꾸지 않습니다.
+                jump_to(e.jcc(insn.opcode == OP_JEQ ? CC_E : CC_NE), insn.target);
+                break;
+            case OP_JLT:
+            case OP_JGE:
+                // a - b에서 빌림이 생기면 a < b
+                need(index, 2);
+                charge(index);
+                e.load(RAX, SP, LO - SLOT);
+                e.load(RDX, SP, HI - SLOT);
+                e.cmp_mem(RAX, SP, LO);
+                e.sbb_mem(RDX, SP, HI);
+                e.lea(SP, SP, -2 * SLOT);
+                jump_to(e.jcc(insn.opcode == OP_JLT ? CC_B : CC_AE), insn.target);
+                break;
+            case OP_JGT:
+            case OP_JLE:
+                need(index, 2);
+                charge(index);
+                e.load(RAX, SP, LO);
+                e.load(RDX, SP, HI);
+                e.cmp_mem(RAX, SP, LO - SLOT);
+                e.sbb_mem(RDX, SP, HI - SLOT);
+                e.lea(SP, SP, -2 * SLOT);
+                jump_to(e.jcc(insn.opcode == OP_JGT ? CC_B : CC_AE), insn.target);
+                break;
+            case OP_JZK:
+            case OP_JNZK:
+                need(index, 1);
+                charge(index);
+                e.load(RAX, SP, LO);
+                e.or_mem(RAX, SP, HI);
+                jump_to(e.jcc(insn.opcode == OP_JZK ? CC_E : CC_NE), insn.target);
+                break;
+            case OP_GCOPY:
+            case OP_GFILL:
+            case OP_GCMP: {
+                need(index, 3);
+                e.mov(RDI, MACHINE);
+                e.mov(RSI, SP);
+                void* helper = insn.opcode == OP_GCOPY ? reinterpret_cast<void*>(&helper_gcopy)
+                             : insn.opcode == OP_GFILL ? reinterpret_cast<void*>(&helper_gfill)
+                                                       : reinterpret_cast<void*>(&helper_gcmp);
+                call_helper(helper);
+                e.test_al();
+                exit_to(e.jcc(CC_E), index);
+                e.sub_imm(SP, (insn.opcode == OP_GCMP ? 2 : 3) * SLOT);
+                break;
+            }
+            case OP_SHLI:
+            case OP_SHRI:
+                need(index, 1);
+                emit_shift(insn.opcode == OP_SHLI, insn.operand);
+                break;
+            case OP_GLOADI:
+                // 주소를 상수로 넣은 뒤 gload와 같은 경로를 탑니다.
+                push_constant(index, insn.imm, D_TYPE::BIT_16);
+                e.mov(RDI, MACHINE);
+                e.mov(RSI, SP);
+                call_helper(reinterpret_cast<void*>(&helper_gload));
+                e.test_al();
+                exit_to(e.jcc(CC_E), index);
+                break;
+            case OP_GSTOREI:
+                need(index, 1);
+                push_constant(index, insn.imm, D_TYPE::BIT_16);
+                e.mov(RDI, MACHINE);
+                e.mov(RSI, SP);
+                call_helper(reinterpret_cast<void*>(&helper_gstore));
+                e.sub_imm(SP, 2 * SLOT);
+                break;
+            default:
+                // 지원하지 않는 명령어는 인터프리터가 실행합니다.
+                exit_to(e.jmp(), index);
+                break;
+        }
+    }
+};
+
+} // namespace
+
+void jit_compiler::compile(uint32_t function_index) {
+    attempted[function_index] = true;
+
+    region_compiler compiler(program);
+    if (!compiler.collect(function_index)) {
+        return;
+    }
+    std::vector<size_t> offsets;
+    compiler.emit_all(offsets);
+
+    const std::vector<uint8_t>& code = compiler.code();
+    size_t length = (code.size() + 4095) & ~size_t(4095);
+    void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        std::cerr << "JIT: could not allocate executable memory" << std::endl;
+        return;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0) {
+        std::cerr << "JIT: could not make code executable" << std::endl;
+        munmap(memory, length);
+        return;
+    }
+    regions.push_back({memory, length});
+
+    for (size_t i = 0; i < compiler.entries.size(); i++) {
+        uint32_t index = compiler.entries[i];
+        if (entries[index] == nullptr) {
+            entries[index] = reinterpret_cast<jit_function>(static_cast<uint8_t*>(memory) + offsets[i]);
+            attempted[index] = true;
+        }
+    }
+}
+
+#endif // DIRTVM_JIT_SUPPORTED
@@ -0,0 +1,62 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "object.h"
+#include "decode.h"
+
+// 베이스라인 JIT은 Linux x86-64에서만 코드를 생성합니다.
+// 다른 플랫폼에서는 컴파일 요청이 무시되어 항상 인터프리터로 실행됩니다.
+#if defined(__x86_64__) && defined(__linux__)
+#define DIRTVM_JIT_SUPPORTED 1
+#endif
+
+class vm;
+
+// 네이티브 코드와 인터프리터가 주고받는 상태입니다.
+// 네이티브 코드에 들어가기 전에 TOS 캐시는 스택 버퍼에 기록되어 있어야 합니다.
+struct jit_state {
+    stack_data* sp;     // 최상위 원소의 주소 (&base[depth])
+    stack_data* base;   // 보호 슬롯 (&base[0])
+    stack_data* limit;  // 용량이 꽉 찼을 때의 sp
+    vm* machine;
+    int64_t fuel;       // 남은 시간 조각. 분기마다 기본 블록 길이만큼 줄입니다.
+};
+
+// 네이티브 코드는 처리할 수 없는 명령어(call, ret, syscall, 오류가 날 수 있는 연산 등)를
+// 만나면 그 명령어의 인덱스를 반환하고, 인터프리터가 그 명령어부터 이어서 실행합니다.
+// 분기의 블록 길이만큼 fuel이 남지 않았을 때도 그 분기에서 나옵니다.
+typedef uint32_t (*jit_function)(jit_state*);
+
+class jit_compiler {
+public:
+    jit_compiler(const decoded_program& program, uint32_t threshold);
+    ~jit_compiler();
+
+    // 이미 컴파일된 진입점 (함수 시작, call 다음 명령어, 영역 안의 분기 대상)
+    jit_function entry(uint32_t index) const { return entries[index]; }
+
+    // call 대상(및 프로그램 시작점)에 도달할 때마다 호출합니다. 호출 횟수가
+    // 임계값을 넘으면 그 함수를 컴파일하고 진입점을 반환합니다.
+    jit_function on_call(uint32_t index) {
+        if (entries[index] == nullptr && ++hotness[index] > threshold && !attempted[index]) {
+            compile(index);
+        }
+        return entries[index];
+    }
+
+private:
+    const decoded_program& program;
+    uint32_t threshold;
+    std::vector<jit_function> entries;
+    std::vector<uint32_t> hotness;
+    std::vector<bool> attempted;
+    std::vector<std::pair<void*, size_t>> regions; // munmap할 실행 메모리
+
+    void compile(uint32_t function_index);
+};
+
+#endif // JIT_H
@@ -0,0 +1,228 @@
+#include "module_file.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+size_t align8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+bool section_in_file(const module_section& section, size_t file_size) {
+    return section.offset % 8 == 0 && section.offset <= file_size && section.size <= file_size - section.offset;
+}
+
+bool check_data(const uint8_t* data, size_t size, std::string& error) {
+    size_t offset = 0;
+    while (offset < size) {
+        if (size - offset < sizeof(data_record)) {
+            error = "truncated data record";
+            return false;
+        }
+        data_record record;
+        std::memcpy(&record, data + offset, sizeof(record));
+        size_t width = data_width(record.d_type);
+        if (width == 0) {
+            error = "invalid data type in data record";
+            return false;
+        }
+        size_t bytes = size_t(record.count) * width;
+        if (bytes > size - offset - sizeof(data_record)) {
+            error = "data record extends past the data section";
+            return false;
+        }
+        if (record.count != 0 && record.address + (record.count - 1) < record.address) {
+            error = "data record wraps around the address space";
+            return false;
+        }
+        offset += align8(sizeof(data_record) + bytes);
+    }
+    return true;
+}
+
+void put(std::vector<uint8_t>& out, const void* bytes, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(bytes);
+    out.insert(out.end(), p, p + size);
+}
+
+void pad8(std::vector<uint8_t>& out) {
+    out.resize(align8(out.size()), 0);
+}
+
+} // namespace
+
+bool parse_module(const uint8_t* bytes, size_t size, module_view& out, std::string& error) {
+    out = module_view();
+    if (size < sizeof(module_header) || std::memcmp(bytes, MODULE_MAGIC, sizeof(MODULE_MAGIC)) != 0) {
+        // 예전 로더와 같이 끝에 남는 홀수 바이트는 무시합니다.
+        out.legacy = true;
+        out.code = reinterpret_cast<const uint16_t*>(bytes);
+        out.code_size = size / 2;
+        return true;
+    }
+
+    module_header header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (header.version != MODULE_VERSION) {
+        error = "unsupported module version " + std::to_string(header.version);
+        return false;
+    }
+    if (!section_in_file(header.code, size) || !section_in_file(header.data, size) ||
+        !section_in_file(header.symbols, size)) {
+        error = "module section out of range";
+        return false;
+    }
+    if (header.code.size % 2 != 0) {
+        error = "code section is not a whole number of words";
+        return false;
+    }
+    if (header.symbols.size / sizeof(symbol_entry) < header.symbol_count) {
+        error = "symbol table out of range";
+        return false;
+    }
+
+    out.code = reinterpret_cast<const uint16_t*>(bytes + header.code.offset);
+    out.code_size = header.code.size / 2;
+    out.data = bytes + header.data.offset;
+    out.data_size = header.data.size;
+    out.symbols = reinterpret_cast<const symbol_entry*>(bytes + header.symbols.offset);
+    out.symbol_count = header.symbol_count;
+    out.names = reinterpret_cast<const char*>(out.symbols + out.symbol_count);
+    out.names_size = header.symbols.size - out.symbol_count * sizeof(symbol_entry);
+
+    for (size_t i = 0; i < out.symbol_count; i++) {
+        const symbol_entry& entry = out.symbols[i];
+        if (entry.name_offset > out.names_size || entry.name_size > out.names_size - entry.name_offset) {
+            error = "symbol name out of range";
+            return false;
+        }
+    }
+    return check_data(out.data, out.data_size, error);
+}
+
+std::vector<module_symbol> module_view::symbol_table() const {
+    std::vector<module_symbol> table;
+    table.reserve(symbol_count);
+    for (size_t i = 0; i < symbol_count; i++) {
+        table.push_back({std::string(names + symbols[i].name_offset, symbols[i].name_size), symbols[i].address});
+    }
+    return table;
+}
+
+std::vector<uint8_t> build_module(const std::vector<uint16_t>& code,
+                                  const std::vector<module_data>& data,
+                                  const std::vector<module_symbol>& symbols) {
+    std::vector<uint8_t> out(sizeof(module_header), 0);
+    module_header header = {};
+    std::memcpy(header.magic, MODULE_MAGIC, sizeof(MODULE_MAGIC));
+    header.version = MODULE_VERSION;
+
+    header.code.offset = out.size();
+    put(out, code.data(), code.size() * sizeof(uint16_t));
+    header.code.size = out.size() - header.code.offset;
+    pad8(out);
+
+    header.data.offset = out.size();
+    for (const module_data& block : data) {
+        size_t width = data_width(block.d_type);
+        data_record record = {};
+        record.address = block.address;
+        record.count = static_cast<uint32_t>(block.values.size());
+        record.d_type = block.d_type;
+        put(out, &record, sizeof(record));
+        for (__uint128_t value : block.values) {
+            put(out, &value, width); // 리틀 엔디언이므로 하위 바이트부터 잘라 씁니다.
+        }
+        pad8(out);
+    }
+    header.data.size = out.size() - header.data.offset;
+
+    header.symbols.offset = out.size();
+    header.symbol_count = static_cast<uint32_t>(symbols.size());
+    uint32_t name_offset = 0;
+    for (const module_symbol& symbol : symbols) {
+        symbol_entry entry = {symbol.address, name_offset, static_cast<uint32_t>(symbol.name.size())};
+        put(out, &entry, sizeof(entry));
+        name_offset += entry.name_size;
+    }
+    for (const module_symbol& symbol : symbols) {
+        put(out, symbol.name.data(), symbol.name.size());
+    }
+    header.symbols.size = out.size() - header.symbols.offset;
+    pad8(out);
+
+    std::memcpy(out.data(), &header, sizeof(header));
+    return out;
+}
+
+mapped_module::mapped_module(mapped_module&& other) noexcept
+    : mapping(other.mapping), mapping_size(other.mapping_size), module(other.module) {
+    other.mapping = nullptr;
+    other.mapping_size = 0;
+    other.module = module_view();
+}
+
+mapped_module& mapped_module::operator=(mapped_module&& other) noexcept {
+    if (this != &other) {
+        release();
+        mapping = other.mapping;
+        mapping_size = other.mapping_size;
+        module = other.module;
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+        other.module = module_view();
+    }
+    return *this;
+}
+
+mapped_module::~mapped_module() {
+    release();
+}
+
+void mapped_module::release() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+    module = module_view();
+}
+
+bool mapped_module::open(const std::string& path, std::string& error) {
+    release();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "could not open " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        error = "could not stat " + path;
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        // 빈 파일은 mmap할 수 없으므로 빈 예전 형식 프로그램으로 취급합니다.
+        close(fd);
+        module.legacy = true;
+        return true;
+    }
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        error = "could not map " + path;
+        return false;
+    }
+    mapping = p;
+    mapping_size = size;
+    if (!parse_module(static_cast<const uint8_t*>(p), size, module, error)) {
+        release();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,139 @@
+#ifndef MODULE_FILE_H
+#define MODULE_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "object.h"
+
+// dirtvm 모듈 파일 형식 (리틀 엔디언, 모든 섹션은 8바이트 정렬)
+//
+//   module_header            72 bytes
+//   code section             uint16_t 워드 배열
+//   data section             data_record 헤더 + 값 배열의 연속, 레코드마다 8바이트 정렬
+//   symbol section           symbol_entry 배열 + 이름 문자열
+//
+// 파일을 mmap한 뒤 섹션을 그대로 가리키므로 코드를 복사하지 않고 실행합니다.
+// 헤더가 없는 예전 바이트코드 파일은 파일 전체를 코드 섹션으로 취급합니다.
+
+static const char MODULE_MAGIC[4] = {'D', 'I', 'R', 'T'};
+static const uint32_t MODULE_VERSION = 1;
+
+struct module_section {
+    uint64_t offset;  // 파일 시작부터의 바이트 위치
+    uint64_t size;    // 바이트 수
+};
+
+struct module_header {
+    char magic[4];
+    uint32_t version;
+    module_section code;
+    module_section data;
+    module_section symbols;
+    uint32_t symbol_count;
+    uint32_t reserved[3];
+};
+
+static_assert(sizeof(module_header) == 72, "module_header layout");
+
+// 전역 메모리 address부터 count개의 셀을 d_type 폭의 값으로 초기화합니다.
+// 값은 폭만큼의 바이트(1, 2, 4, 8, 16)로 헤더 바로 뒤에 놓입니다.
+struct data_record {
+    uint64_t address;
+    uint32_t count;
+    uint8_t d_type;
+    uint8_t reserved[3];
+};
+
+static_assert(sizeof(data_record) == 16, "data_record layout");
+
+// 이름은 심볼 섹션 안의 문자열 영역(엔트리 배열 바로 뒤)을 가리킵니다.
+struct symbol_entry {
+    uint64_t address;      // 코드 섹션의 워드 주소
+    uint32_t name_offset;  // 문자열 영역에서의 위치
+    uint32_t name_size;
+};
+
+static_assert(sizeof(symbol_entry) == 16, "symbol_entry layout");
+
+struct module_symbol {
+    std::string name;
+    uint64_t address;
+};
+
+// 초기화 데이터 한 덩어리. values의 원소는 d_type 폭으로 잘려 저장됩니다.
+struct module_data {
+    uint64_t address;
+    D_TYPE d_type;
+    std::vector<__uint128_t> values;
+};
+
+// 검증된 모듈의 섹션들을 가리킵니다. 원본 바이트가 살아 있는 동안만 유효합니다.
+struct module_view {
+    bool legacy = false;             // 헤더 없는 예전 바이트코드
+    const uint16_t* code = nullptr;
+    size_t code_size = 0;            // 워드 수
+    const uint8_t* data = nullptr;
+    size_t data_size = 0;            // 바이트 수
+    const symbol_entry* symbols = nullptr;
+    size_t symbol_count = 0;
+    const char* names = nullptr;
+    size_t names_size = 0;
+
+    // 데이터 섹션의 레코드를 차례로 넘깁니다. values는 레코드 헤더 바로 뒤를 가리킵니다.
+    template <typename F>
+    void for_each_data(F&& f) const;
+
+    std::vector<module_symbol> symbol_table() const;
+};
+
+// 바이트 배열을 모듈로 해석합니다. 매직이 없으면 예전 형식으로 받아들이고,
+// 헤더가 있는데 섹션이 파일 범위를 벗어나거나 정렬이 맞지 않으면 false와 오류 메시지를 반환합니다.
+bool parse_module(const uint8_t* bytes, size_t size, module_view& out, std::string& error);
+
+// 모듈 파일을 만듭니다.
+std::vector<uint8_t> build_module(const std::vector<uint16_t>& code,
+                                  const std::vector<module_data>& data = {},
+                                  const std::vector<module_symbol>& symbols = {});
+
+// 값 하나가 데이터 섹션에서 차지하는 바이트 수
+inline size_t data_width(uint8_t d_type) {
+    return d_type <= BIT_128 ? size_t(1) << d_type : 0;
+}
+
+// 파일을 읽기 전용으로 mmap하고 모듈로 해석합니다. 이동만 가능합니다.
+class mapped_module {
+public:
+    mapped_module() {}
+    mapped_module(mapped_module&& other) noexcept;
+    mapped_module& operator=(mapped_module&& other) noexcept;
+    mapped_module(const mapped_module&) = delete;
+    mapped_module& operator=(const mapped_module&) = delete;
+    ~mapped_module();
+
+    bool open(const std::string& path, std::string& error);
+    const module_view& view() const { return module; }
+
+private:
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    module_view module;
+
+    void release();
+};
+
+template <typename F>
+void module_view::for_each_data(F&& f) const {
+    size_t offset = 0;
+    while (offset < data_size) {
+        const data_record* record = reinterpret_cast<const data_record*>(data + offset);
+        const uint8_t* values = data + offset + sizeof(data_record);
+        f(*record, values);
+        size_t bytes = sizeof(data_record) + size_t(record->count) * data_width(record->d_type);
+        offset += (bytes + 7) & ~size_t(7);
+    }
+}
+
+#endif // MODULE_FILE_H
@@ -1,13 +1,308 @@
 #include "object.h"
 
-stack_data::stack_data(D_TYPE type, __uint128_t val) : d_type(type), data(val) {}
+#include <algorithm>
+#include <cstring>
 
-stack_data::~stack_data() {}
+// 새로 생기는 셀은 BIT_8 0입니다.
+void cell_array::resize(size_t size) {
+    lo.resize(size, 0);
+    tags.resize(size, D_TYPE::BIT_8);
+    if (!hi.empty()) {
+        hi.resize(size, 0);
+    }
+}
+
+void cell_array::clear(size_t begin, size_t count) {
+    std::memset(&lo[begin], 0, count * sizeof(uint64_t));
+    std::memset(&tags[begin], D_TYPE::BIT_8, count);
+    if (!hi.empty()) {
+        std::memset(&hi[begin], 0, count * sizeof(uint64_t));
+    }
+}
+
+void cell_array::move(size_t dst, size_t src, size_t count) {
+    std::memmove(&lo[dst], &lo[src], count * sizeof(uint64_t));
+    std::memmove(&tags[dst], &tags[src], count);
+    if (!hi.empty()) {
+        std::memmove(&hi[dst], &hi[src], count * sizeof(uint64_t));
+    }
+}
+
+void cell_array::store_high(size_t index, uint64_t high) {
+    if (hi.empty()) {
+        hi.resize(lo.size(), 0);
+    }
+    hi[index] = high;
+}
+
+stack_data paged_memory::load_slow(uint64_t address) const {
+    uint64_t number = address >> PAGE_BITS;
+    if (number != last_number) {
+        auto it = pages.find(number);
+        last_number = number;
+        last_entry = it != pages.end() ? const_cast<page_entry*>(&it->second) : nullptr;
+        last_page = last_entry ? last_entry->cells : nullptr;
+        last_hi = last_entry ? last_entry->hi : nullptr;
+    }
+    if (last_page == nullptr) {
+        return stack_data(D_TYPE::BIT_8, 0);
+    }
+    size_t offset = address & (PAGE_SIZE - 1);
+    __uint128_t value = last_page->lo[offset];
+    if (last_hi) {
+        value |= (__uint128_t)last_hi[offset] << 64;
+    }
+    return stack_data(static_cast<D_TYPE>(last_page->tags[offset]), value);
+}
+
+void paged_memory::store_slow(uint64_t address, stack_data cell) {
+    uint64_t number = address >> PAGE_BITS;
+    page_entry& entry = (number == last_number && last_entry != nullptr) ? *last_entry : allocate(number);
+    size_t offset = address & (PAGE_SIZE - 1);
+    __uint128_t value = cell.get_data();
+    entry.cells->lo[offset] = static_cast<uint64_t>(value);
+    entry.cells->tags[offset] = cell.get_d_type();
+    uint64_t high = static_cast<uint64_t>(value >> 64);
+    if (high != 0 || entry.hi) {
+        wide(entry)[offset] = high;
+    }
+}
+
+paged_memory::page_entry& paged_memory::allocate(uint64_t number) {
+    page_entry& entry = pages[number];
+    if (!entry.cells) {
+        // 값 초기화로 lo와 tags(BIT_8)를 0으로 채웁니다.
+        entry.owned_cells.reset(new page());
+        entry.cells = entry.owned_cells.get();
+    }
+    last_number = number;
+    last_entry = &entry;
+    last_page = entry.cells;
+    last_hi = entry.hi;
+    return entry;
+}
+
+// 상위 64비트 배열을 돌려줍니다. 없으면 0으로 채워 할당합니다.
+uint64_t* paged_memory::wide(page_entry& entry) {
+    if (!entry.hi) {
+        entry.owned_hi.reset(new uint64_t[PAGE_SIZE]());
+        entry.hi = entry.owned_hi.get();
+        if (last_entry == &entry) {
+            last_hi = entry.hi;
+        }
+    }
+    return entry.hi;
+}
+
+const paged_memory::page_entry* paged_memory::find(uint64_t number) const {
+    auto it = pages.find(number);
+    return it != pages.end() ? &it->second : nullptr;
+}
+
+// 한 페이지 안에 머무는 조각 단위로 나눠, 조각마다 memmove/memset을 씁니다.
+// 뒤쪽으로 겹치는 복사는 높은 주소의 조각부터 처리합니다.
+void paged_memory::copy(uint64_t dst, uint64_t src, uint64_t count) {
+    if (count == 0 || dst == src) {
+        return;
+    }
+    bool backward = dst > src && dst - src < count;
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t remaining = count - done;
+        uint64_t d, s, n;
+        if (!backward) {
+            d = dst + done;
+            s = src + done;
+            n = std::min<uint64_t>({remaining, PAGE_SIZE - (d & (PAGE_SIZE - 1)), PAGE_SIZE - (s & (PAGE_SIZE - 1))});
+        } else {
+            uint64_t d_end = dst + remaining;
+            uint64_t s_end = src + remaining;
+            n = std::min<uint64_t>({remaining, ((d_end - 1) & (PAGE_SIZE - 1)) + 1, ((s_end - 1) & (PAGE_SIZE - 1)) + 1});
+            d = d_end - n;
+            s = s_end - n;
+        }
+        done += n;
+
+        const page_entry* from = find(s >> PAGE_BITS);
+        page_entry* to = nullptr;
+        if (from == nullptr) {
+            // 빈 페이지에서 빈 페이지로의 복사는 할 일이 없습니다.
+            auto it = pages.find(d >> PAGE_BITS);
+            if (it == pages.end()) {
+                continue;
+            }
+            to = &it->second;
+        } else {
+            to = &allocate(d >> PAGE_BITS);
+        }
+        size_t d_off = d & (PAGE_SIZE - 1);
+        size_t s_off = s & (PAGE_SIZE - 1);
+        if (from == nullptr) {
+            std::memset(&to->cells->lo[d_off], 0, n * sizeof(uint64_t));
+            std::memset(&to->cells->tags[d_off], D_TYPE::BIT_8, n);
+            if (to->hi) {
+                std::memset(&to->hi[d_off], 0, n * sizeof(uint64_t));
+            }
+            continue;
+        }
+        std::memmove(&to->cells->lo[d_off], &from->cells->lo[s_off], n * sizeof(uint64_t));
+        std::memmove(&to->cells->tags[d_off], &from->cells->tags[s_off], n);
+        if (from->hi) {
+            std::memmove(&wide(*to)[d_off], &from->hi[s_off], n * sizeof(uint64_t));
+        } else if (to->hi) {
+            std::memset(&to->hi[d_off], 0, n * sizeof(uint64_t));
+        }
+    }
+}
+
+void paged_memory::read_bytes(uint64_t address, uint64_t count, uint8_t* out) const {
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t a = address + done;
+        size_t offset = a & (PAGE_SIZE - 1);
+        uint64_t n = std::min<uint64_t>(count - done, PAGE_SIZE - offset);
+        const page_entry* from = find(a >> PAGE_BITS);
+        if (from == nullptr) {
+            std::memset(out + done, 0, n);
+        } else {
+            const uint64_t* lo = &from->cells->lo[offset];
+            for (uint64_t i = 0; i < n; i++) {
+                out[done + i] = static_cast<uint8_t>(lo[i]);
+            }
+        }
+        done += n;
+    }
+}
+
+void paged_memory::write(uint64_t dst, D_TYPE d_type, const uint8_t* values, uint64_t count) {
+    size_t width = size_t(1) << d_type;
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t d = dst + done;
+        size_t offset = d & (PAGE_SIZE - 1);
+        uint64_t n = std::min<uint64_t>(count - done, PAGE_SIZE - offset);
+        const uint8_t* from = values + done * width;
+        done += n;
+
+        page_entry& to = allocate(d >> PAGE_BITS);
+        std::memset(&to.cells->tags[offset], d_type, n);
+        if (width == 1) {
+            for (uint64_t i = 0; i < n; i++) {
+                to.cells->lo[offset + i] = from[i];
+            }
+        } else if (width <= 8) {
+            for (uint64_t i = 0; i < n; i++) {
+                uint64_t value = 0;
+                std::memcpy(&value, from + i * width, width);
+                to.cells->lo[offset + i] = value;
+            }
+        } else {
+            uint64_t* hi = wide(to);
+            for (uint64_t i = 0; i < n; i++) {
+                std::memcpy(&to.cells->lo[offset + i], from + i * 16, 8);
+                std::memcpy(&hi[offset + i], from + i * 16 + 8, 8);
+            }
+            continue;
+        }
+        if (to.hi) {
+            std::fill_n(&to.hi[offset], n, 0);
+        }
+    }
+}
+
+void paged_memory::fill(uint64_t dst, uint64_t count, stack_data value) {
+    uint64_t lo = static_cast<uint64_t>(value.get_data());
+    uint64_t high = static_cast<uint64_t>(value.get_data() >> 64);
+    bool zero = lo == 0 && high == 0 && value.get_d_type() == D_TYPE::BIT_8;
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t d = dst + done;
+        size_t offset = d & (PAGE_SIZE - 1);
+        uint64_t n = std::min<uint64_t>(count - done, PAGE_SIZE - offset);
+        done += n;
+
+        page_entry* to;
+        if (zero) {
+            // 0으로 채우기는 없는 페이지를 만들지 않습니다.
+            auto it = pages.find(d >> PAGE_BITS);
+            if (it == pages.end()) {
+                continue;
+            }
+            to = &it->second;
+        } else {
+            to = &allocate(d >> PAGE_BITS);
+        }
+        std::fill_n(&to->cells->lo[offset], n, lo);
+        std::memset(&to->cells->tags[offset], value.get_d_type(), n);
+        if (high != 0 || to->hi) {
+            std::fill_n(&wide(*to)[offset], n, high);
+        }
+    }
+}
+
+int paged_memory::compare(uint64_t a, uint64_t b, uint64_t count) const {
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t x = a + done;
+        uint64_t y = b + done;
+        size_t x_off = x & (PAGE_SIZE - 1);
+        size_t y_off = y & (PAGE_SIZE - 1);
+        uint64_t n = std::min<uint64_t>({count - done, PAGE_SIZE - x_off, PAGE_SIZE - y_off});
+        done += n;
+
+        const page_entry* p = find(x >> PAGE_BITS);
+        const page_entry* q = find(y >> PAGE_BITS);
+        if (p == nullptr && q == nullptr) {
+            continue;
+        }
+        for (uint64_t i = 0; i < n; i++) {
+            __uint128_t u = p ? p->cells->lo[x_off + i] : 0;
+            __uint128_t v = q ? q->cells->lo[y_off + i] : 0;
+            if (p && p->hi) u |= (__uint128_t)p->hi[x_off + i] << 64;
+            if (q && q->hi) v |= (__uint128_t)q->hi[y_off + i] << 64;
+            if (u != v) {
+                return u < v ? -1 : 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// 새 세그먼트를 만들거나 세그먼트를 키웁니다. 세그먼트가 아레나 꼭대기에 있으면
+// 제자리에서 늘리고, 아니면 꼭대기로 옮깁니다. 옮기고 남은 자리는 프레임을 떠날 때 회수됩니다.
+bool local_arena::store_slow(uint16_t tag, __uint128_t address, stack_data value, size_t limit) {
+    if (address >= limit) {
+        return false;
+    }
+    size_t index = static_cast<size_t>(address);
+    segment* s = find(tag);
+    if (s == nullptr) {
+        segments.push_back({tag, top, 0, 0});
+        s = &segments.back();
+    }
+
+    size_t capacity = std::min(std::max({index + 1, s->capacity * 2, size_t(8)}), limit);
+    if (s->offset + s->capacity == top) {
+        reserve(s->offset + capacity);
+        cells.clear(s->offset + s->capacity, capacity - s->capacity);
+    } else {
+        reserve(top + capacity);
+        cells.move(top, s->offset, s->size);
+        cells.clear(top + s->size, capacity - s->size);
+        s->offset = top;
+    }
+    s->capacity = capacity;
+    top = s->offset + capacity;
 
-D_TYPE stack_data::get_d_type() const {
-    return d_type;
+    if (index >= s->size) {
+        s->size = index + 1;
+    }
+    cells.store(s->offset + index, value);
+    return true;
 }
 
-__uint128_t stack_data::get_data() const {
-    return data;
+void local_arena::reserve(size_t size) {
+    if (cells.size() < size) {
+        cells.resize(std::max(size, cells.size() * 2));
+    }
 }
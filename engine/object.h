@@ -1,7 +1,13 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
-enum D_TYPE {
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+enum D_TYPE : uint8_t {
     BIT_8,
     BIT_16,
     BIT_32,
@@ -9,17 +15,227 @@ enum D_TYPE {
     BIT_128,
 };
 
-class stack_data {
+// 값과 폭 태그를 8바이트 정렬로 묶어 24바이트에 담습니다.
+// (__uint128_t의 16바이트 정렬을 그대로 따르면 32바이트가 됩니다.)
+// 레이아웃: data 하위 64비트 @0, 상위 64비트 @8, d_type @16
+class __attribute__((packed, aligned(8))) stack_data {
 private:
-    D_TYPE d_type;
     __uint128_t data;
-    
+    D_TYPE d_type;
+
+public:
+    stack_data() {}
+    stack_data(D_TYPE d_type, __uint128_t data) : data(data), d_type(d_type) {}
+
+    D_TYPE get_d_type() const { return d_type; }
+    __uint128_t get_data() const { return data; }
+};
+
+static_assert(sizeof(stack_data) == 24, "stack_data layout changed");
+
+// 메모리 셀 배열. 태그와 값을 분리된 배열에 저장하며, 상위 64비트 배열은
+// 64비트를 넘는 값이 처음 저장될 때 할당됩니다. 셀당 9바이트(넓은 값이 있으면 17바이트)입니다.
+class cell_array {
+private:
+    friend struct snapshot_codec;
+
+    std::vector<uint64_t> lo;
+    std::vector<uint8_t> tags;
+    std::vector<uint64_t> hi;
+
+public:
+    size_t size() const { return lo.size(); }
+    void resize(size_t size);
+    // [begin, begin + count)를 BIT_8 0으로 되돌립니다.
+    void clear(size_t begin, size_t count);
+    // 겹쳐도 안전한 범위 복사
+    void move(size_t dst, size_t src, size_t count);
+
+    stack_data load(size_t index) const {
+        __uint128_t value = lo[index];
+        if (!hi.empty()) {
+            value |= (__uint128_t)hi[index] << 64;
+        }
+        return stack_data(static_cast<D_TYPE>(tags[index]), value);
+    }
+
+    void store(size_t index, stack_data cell) {
+        __uint128_t value = cell.get_data();
+        lo[index] = static_cast<uint64_t>(value);
+        tags[index] = cell.get_d_type();
+        uint64_t high = static_cast<uint64_t>(value >> 64);
+        if (high != 0 || !hi.empty()) {
+            store_high(index, high);
+        }
+    }
+
+private:
+    void store_high(size_t index, uint64_t high);
+};
+
+// 희소 전역 메모리. 주소 공간을 고정 크기 페이지로 나누고 페이지는 처음 저장될 때 할당합니다.
+// 한 번도 저장되지 않은 셀은 BIT_8 0으로 읽히며 메모리를 차지하지 않습니다.
+// 페이지 테이블은 해시 맵이고, 마지막으로 접근한 페이지를 캐시해 연속 접근은 맵을 거치지 않습니다.
+class paged_memory {
+public:
+    static const unsigned PAGE_BITS = 12;
+    static const size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+    // 마지막 페이지에 대한 접근만 인라인으로 처리하고 나머지는 함수 호출로 넘깁니다.
+    // (인터프리터 루프에 인라인되는 코드를 작게 유지해야 레지스터 배치가 유지됩니다.)
+    stack_data load(uint64_t address) const {
+        if ((address >> PAGE_BITS) == last_number && last_page != nullptr) {
+            size_t offset = address & (PAGE_SIZE - 1);
+            __uint128_t value = last_page->lo[offset];
+            if (last_hi) {
+                value |= (__uint128_t)last_hi[offset] << 64;
+            }
+            return stack_data(static_cast<D_TYPE>(last_page->tags[offset]), value);
+        }
+        return load_slow(address);
+    }
+
+    void store(uint64_t address, stack_data cell) {
+        __uint128_t value = cell.get_data();
+        if ((address >> PAGE_BITS) == last_number && last_page != nullptr &&
+            !last_hi && (value >> 64) == 0) {
+            size_t offset = address & (PAGE_SIZE - 1);
+            last_page->lo[offset] = static_cast<uint64_t>(value);
+            last_page->tags[offset] = cell.get_d_type();
+            return;
+        }
+        store_slow(address, cell);
+    }
+
+    // 대량 연산. 범위 검사는 호출하는 쪽에서 한 번 합니다.
+    // copy는 겹치는 범위에서도 memmove처럼 동작합니다.
+    void copy(uint64_t dst, uint64_t src, uint64_t count);
+    void fill(uint64_t dst, uint64_t count, stack_data value);
+    // 값(data)만 비교합니다. 같으면 0, a가 작으면 -1, 크면 1.
+    int compare(uint64_t a, uint64_t b, uint64_t count) const;
+    // [address, address + count) 셀의 하위 8비트를 out에 모읍니다. (SYS_write의 바이트 뷰)
+    void read_bytes(uint64_t address, uint64_t count, uint8_t* out) const;
+    // 폭이 (1 << d_type) 바이트인 리틀 엔디언 값 count개를 dst부터 채웁니다. (모듈 데이터 섹션 적재)
+    void write(uint64_t dst, D_TYPE d_type, const uint8_t* values, uint64_t count);
+
+    size_t page_count() const { return pages.size(); }
+
+private:
+    friend struct snapshot_codec;
+
+    // 페이지 본체는 포인터가 없는 고정 크기 블록이라 스냅샷 파일에 그대로 쓰고
+    // 복원할 때 파일 매핑을 그대로 가리킬 수 있습니다.
+    struct page {
+        uint64_t lo[PAGE_SIZE];
+        uint8_t tags[PAGE_SIZE];
+    };
+
+    // 상위 64비트 배열은 64비트를 넘는 값이 처음 저장될 때 할당합니다.
+    // 스냅샷에서 복원한 페이지는 owned_*가 비어 있고 cells/hi가 매핑을 가리킵니다.
+    struct page_entry {
+        page* cells = nullptr;
+        uint64_t* hi = nullptr;
+        std::unique_ptr<page> owned_cells;
+        std::unique_ptr<uint64_t[]> owned_hi;
+    };
+
+    std::unordered_map<uint64_t, page_entry> pages;
+    mutable uint64_t last_number = UINT64_MAX;
+    mutable page* last_page = nullptr;
+    mutable uint64_t* last_hi = nullptr;
+    mutable page_entry* last_entry = nullptr;
+    std::shared_ptr<void> backing;  // 매핑된 페이지가 가리키는 스냅샷 매핑
+
+    const page_entry* find(uint64_t number) const;
+    stack_data load_slow(uint64_t address) const;
+    void store_slow(uint64_t address, stack_data cell);
+    page_entry& allocate(uint64_t number);
+    uint64_t* wide(page_entry& entry);
+};
+
+// 프레임 단위 지역 메모리. 모든 지역 셀은 하나의 아레나에서 bump 방식으로 할당됩니다.
+// 프레임은 태그마다 아레나의 연속 구간(세그먼트)을 하나씩 가지며, 태그는 현재 프레임의
+// 세그먼트에서만 찾습니다. 프레임을 떠날 때는 세그먼트 목록과 아레나 꼭대기를 들어가기
+// 전 위치로 되돌리므로 해제는 O(1)이고, 아레나는 최대 사용량 이상으로 자라지 않습니다.
+class local_arena {
 public:
-    stack_data(D_TYPE d_type, __uint128_t data);
-    ~stack_data();
+    // 세그먼트 하나의 기본 최대 셀 수. store()의 limit 이상인 지역 주소에 저장하면 오류입니다.
+    static const size_t DEFAULT_SEGMENT_LIMIT = size_t(1) << 24;
+
+    struct frame_mark {
+        uint32_t segment_base;   // 이전 프레임의 첫 세그먼트
+        uint32_t segment_top;    // 이 프레임이 시작될 때의 세그먼트 수
+        size_t cell_top;         // 이 프레임이 시작될 때의 아레나 꼭대기
+    };
+
+    // 새 프레임을 시작하고, leave()에 넘길 표식을 반환합니다.
+    frame_mark enter() {
+        frame_mark mark{frame_base, static_cast<uint32_t>(segments.size()), top};
+        frame_base = static_cast<uint32_t>(segments.size());
+        return mark;
+    }
+
+    void leave(const frame_mark& mark) {
+        segments.resize(mark.segment_top);
+        top = mark.cell_top;
+        frame_base = mark.segment_base;
+    }
+
+    // 현재 프레임에서 저장된 적 없는 태그나 가장 큰 저장 주소를 넘는 읽기는 false입니다.
+    bool load(uint16_t tag, __uint128_t address, stack_data& out) const {
+        const segment* s = find(tag);
+        if (s == nullptr || address >= s->size) {
+            return false;
+        }
+        out = cells.load(s->offset + static_cast<size_t>(address));
+        return true;
+    }
+
+    bool store(uint16_t tag, __uint128_t address, stack_data value, size_t limit = DEFAULT_SEGMENT_LIMIT) {
+        segment* s = find(tag);
+        if (s != nullptr && address < s->capacity) {
+            size_t index = static_cast<size_t>(address);
+            if (index >= s->size) {
+                s->size = index + 1;
+            }
+            cells.store(s->offset + index, value);
+            return true;
+        }
+        return store_slow(tag, address, value, limit);
+    }
+
+    size_t cell_footprint() const { return cells.size(); }
+
+private:
+    friend struct snapshot_codec;
+
+    struct segment {
+        uint16_t tag;
+        size_t offset;    // 아레나에서의 시작 위치
+        size_t size;      // 가장 큰 저장 주소 + 1
+        size_t capacity;  // 확보한 셀 수
+    };
+
+    cell_array cells;
+    std::vector<segment> segments;
+    uint32_t frame_base = 0;
+    size_t top = 0;
+
+    const segment* find(uint16_t tag) const {
+        for (size_t i = segments.size(); i-- > frame_base;) {
+            if (segments[i].tag == tag) {
+                return &segments[i];
+            }
+        }
+        return nullptr;
+    }
+
+    segment* find(uint16_t tag) {
+        return const_cast<segment*>(static_cast<const local_arena*>(this)->find(tag));
+    }
 
-    D_TYPE get_d_type() const;
-    __uint128_t get_data() const;
+    bool store_slow(uint16_t tag, __uint128_t address, stack_data value, size_t limit);
+    void reserve(size_t size);
 };
 
 #endif // OBJECT_H
@@ -0,0 +1,71 @@
+#ifndef OPCODE_H
+#define OPCODE_H
+
+#include <cstdint>
+
+// 6-bit opcodes as laid out in SPEC.md.
+enum OPCODE : uint8_t {
+    OP_HALT     = 0b000000,
+    OP_ADD      = 0b000001,
+    OP_SUB      = 0b000010,
+    OP_MUL      = 0b000011,
+    OP_DIV      = 0b000100,
+    OP_POP      = 0b000110,
+    OP_DUP      = 0b000111,
+    OP_JMP      = 0b001000,
+    OP_JZ       = 0b001001,
+    OP_JNZ      = 0b001010,
+    OP_CALL     = 0b001011,
+    OP_RET      = 0b001100,
+    OP_EQ       = 0b001101,
+    OP_LT       = 0b001110,
+    OP_GT       = 0b001111,
+    OP_GLOAD    = 0b010000,
+    OP_GSTORE   = 0b010001,
+    OP_LLOAD    = 0b010010,
+    OP_LSTORE   = 0b010011,
+    OP_PUSHD8   = 0b010100,
+    OP_PUSHD16  = 0b010101,
+    OP_PUSHD32  = 0b010110,
+    OP_PUSHD64  = 0b010111,
+    OP_PUSHD128 = 0b011000,
+    OP_SYSCALL  = 0b011001,
+
+    // 어셈블러의 -O1 피프홀 최적화가 만드는 슈퍼 명령어
+    OP_ADDI     = 0b011010, // pushd16 N; add
+    OP_JEQ      = 0b011011, // eq; jnz L
+    OP_JNE      = 0b011100, // eq; jz L
+    OP_JLT      = 0b011101, // lt; jnz L
+    OP_JGE      = 0b011110, // lt; jz L
+    OP_JGT      = 0b011111, // gt; jnz L
+    OP_JLE      = 0b100000, // gt; jz L
+    OP_JZK      = 0b100001, // dup; jz L
+    OP_JNZK     = 0b100010, // dup; jnz L
+    OP_GLOADI   = 0b100011, // pushd16 A; gload
+    OP_GSTOREI  = 0b100100, // pushd16 A; gstore
+
+    // 최적화기의 강도 감소가 만드는 명령어. 10-bit 피연산자가 시프트 양입니다.
+    OP_SHLI     = 0b100101, // pushd 2^k; mul
+    OP_SHRI     = 0b100110, // pushd 2^k; div
+
+    // 전역 메모리 대량 연산
+    OP_GCOPY    = 0b100111,
+    OP_GFILL    = 0b101000,
+    OP_GCMP     = 0b101001,
+
+    // 그린 스레드 (파이버)
+    OP_SPAWN    = 0b101010, // 128비트 주소가 뒤따릅니다.
+    OP_YIELD    = 0b101011,
+    OP_JOIN     = 0b101100,
+
+    // 바이트코드에는 없고 디코딩된 프로그램에만 놓이는 명령어 (6비트 범위 밖)
+    OP_BREAK    = 0b1000000, // 중단점. run()이 BREAKPOINT를 반환합니다.
+};
+
+// 128비트 분기 주소가 뒤따르는 명령어인지 확인합니다.
+inline bool is_branch_opcode(uint8_t opcode) {
+    return opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNZ || opcode == OP_CALL ||
+           (opcode >= OP_JEQ && opcode <= OP_JNZK) || opcode == OP_SPAWN;
+}
+
+#endif // OPCODE_H
@@ -0,0 +1,135 @@
+#include "output.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+output_buffer::channel& output_buffer::get(int fd) {
+    for (channel& ch : channels) {
+        if (ch.fd == fd) {
+            return ch;
+        }
+    }
+    flush_policy policy = fd == STDERR_FILENO ? flush_policy::UNBUFFERED
+                        : isatty(fd) ? flush_policy::LINE : flush_policy::FULL;
+    channels.push_back({fd, policy, {}, 0});
+    return channels.back();
+}
+
+void output_buffer::set_policy(int fd, flush_policy policy) {
+    channel& ch = get(fd);
+    if (policy == flush_policy::UNBUFFERED) {
+        flush(ch);
+    }
+    ch.policy = policy;
+}
+
+long output_buffer::write(int fd, const paged_memory& memory, uint64_t address, uint64_t count) {
+    channel& ch = get(fd);
+    bool ok = true;
+
+    if (ch.policy == flush_policy::UNBUFFERED || count > capacity - ch.used) {
+        // 버퍼를 거치지 않고 씁니다. 쌓인 내용이 있으면 첫 조각과 함께 writev 한 번으로 보내고,
+        // 아주 큰 write는 scratch가 한없이 커지지 않도록 나눠서 씁니다.
+        if (ch.policy == flush_policy::UNBUFFERED) {
+            ok = flush_all();
+        }
+        const uint64_t chunk = std::max<uint64_t>(capacity, SCRATCH_CHUNK);
+        uint64_t done = 0;
+        while (done < count) {
+            uint64_t n = std::min(chunk, count - done);
+            scratch.resize(n);
+            memory.read_bytes(address + done, n, scratch.data());
+            ok = write_all(fd, ch.data.data(), ch.used, scratch.data(), n) && ok;
+            ch.used = 0;
+            done += n;
+        }
+        return ok ? static_cast<long>(count) : -1;
+    }
+
+    if (ch.data.empty()) {
+        ch.data.resize(capacity);
+    }
+    uint8_t* tail = ch.data.data() + ch.used;
+    memory.read_bytes(address, count, tail);
+    ch.used += count;
+
+    if (ch.used == capacity ||
+        (ch.policy == flush_policy::LINE && std::memchr(tail, '\n', count) != nullptr)) {
+        ok = flush(ch);
+    }
+    return ok ? static_cast<long>(count) : -1;
+}
+
+long output_buffer::write_direct(int fd, const paged_memory& memory, uint64_t address, uint64_t count) {
+    size_t size = static_cast<size_t>(std::min(count, SCRATCH_CHUNK));
+    scratch.resize(size);
+    memory.read_bytes(address, size, scratch.data());
+    for (;;) {
+        syscalls++;
+        ssize_t n = ::write(fd, scratch.data(), size);
+        if (n >= 0 || errno != EINTR) {
+            return n < 0 ? -1 : static_cast<long>(n);
+        }
+    }
+}
+
+bool output_buffer::flush(int fd) {
+    return flush(get(fd));
+}
+
+bool output_buffer::flush(channel& ch) {
+    if (ch.used == 0) {
+        return true;
+    }
+    bool ok = write_all(ch.fd, ch.data.data(), ch.used, nullptr, 0);
+    ch.used = 0;
+    return ok;
+}
+
+bool output_buffer::flush_all() {
+    bool ok = true;
+    for (channel& ch : channels) {
+        ok = flush(ch) && ok;
+    }
+    return ok;
+}
+
+// 부분 쓰기와 EINTR을 처리하며 두 구간을 모두 씁니다.
+bool output_buffer::write_all(int fd, const uint8_t* first, size_t first_size,
+                              const uint8_t* second, size_t second_size) {
+    iovec parts[2] = {
+        {const_cast<uint8_t*>(first), first_size},
+        {const_cast<uint8_t*>(second), second_size},
+    };
+    iovec* part = parts;
+    int remaining = 2;
+    while (remaining > 0 && part->iov_len == 0) {
+        part++;
+        remaining--;
+    }
+    while (remaining > 0) {
+        syscalls++;
+        ssize_t written = remaining == 1 ? ::write(fd, part->iov_base, part->iov_len)
+                                         : ::writev(fd, part, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t left = static_cast<size_t>(written);
+        while (remaining > 0 && left >= part->iov_len) {
+            left -= part->iov_len;
+            part++;
+            remaining--;
+        }
+        if (remaining > 0) {
+            part->iov_base = static_cast<uint8_t*>(part->iov_base) + left;
+            part->iov_len -= left;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "object.h"
+
+// fd마다 버퍼를 비우는 시점
+enum class flush_policy : uint8_t {
+    LINE,        // 줄바꿈이 들어오거나 버퍼가 차면
+    FULL,        // 버퍼가 차면
+    UNBUFFERED,  // 매번 바로 씁니다. 다른 fd에 쌓인 출력을 먼저 비워 순서를 지킵니다.
+};
+
+// VM마다 하나씩 가지는 SYS_write 출력 버퍼. 작은 write를 fd별로 모아 한 번의 시스템 콜로 보냅니다.
+// 전역 메모리의 셀에서 하위 바이트를 버퍼로 바로 모으며, 버퍼에 들어가지 않는 큰 write는
+// 쌓인 내용과 함께 writev 한 번으로 내보냅니다.
+class output_buffer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    explicit output_buffer(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity ? capacity : 1) {}
+    ~output_buffer() { flush_all(); }
+
+    // 정하지 않은 fd는 처음 쓸 때 정합니다. stderr는 UNBUFFERED, 터미널은 LINE, 나머지는 FULL입니다.
+    void set_policy(int fd, flush_policy policy);
+
+    // memory[address, address + count)의 하위 바이트를 fd로 씁니다. 범위 검사는 호출하는 쪽에서 합니다.
+    // 받아들인 바이트 수를 반환하며, 이번 호출에서 일어난 쓰기가 실패하면 -1을 반환합니다.
+    long write(int fd, const paged_memory& memory, uint64_t address, uint64_t count);
+
+    // 버퍼를 거치지 않고 write(2) 한 번으로 씁니다. 쓴 바이트 수나 -1(errno 유지)을 반환합니다.
+    long write_direct(int fd, const paged_memory& memory, uint64_t address, uint64_t count);
+
+    bool flush(int fd);
+    bool flush_all();
+
+    // 지금까지 실제로 호출한 write/writev 횟수
+    size_t syscall_count() const { return syscalls; }
+
+private:
+    struct channel {
+        int fd;
+        flush_policy policy;
+        std::vector<uint8_t> data;  // capacity 크기로 한 번 할당합니다.
+        size_t used;
+    };
+
+    static constexpr uint64_t SCRATCH_CHUNK = 1 << 20;
+
+    size_t capacity;
+    std::vector<channel> channels;  // 쓰는 fd는 보통 몇 개뿐이므로 선형 탐색합니다.
+    std::vector<uint8_t> scratch;   // 버퍼보다 큰 write를 모으는 곳
+    size_t syscalls = 0;
+
+    channel& get(int fd);
+    bool flush(channel& ch);
+    bool write_all(int fd, const uint8_t* first, size_t first_size, const uint8_t* second, size_t second_size);
+};
+
+#endif // OUTPUT_H
@@ -0,0 +1,140 @@
+#include "profile.h"
+#include "disassemble.h"
+#include "opcode.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <string>
+
+namespace {
+
+std::string function_name(const std::map<uint64_t, std::string>& labels, uint64_t start) {
+    auto it = labels.find(start);
+    if (it != labels.end()) {
+        return it->second;
+    }
+    return start == 0 ? "main" : "fn_" + std::to_string(start);
+}
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+} // namespace
+
+vm_profiler::vm_profiler(uint32_t interval) : mean_interval(std::max<uint32_t>(interval, 2)) {}
+
+void vm_profiler::bind(const decoded_program& program) {
+    function_starts.assign(1, 0);
+    for (const instruction& insn : program.code) {
+        if (insn.opcode == OP_CALL || insn.opcode == OP_SPAWN) {
+            function_starts.push_back(program.addresses[insn.target]);
+        }
+    }
+    std::sort(function_starts.begin(), function_starts.end());
+    function_starts.erase(std::unique(function_starts.begin(), function_starts.end()), function_starts.end());
+}
+
+uint64_t vm_profiler::next_interval() {
+    // xorshift64
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return mean_interval / 2 + rng_state % mean_interval;
+}
+
+uint64_t vm_profiler::function_of(uint64_t address) const {
+    auto it = std::upper_bound(function_starts.begin(), function_starts.end(), address);
+    return it == function_starts.begin() ? 0 : *(it - 1);
+}
+
+void vm_profiler::sample(const decoded_program& program, size_t last, size_t next,
+                         const std::vector<call_frame>& frames) {
+    sample_count++;
+    const instruction& branch = program.code[last];
+    size_t first = last + 1 - std::min<size_t>(std::max<uint8_t>(branch.block_length, 1), last + 1);
+    uint64_t block = program.addresses[first];
+    block_count& count = blocks.emplace(block, block_count{program.addresses[last], 0}).first->second;
+    count.samples++;
+
+    // 프레임의 돌아갈 곳(call 명령어)이 속한 함수가 호출한 쪽입니다. 방금 call했다면 마지막 프레임의
+    // 함수가 곧 블록의 함수이고, ret했다면 블록은 이미 사라진 프레임의 함수에 있습니다.
+    scratch.clear();
+    for (const call_frame& frame : frames) {
+        scratch.push_back(function_of(program.addresses[frame.return_index - 1]));
+    }
+    if (branch.opcode == OP_RET) {
+        scratch.push_back(function_of(program.addresses[next]));
+    }
+    if (branch.opcode != OP_CALL || scratch.empty()) {
+        scratch.push_back(function_of(block));
+    }
+    stacks[scratch]++;
+}
+
+void vm_profiler::write_report(std::ostream& out, const std::vector<module_symbol>& symbols, size_t limit) const {
+    std::map<uint64_t, std::string> labels = address_labels(symbols);
+    out << "# dirtvm profile: " << sample_count << " samples, one per ~" << mean_interval << " instructions\n\n";
+
+    std::vector<std::pair<uint64_t, block_count>> hot(blocks.begin(), blocks.end());
+    std::sort(hot.begin(), hot.end(), [](const std::pair<uint64_t, block_count>& a, const std::pair<uint64_t, block_count>& b) {
+        return a.second.samples != b.second.samples ? a.second.samples > b.second.samples : a.first < b.first;
+    });
+    out << "# basic blocks\n";
+    out << std::setw(10) << "samples" << std::setw(9) << "percent" << "  " << std::left << std::setw(16) << "address"
+        << "location" << std::right << "\n";
+    for (size_t i = 0; i < hot.size() && i < limit; i++) {
+        uint64_t start = hot[i].first;
+        uint64_t function = function_of(start);
+        std::string location = function_name(labels, function);
+        auto label = labels.find(start);
+        if (label != labels.end() && start != function) {
+            location += " (" + label->second + ")";
+        } else if (start != function) {
+            location += "+" + std::to_string(start - function);
+        }
+        std::string range = std::to_string(start) + "-" + std::to_string(hot[i].second.end);
+        out << std::setw(10) << hot[i].second.samples << std::setw(8) << std::fixed << std::setprecision(2)
+            << percent(hot[i].second.samples, sample_count) << "%  " << std::left << std::setw(16) << range
+            << location << std::right << "\n";
+    }
+
+    // self는 스택의 맨 안쪽, total은 스택 어디든 (재귀는 한 번만) 나타난 표본 수입니다.
+    std::map<uint64_t, std::pair<uint64_t, uint64_t>> functions;
+    std::set<uint64_t> seen;
+    for (const auto& entry : stacks) {
+        functions[entry.first.back()].first += entry.second;
+        seen.clear();
+        for (uint64_t function : entry.first) {
+            if (seen.insert(function).second) {
+                functions[function].second += entry.second;
+            }
+        }
+    }
+    std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t>>> flat(functions.begin(), functions.end());
+    std::sort(flat.begin(), flat.end(), [](const std::pair<uint64_t, std::pair<uint64_t, uint64_t>>& a,
+                                           const std::pair<uint64_t, std::pair<uint64_t, uint64_t>>& b) {
+        return a.second.first != b.second.first ? a.second.first > b.second.first : a.first < b.first;
+    });
+    out << "\n# functions\n";
+    out << std::setw(10) << "self" << std::setw(9) << "percent" << std::setw(10) << "total" << std::setw(9)
+        << "percent" << "  function\n";
+    for (const auto& entry : flat) {
+        out << std::setw(10) << entry.second.first << std::setw(8) << std::fixed << std::setprecision(2)
+            << percent(entry.second.first, sample_count) << "%" << std::setw(10) << entry.second.second
+            << std::setw(8) << percent(entry.second.second, sample_count) << "%  "
+            << function_name(labels, entry.first) << " @" << entry.first << "\n";
+    }
+}
+
+void vm_profiler::write_collapsed(std::ostream& out, const std::vector<module_symbol>& symbols) const {
+    std::map<uint64_t, std::string> labels = address_labels(symbols);
+    for (const auto& entry : stacks) {
+        for (size_t i = 0; i < entry.first.size(); i++) {
+            out << (i ? ";" : "") << function_name(labels, entry.first[i]);
+        }
+        out << " " << entry.second << "\n";
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <map>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "decode.h"
+#include "module_file.h"
+
+struct call_frame;
+
+// 명령어 수 기반 표본 추출 프로파일러. vm::set_profiler()로 붙이면 run()이 평균 interval개의
+// 명령어마다 시간 조각 경계에서 방금 실행한 기본 블록과 호출 스택을 하나씩 기록합니다.
+// 경계를 넘긴 블록이 뽑힐 확률은 블록 길이에 비례하므로 표본 수는 실행한 명령어 수의 추정치이고,
+// 간격은 반복문의 주기와 맞물리지 않도록 [interval/2, interval*3/2)에서 무작위로 고릅니다.
+// 함수는 call과 spawn의 대상 주소(와 0번지)에서 시작해 다음 함수 전까지로 봅니다.
+// 한 VM 전용이며 VM보다 오래 살아 있어야 합니다.
+class vm_profiler {
+public:
+    static const uint32_t DEFAULT_INTERVAL = 10007;
+
+    explicit vm_profiler(uint32_t interval = DEFAULT_INTERVAL);
+
+    uint64_t samples() const { return sample_count; }
+    uint32_t interval() const { return mean_interval; }
+
+    // 기본 블록별 표본 수(많은 순서로 limit개)와 함수별 self/total 표본 수.
+    // symbols의 라벨로 함수와 주소에 이름을 붙입니다.
+    void write_report(std::ostream& out, const std::vector<module_symbol>& symbols, size_t limit = 50) const;
+    // flamegraph.pl과 speedscope가 읽는 접힌 스택 형식 ("main;f;g 표본 수")
+    void write_collapsed(std::ostream& out, const std::vector<module_symbol>& symbols) const;
+
+private:
+    friend class vm;
+
+    struct block_count {
+        uint64_t end;       // 블록을 끝낸 분기 명령어의 주소
+        uint64_t samples;
+    };
+
+    uint32_t mean_interval;
+    uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+    uint64_t sample_count = 0;
+    std::vector<uint64_t> function_starts;               // 정렬된 함수 시작 주소
+    std::unordered_map<uint64_t, block_count> blocks;    // 블록 시작 주소 -> 표본
+    std::map<std::vector<uint64_t>, uint64_t> stacks;    // 바깥부터의 함수 시작 주소 -> 표본
+    std::vector<uint64_t> scratch;
+
+    // run()이 부릅니다. bind는 set_profiler에서 한 번, sample은 시간 조각 경계마다 부릅니다.
+    void bind(const decoded_program& program);
+    uint64_t next_interval();
+    // last는 방금 실행한 블록을 끝낸 분기, next는 다음에 실행할 명령어의 인덱스입니다.
+    void sample(const decoded_program& program, size_t last, size_t next, const std::vector<call_frame>& frames);
+
+    uint64_t function_of(uint64_t address) const;
+};
+
+#endif // PROFILE_H
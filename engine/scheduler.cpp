@@ -0,0 +1,123 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+vm_scheduler::vm_scheduler(unsigned count, uint64_t slice) : slice(slice) {
+    if (count == 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < count; i++) {
+        workers.emplace_back(new worker());
+    }
+    for (unsigned i = 0; i < count; i++) {
+        workers[i]->thread = std::thread(&vm_scheduler::run_worker, this, i);
+    }
+}
+
+vm_scheduler::~vm_scheduler() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stopping = true;
+    }
+    idle.notify_all();
+    for (auto& w : workers) {
+        w->thread.join();
+    }
+}
+
+void vm_scheduler::submit(std::unique_ptr<vm> machine, completion done) {
+    {
+        std::lock_guard<std::mutex> guard(done_lock);
+        outstanding++;
+    }
+    std::unique_ptr<job> item(new job{std::move(machine), std::move(done)});
+    push(next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size(), std::move(item));
+}
+
+void vm_scheduler::wait() {
+    std::unique_lock<std::mutex> guard(done_lock);
+    all_done.wait(guard, [this]() { return outstanding == 0; });
+}
+
+vm_scheduler::stats vm_scheduler::statistics() const {
+    return {finished_jobs.load(), slice_count.load(), steal_count.load()};
+}
+
+void vm_scheduler::push(unsigned index, std::unique_ptr<job> item) {
+    {
+        std::lock_guard<std::mutex> guard(workers[index]->lock);
+        workers[index]->queue.push_back(std::move(item));
+    }
+    queued++;
+    // 잠든 작업자가 있을 때만 깨웁니다. 작업자는 sleepers를 올린 뒤 queued를 다시 확인하므로
+    // 둘 중 하나는 반드시 상대의 변경을 봅니다.
+    if (sleepers.load() != 0) {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        idle.notify_one();
+    }
+}
+
+std::unique_ptr<vm_scheduler::job> vm_scheduler::take(unsigned index) {
+    worker& self = *workers[index];
+    {
+        std::lock_guard<std::mutex> guard(self.lock);
+        if (!self.queue.empty()) {
+            std::unique_ptr<job> item = std::move(self.queue.front());
+            self.queue.pop_front();
+            queued--;
+            return item;
+        }
+    }
+    return steal(index);
+}
+
+// 다른 작업자의 대기열 뒤쪽에서 하나를 가져옵니다. 앞쪽은 주인이 꺼내 가는 쪽입니다.
+std::unique_ptr<vm_scheduler::job> vm_scheduler::steal(unsigned thief) {
+    size_t count = workers.size();
+    for (size_t i = 1; i < count; i++) {
+        worker& victim = *workers[(thief + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.queue.empty()) {
+            std::unique_ptr<job> item = std::move(victim.queue.back());
+            victim.queue.pop_back();
+            queued--;
+            steal_count.fetch_add(1, std::memory_order_relaxed);
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+void vm_scheduler::run_worker(unsigned index) {
+    for (;;) {
+        std::unique_ptr<job> item = take(index);
+        if (!item) {
+            std::unique_lock<std::mutex> guard(idle_lock);
+            sleepers++;
+            idle.wait(guard, [this]() { return queued.load() != 0 || stopping.load(); });
+            sleepers--;
+            if (stopping && queued.load() == 0) {
+                return;
+            }
+            continue;
+        }
+
+        vm_status status = item->machine->run(slice);
+        slice_count.fetch_add(1, std::memory_order_relaxed);
+        if (status == vm_status::OUT_OF_FUEL) {
+            push(index, std::move(item));
+            continue;
+        }
+
+        if (item->done) {
+            item->done(*item->machine, status);
+        }
+        item.reset();
+        finished_jobs.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> guard(done_lock);
+        if (--outstanding == 0) {
+            all_done.notify_all();
+        }
+    }
+}
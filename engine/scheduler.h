@@ -0,0 +1,84 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vm.h"
+
+// 여러 VM 인스턴스를 모든 코어에서 실행하는 작업 훔치기 스케줄러.
+// 작업자 스레드마다 실행 대기열을 두고, 자기 대기열이 비면 다른 작업자의 대기열 뒤쪽에서
+// 작업을 훔쳐 옵니다. 각 작업은 run(slice)로 정해진 명령어 수만큼만 실행하고, 연료가
+// 떨어지면 자기 대기열 끝으로 돌아가므로 긴 작업 뒤에 짧은 작업이 오래 묶이지 않습니다.
+class vm_scheduler {
+public:
+    // 작업이 OUT_OF_FUEL 말고 다른 상태로 돌아왔을 때 작업자 스레드에서 불립니다.
+    typedef std::function<void(vm&, vm_status)> completion;
+
+    struct stats {
+        uint64_t jobs;    // 끝난 작업 수
+        uint64_t slices;  // run() 호출 수
+        uint64_t steals;  // 다른 작업자에게서 가져온 작업 수
+    };
+
+    // workers가 0이면 하드웨어 스레드 수만큼 만듭니다. slice는 작업을 한 번 잡았을 때
+    // 실행할 명령어 수이며, vm::UNLIMITED이면 끝날 때까지 실행합니다.
+    explicit vm_scheduler(unsigned workers = 0, uint64_t slice = 100000);
+    ~vm_scheduler();
+    vm_scheduler(const vm_scheduler&) = delete;
+    vm_scheduler& operator=(const vm_scheduler&) = delete;
+
+    // 작업을 넣습니다. 어느 스레드에서 불러도 됩니다.
+    void submit(std::unique_ptr<vm> machine, completion done = completion());
+
+    // 지금까지 넣은 작업이 모두 끝날 때까지 기다립니다.
+    void wait();
+
+    stats statistics() const;
+    unsigned worker_count() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+    struct job {
+        std::unique_ptr<vm> machine;
+        completion done;
+    };
+
+    struct worker {
+        std::mutex lock;
+        std::deque<std::unique_ptr<job>> queue;
+        std::thread thread;
+    };
+
+    uint64_t slice;
+    std::vector<std::unique_ptr<worker>> workers;
+    std::atomic<unsigned> next_worker{0};
+
+    std::atomic<size_t> queued{0};       // 대기열에 있는 작업 수
+    std::atomic<size_t> sleepers{0};     // 일감이 없어 잠든 작업자 수
+    std::atomic<bool> stopping{false};
+    std::mutex idle_lock;
+    std::condition_variable idle;
+
+    std::mutex done_lock;
+    std::condition_variable all_done;
+    size_t outstanding = 0;              // 넣었지만 아직 끝나지 않은 작업 수 (done_lock)
+
+    std::atomic<uint64_t> finished_jobs{0};
+    std::atomic<uint64_t> slice_count{0};
+    std::atomic<uint64_t> steal_count{0};
+
+    void push(unsigned index, std::unique_ptr<job> item);
+    std::unique_ptr<job> take(unsigned index);
+    std::unique_ptr<job> steal(unsigned thief);
+    void run_worker(unsigned index);
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,465 @@
+#include "snapshot.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+size_t align_to(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// 상태 섹션 쓰기. 값은 정렬 없이 이어 붙입니다.
+class state_writer {
+public:
+    std::vector<uint8_t> bytes;
+
+    void raw(const void* p, size_t size) {
+        const uint8_t* from = static_cast<const uint8_t*>(p);
+        bytes.insert(bytes.end(), from, from + size);
+    }
+
+    template <typename T>
+    void put(T value) {
+        raw(&value, sizeof(value));
+    }
+};
+
+// 상태 섹션 읽기. 섹션 끝을 넘는 읽기는 실패합니다.
+class state_reader {
+public:
+    state_reader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    bool raw(void* p, size_t count) {
+        if (count > size - offset) {
+            return false;
+        }
+        std::memcpy(p, data + offset, count);
+        offset += count;
+        return true;
+    }
+
+    template <typename T>
+    bool get(T& value) {
+        return raw(&value, sizeof(value));
+    }
+
+    // count개의 원소가 남아 있는지 확인합니다. 손상된 개수로 큰 메모리를 잡지 않기 위해 씁니다.
+    bool has(uint64_t count, size_t element_size) const {
+        return count <= (size - offset) / element_size;
+    }
+
+    bool done() const { return offset == size; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+};
+
+} // namespace
+
+// object.h와 vm.h의 friend. 상태를 바이트열로 바꾸고 되돌립니다.
+struct snapshot_codec {
+    typedef paged_memory::page page;
+
+    static void put_cells(state_writer& out, const cell_array& cells) {
+        out.put<uint64_t>(cells.lo.size());
+        out.raw(cells.lo.data(), cells.lo.size() * sizeof(uint64_t));
+        out.raw(cells.tags.data(), cells.tags.size());
+        out.put<uint8_t>(!cells.hi.empty());
+        out.raw(cells.hi.data(), cells.hi.size() * sizeof(uint64_t));
+    }
+
+    static bool get_cells(state_reader& in, cell_array& cells) {
+        uint64_t count;
+        uint8_t has_hi;
+        if (!in.get(count) || !in.has(count, sizeof(uint64_t) + 1)) {
+            return false;
+        }
+        cells.lo.resize(count);
+        cells.tags.resize(count);
+        if (!in.raw(cells.lo.data(), count * sizeof(uint64_t)) || !in.raw(cells.tags.data(), count) ||
+            !in.get(has_hi)) {
+            return false;
+        }
+        cells.hi.clear();
+        if (has_hi) {
+            if (!in.has(count, sizeof(uint64_t))) {
+                return false;
+            }
+            cells.hi.resize(count);
+            return in.raw(cells.hi.data(), count * sizeof(uint64_t));
+        }
+        return true;
+    }
+
+    static void put_arena(state_writer& out, const local_arena& arena) {
+        put_cells(out, arena.cells);
+        out.put<uint64_t>(arena.segments.size());
+        for (const local_arena::segment& s : arena.segments) {
+            out.put<uint16_t>(s.tag);
+            out.put<uint64_t>(s.offset);
+            out.put<uint64_t>(s.size);
+            out.put<uint64_t>(s.capacity);
+        }
+        out.put<uint32_t>(arena.frame_base);
+        out.put<uint64_t>(arena.top);
+    }
+
+    static bool get_arena(state_reader& in, local_arena& arena) {
+        uint64_t count;
+        if (!get_cells(in, arena.cells) || !in.get(count) || !in.has(count, 26)) {
+            return false;
+        }
+        size_t cell_count = arena.cells.size();
+        arena.segments.resize(count);
+        for (local_arena::segment& s : arena.segments) {
+            uint64_t offset, size, capacity;
+            if (!in.get(s.tag) || !in.get(offset) || !in.get(size) || !in.get(capacity)) {
+                return false;
+            }
+            if (size > capacity || offset > cell_count || capacity > cell_count - offset) {
+                return false;
+            }
+            s.offset = offset;
+            s.size = size;
+            s.capacity = capacity;
+        }
+        uint64_t top;
+        if (!in.get(arena.frame_base) || !in.get(top)) {
+            return false;
+        }
+        arena.top = top;
+        return arena.frame_base <= arena.segments.size() && top <= cell_count;
+    }
+
+    // 실행 흐름 하나의 상태. vm 멤버와 멈춰 있는 파이버가 같은 형식을 씁니다.
+    static void put_thread(state_writer& out, __uint128_t pc, const stack_data* stack, size_t capacity,
+                           size_t size, const std::vector<call_frame>& frames, const local_arena& locals) {
+        out.put(pc);
+        out.put<uint64_t>(capacity);
+        out.put<uint64_t>(size);
+        if (size != 0) {
+            out.raw(stack + 1, size * sizeof(stack_data));
+        }
+        out.put<uint64_t>(frames.size());
+        for (const call_frame& frame : frames) {
+            out.put<uint32_t>(frame.return_index);
+            out.put<uint32_t>(frame.locals.segment_base);
+            out.put<uint32_t>(frame.locals.segment_top);
+            out.put<uint64_t>(frame.locals.cell_top);
+        }
+        put_arena(out, locals);
+    }
+
+    static bool get_thread(state_reader& in, size_t code_size, __uint128_t& pc, std::unique_ptr<stack_data[]>& stack,
+                           size_t& capacity, size_t& size, std::vector<call_frame>& frames, local_arena& locals) {
+        uint64_t saved_capacity, saved_size, frame_count;
+        // 용량을 먼저 제한하므로 아래의 capacity + 1은 넘치지 않고, 손상된 값으로 큰 버퍼를 잡지도 않습니다.
+        if (!in.get(pc) || !in.get(saved_capacity) || !in.get(saved_size) ||
+            saved_capacity > vm::MAX_STACK_CAPACITY || saved_size > saved_capacity ||
+            !in.has(saved_size, sizeof(stack_data))) {
+            return false;
+        }
+        capacity = saved_capacity;
+        size = saved_size;
+        if (capacity == 0) {
+            stack.reset();
+        } else {
+            stack.reset(new stack_data[capacity + 1]);
+            stack[0] = stack_data(D_TYPE::BIT_8, 0);
+            if (!in.raw(&stack[1], size * sizeof(stack_data))) {
+                return false;
+            }
+        }
+        if (!in.get(frame_count) || !in.has(frame_count, 20)) {
+            return false;
+        }
+        frames.resize(frame_count);
+        for (call_frame& frame : frames) {
+            uint64_t cell_top;
+            if (!in.get(frame.return_index) || !in.get(frame.locals.segment_base) ||
+                !in.get(frame.locals.segment_top) || !in.get(cell_top) || frame.return_index >= code_size) {
+                return false;
+            }
+            frame.locals.cell_top = cell_top;
+        }
+        if (!get_arena(in, locals)) {
+            return false;
+        }
+        for (const call_frame& frame : frames) {
+            if (frame.locals.segment_base > frame.locals.segment_top ||
+                frame.locals.segment_top > locals.segments.size() || frame.locals.cell_top > locals.cells.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void put_state(state_writer& out, const vm& machine) {
+        out.put<uint8_t>(machine.exit_requested);
+        out.put<int32_t>(machine.exit_status);
+        put_thread(out, machine.pc, machine.stack.get(), machine.stack_capacity, machine.stack_size,
+                   machine.call_stack, machine.local_memory);
+
+        out.put<uint64_t>(machine.current_fiber);
+        out.put<uint64_t>(machine.fibers.size());
+        for (const fiber& f : machine.fibers) {
+            put_thread(out, f.pc, f.stack.get(), f.stack_capacity, f.stack_size, f.call_stack, f.local_memory);
+            out.put<uint8_t>(static_cast<uint8_t>(f.state));
+            out.put(f.result);
+            out.put<uint64_t>(f.joiners.size());
+            for (uint64_t id : f.joiners) {
+                out.put(id);
+            }
+        }
+        out.put<uint64_t>(machine.run_queue.size());
+        for (uint64_t id : machine.run_queue) {
+            out.put(id);
+        }
+    }
+
+    static bool get_state(state_reader& in, vm& machine) {
+        size_t code_size = machine.program.code.size();
+        uint8_t exited;
+        uint64_t fiber_count, queued;
+        if (!in.get(exited) || !in.get(machine.exit_status) ||
+            !get_thread(in, code_size, machine.pc, machine.stack, machine.stack_capacity, machine.stack_size,
+                        machine.call_stack, machine.local_memory) ||
+            machine.stack_capacity == 0) {
+            return false;
+        }
+        machine.exit_requested = exited != 0;
+
+        if (!in.get(machine.current_fiber) || !in.get(fiber_count) || !in.has(fiber_count, 1)) {
+            return false;
+        }
+        machine.fibers.resize(fiber_count);
+        for (fiber& f : machine.fibers) {
+            uint8_t state;
+            uint64_t joiners;
+            if (!get_thread(in, code_size, f.pc, f.stack, f.stack_capacity, f.stack_size, f.call_stack,
+                            f.local_memory) ||
+                !in.get(state) || state > static_cast<uint8_t>(fiber_state::DONE) || !in.get(f.result) ||
+                !in.get(joiners) || !in.has(joiners, sizeof(uint64_t))) {
+                return false;
+            }
+            f.state = static_cast<fiber_state>(state);
+            f.joiners.resize(joiners);
+            for (uint64_t& id : f.joiners) {
+                if (!in.get(id) || id >= fiber_count) {
+                    return false;
+                }
+            }
+        }
+        if (machine.current_fiber >= std::max<uint64_t>(fiber_count, 1) || !in.get(queued) ||
+            !in.has(queued, sizeof(uint64_t))) {
+            return false;
+        }
+        machine.run_queue.clear();
+        for (uint64_t i = 0; i < queued; i++) {
+            uint64_t id;
+            if (!in.get(id) || id >= fiber_count) {
+                return false;
+            }
+            machine.run_queue.push_back(id);
+        }
+        return in.done();
+    }
+
+    // 페이지 번호 순으로 페이지 테이블을 만들고, 페이지 데이터의 오프셋을 매깁니다.
+    static std::vector<snapshot_page> page_table(const paged_memory& memory, size_t data_offset) {
+        std::vector<snapshot_page> table;
+        table.reserve(memory.pages.size());
+        for (const auto& entry : memory.pages) {
+            table.push_back({entry.first, 0, entry.second.hi != nullptr});
+        }
+        std::sort(table.begin(), table.end(),
+                  [](const snapshot_page& a, const snapshot_page& b) { return a.number < b.number; });
+        size_t offset = align_to(data_offset, SNAPSHOT_PAGE_ALIGN);
+        for (snapshot_page& p : table) {
+            bool wide = p.hi_offset != 0;
+            p.cells_offset = offset;
+            offset = align_to(offset + sizeof(page), SNAPSHOT_PAGE_ALIGN);
+            p.hi_offset = wide ? offset : 0;
+            if (wide) {
+                offset = align_to(offset + paged_memory::PAGE_SIZE * sizeof(uint64_t), SNAPSHOT_PAGE_ALIGN);
+            }
+        }
+        return table;
+    }
+
+    static bool save(vm& machine, const std::string& path, std::string& error) {
+        if (machine.trap_reason != vm_trap::NONE) {
+            error = "cannot snapshot a trapped VM";
+            return false;
+        }
+        bool oversized = machine.stack_capacity > vm::MAX_STACK_CAPACITY;
+        for (const fiber& f : machine.fibers) {
+            oversized = oversized || f.stack_capacity > vm::MAX_STACK_CAPACITY;
+        }
+        if (oversized) {
+            error = "stack capacity too large to snapshot";
+            return false;
+        }
+        machine.output.flush_all();
+
+        const std::vector<uint16_t>& code = machine.module->bytecode();
+        state_writer state;
+        put_state(state, machine);
+
+        snapshot_header header = {};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.code = {sizeof(header), code.size() * sizeof(uint16_t)};
+        header.state = {align_to(header.code.offset + header.code.size, 8), state.bytes.size()};
+        header.pages.offset = align_to(header.state.offset + header.state.size, 8);
+        header.page_count = machine.global_memory.pages.size();
+        header.pages.size = header.page_count * sizeof(snapshot_page);
+        std::vector<snapshot_page> table = page_table(machine.global_memory, header.pages.offset + header.pages.size);
+
+        // 복원된 VM이 매핑하고 있을 수 있는 파일을 덮어쓰지 않도록 새 파일을 만든 뒤 이름을 바꿉니다.
+        std::string temporary = path + ".tmp";
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            error = "could not open " + temporary;
+            return false;
+        }
+        size_t position = 0;
+        auto write = [&](const void* p, size_t size) {
+            out.write(static_cast<const char*>(p), size);
+            position += size;
+        };
+        auto pad = [&](size_t offset) {
+            static const char zeros[SNAPSHOT_PAGE_ALIGN] = {};
+            while (position < offset) {
+                write(zeros, std::min(offset - position, sizeof(zeros)));
+            }
+        };
+
+        write(&header, sizeof(header));
+        write(code.data(), header.code.size);
+        pad(header.state.offset);
+        write(state.bytes.data(), state.bytes.size());
+        pad(header.pages.offset);
+        write(table.data(), header.pages.size);
+        for (const snapshot_page& p : table) {
+            const paged_memory::page_entry& entry = machine.global_memory.pages.find(p.number)->second;
+            pad(p.cells_offset);
+            write(entry.cells, sizeof(page));
+            if (p.hi_offset != 0) {
+                pad(p.hi_offset);
+                write(entry.hi, paged_memory::PAGE_SIZE * sizeof(uint64_t));
+            }
+        }
+        out.close();
+        if (!out) {
+            std::remove(temporary.c_str());
+            error = "could not write " + temporary;
+            return false;
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            error = "could not rename " + temporary + " to " + path;
+            return false;
+        }
+        return true;
+    }
+
+    static bool in_file(const module_section& section, size_t file_size) {
+        return section.offset % 8 == 0 && section.offset <= file_size && section.size <= file_size - section.offset;
+    }
+
+    static std::unique_ptr<vm> restore(const std::string& path, vm_options options, std::string& error) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "could not open " + path;
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            error = "could not stat " + path;
+            return nullptr;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size < sizeof(snapshot_header)) {
+            close(fd);
+            error = "not a snapshot file";
+            return nullptr;
+        }
+        // 쓰기 가능한 사적 매핑. 페이지에 쓰면 그 페이지만 복사되고 파일은 바뀌지 않습니다.
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            error = "could not map " + path;
+            return nullptr;
+        }
+        std::shared_ptr<void> mapping(p, [size](void* q) { munmap(q, size); });
+        const uint8_t* bytes = static_cast<const uint8_t*>(p);
+
+        snapshot_header header;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            error = "not a snapshot file";
+            return nullptr;
+        }
+        if (header.version != SNAPSHOT_VERSION) {
+            error = "unsupported snapshot version " + std::to_string(header.version);
+            return nullptr;
+        }
+        if (!in_file(header.code, size) || !in_file(header.state, size) || !in_file(header.pages, size) ||
+            header.code.size % 2 != 0 || header.pages.size / sizeof(snapshot_page) < header.page_count) {
+            error = "snapshot section out of range";
+            return nullptr;
+        }
+
+        std::shared_ptr<const vm_module> module = vm_module::create(
+            reinterpret_cast<const uint16_t*>(bytes + header.code.offset), header.code.size / 2);
+        std::unique_ptr<vm> machine(new vm(module, options));
+        state_reader state(bytes + header.state.offset, header.state.size);
+        if (!get_state(state, *machine)) {
+            error = "corrupt snapshot state";
+            return nullptr;
+        }
+
+        paged_memory& memory = machine->global_memory;
+        const snapshot_page* table = reinterpret_cast<const snapshot_page*>(bytes + header.pages.offset);
+        uint8_t* base = static_cast<uint8_t*>(p);
+        for (uint64_t i = 0; i < header.page_count; i++) {
+            const snapshot_page& entry = table[i];
+            const size_t hi_size = paged_memory::PAGE_SIZE * sizeof(uint64_t);
+            if (!in_file({entry.cells_offset, sizeof(page)}, size) ||
+                (entry.hi_offset != 0 && !in_file({entry.hi_offset, hi_size}, size))) {
+                error = "snapshot page out of range";
+                return nullptr;
+            }
+            paged_memory::page_entry& slot = memory.pages[entry.number];
+            slot = paged_memory::page_entry();
+            slot.cells = reinterpret_cast<page*>(base + entry.cells_offset);
+            slot.hi = entry.hi_offset != 0 ? reinterpret_cast<uint64_t*>(base + entry.hi_offset) : nullptr;
+        }
+        memory.backing = std::move(mapping);
+        memory.last_number = UINT64_MAX;
+        memory.last_entry = nullptr;
+        memory.last_page = nullptr;
+        memory.last_hi = nullptr;
+        return machine;
+    }
+};
+
+bool vm::save_snapshot(const std::string& path, std::string& error) {
+    return snapshot_codec::save(*this, path, error);
+}
+
+std::unique_ptr<vm> vm::restore_snapshot(const std::string& path, vm_options options, std::string& error) {
+    return snapshot_codec::restore(path, options, error);
+}
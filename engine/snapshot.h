@@ -0,0 +1,46 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "module_file.h"
+
+// dirtvm 스냅샷 파일 형식 (리틀 엔디언)
+//
+//   snapshot_header          64 bytes
+//   code section             uint16_t 워드 배열 (vm_module::bytecode()), 8바이트 정렬
+//   state section            pc, 스택, 호출 스택, 지역 메모리, 파이버를 차례로 담은 바이트열
+//   page table               snapshot_page 배열, 8바이트 정렬
+//   page data                전역 메모리 페이지 본체와 상위 64비트 배열, 각각 4096바이트 정렬
+//
+// 페이지 데이터는 paged_memory의 페이지 블록을 그대로 쓴 것이므로, 복원할 때 파일을
+// MAP_PRIVATE로 매핑하고 페이지가 매핑을 직접 가리키게 합니다. 명령어 위치는 디코딩된
+// 명령어 인덱스로 저장하며, 같은 코드를 다시 디코딩하면 같은 인덱스가 나옵니다.
+// 디코더가 인덱스를 매기는 방식이 바뀌면 SNAPSHOT_VERSION을 올려야 합니다.
+
+static const char SNAPSHOT_MAGIC[4] = {'D', 'S', 'N', 'P'};
+static const uint32_t SNAPSHOT_VERSION = 2;
+static const size_t SNAPSHOT_PAGE_ALIGN = 4096;
+
+struct snapshot_header {
+    char magic[4];
+    uint32_t version;
+    module_section code;
+    module_section state;
+    module_section pages;   // snapshot_page 배열
+    uint64_t page_count;
+};
+
+static_assert(sizeof(snapshot_header) == 64, "snapshot_header layout");
+
+// 전역 메모리 페이지 하나. 오프셋은 파일 시작부터의 바이트 위치입니다.
+struct snapshot_page {
+    uint64_t number;        // 주소 >> paged_memory::PAGE_BITS
+    uint64_t cells_offset;  // 하위 64비트 배열과 태그 배열
+    uint64_t hi_offset;     // 상위 64비트 배열. 없으면 0
+};
+
+static_assert(sizeof(snapshot_page) == 24, "snapshot_page layout");
+
+#endif // SNAPSHOT_H
@@ -1,51 +1,79 @@
 #include <unistd.h>
+#include <cerrno>
 #include <iostream>
-#include <vector>
 #include <sys/syscall.h> // For syscall numbers like SYS_write
 
 #include "vm.h"
 #include "object.h"
 
-void vm::handle_syscall(uint16_t operand1) {
+static bool would_block() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+// 인자는 시스템 콜이 끝날 때 꺼냅니다. 기다려야 하면 스택을 그대로 두고 false를 반환하므로
+// 다시 run()하면 같은 syscall 명령어가 같은 인자로 다시 실행됩니다.
+// 실행 오류나 SYS_exit일 때도 false를 반환하며, trap_reason이나 exit_requested가 설정됩니다.
+bool vm::handle_syscall(uint16_t operand1) {
     long syscall_num = operand1;
     long ret = 0;
 
     switch (syscall_num) {
         case SYS_read: { // syscall 0
-            stack_data fd_data = pop();
-            stack_data buf_addr_data = pop();
-            stack_data count_data = pop();
-            // Reading into VM memory is complex, so not fully implemented.
-            std::cerr << "Syscall error: read is not implemented" << std::endl;
-            ret = -1;
+            if (stack_size < 3) {
+                return raise(vm_trap::STACK_UNDERFLOW);
+            }
+            int fd = (int)peek(0).get_data();
+            __uint128_t buf_addr = peek(1).get_data();
+            __uint128_t count = peek(2).get_data();
+
+            if (!global_range(buf_addr, count)) {
+                std::cerr << "Syscall error: read buffer out of bounds" << std::endl;
+                ret = -1;
+            } else {
+                // 입력을 기다리기 전에 프롬프트 같은 출력을 먼저 내보냅니다.
+                if (input.buffered() == 0 || fd != STDIN_FILENO) {
+                    output.flush_all();
+                }
+                ret = input.read(fd, global_memory, static_cast<uint64_t>(buf_addr), static_cast<uint64_t>(count));
+                if (ret < 0 && nonblocking_io && would_block()) {
+                    return wait_for(fd, false);
+                }
+            }
+            stack_size -= 3;
             break;
         }
         case SYS_write: { // syscall 1
-            stack_data fd_data = pop();
-            stack_data buf_addr_data = pop();
-            stack_data count_data = pop();
-
-            long fd = (long)fd_data.get_data();
-            __uint128_t buf_addr = buf_addr_data.get_data();
-            size_t count = (size_t)count_data.get_data();
+            if (stack_size < 3) {
+                return raise(vm_trap::STACK_UNDERFLOW);
+            }
+            int fd = (int)peek(0).get_data();
+            __uint128_t buf_addr = peek(1).get_data();
+            __uint128_t count = peek(2).get_data();
 
-            if (buf_addr + count > global_memory.size()) {
+            if (!global_range(buf_addr, count)) {
                  std::cerr << "Syscall error: write buffer out of bounds" << std::endl;
                  ret = -1;
-            } else {
-                std::vector<char> buffer;
-                buffer.reserve(count);
-                for(size_t i = 0; i < count; i++) {
-                    buffer.push_back(static_cast<char>(global_memory[static_cast<size_t>(buf_addr + i)].get_data()));
+            } else if (nonblocking_io) {
+                // 호스트 모드에서는 버퍼링하지 않고 write(2)처럼 쓸 수 있는 만큼만 씁니다.
+                ret = output.write_direct(fd, global_memory, static_cast<uint64_t>(buf_addr), static_cast<uint64_t>(count));
+                if (ret < 0 && would_block()) {
+                    return wait_for(fd, true);
                 }
-                ret = write(fd, buffer.data(), count);
+            } else {
+                // 셀의 하위 바이트를 출력 버퍼로 바로 모읍니다. 실제 write는 버퍼 정책에 따라 나중에 일어납니다.
+                ret = output.write(fd, global_memory, static_cast<uint64_t>(buf_addr), static_cast<uint64_t>(count));
             }
+            stack_size -= 3;
             break;
         }
         case SYS_exit: { // syscall 60
             stack_data status_data = pop();
-            exit((int)status_data.get_data());
-            break; 
+            if (trap_reason != vm_trap::NONE) {
+                return false;
+            }
+            exit_requested = true;
+            exit_status = (int)status_data.get_data();
+            return false;
         }
         default: {
             std::cerr << "Unsupported syscall: " << syscall_num << std::endl;
@@ -54,9 +82,11 @@ void vm::handle_syscall(uint16_t operand1) {
         }
     }
 
-    // For syscalls that don't return (like exit), this won't be reached.
-    // For others, push the return value.
-    if (syscall_num != SYS_exit) {
-        push(stack_data(D_TYPE::BIT_64, ret));
-    }
+    push(stack_data(D_TYPE::BIT_64, ret));
+    return trap_reason == vm_trap::NONE;
+}
+
+bool vm::wait_for(int fd, bool write) {
+    waiting_io = {fd, write};
+    return false;
 }
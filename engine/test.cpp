@@ -3,6 +3,27 @@
 #include <cassert>
 #include "vm.h"
 #include "object.h"
+#include "module_file.h"
+#include "snapshot.h"
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <memory>
+#include <sys/socket.h>
+#include "event_loop.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "trace.h"
+#include "disassemble.h"
+#include "opcode.h"
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 // --- Opcode Definitions for Readability ---
 #define OPC_ADD      (0b000001 << 10)
@@ -29,6 +50,29 @@
 #define OPC_PUSHD64  (0b010111 << 10)
 #define OPC_PUSHD128 (0b011000 << 10)
 #define OPC_SYSCALL  (0b011001 << 10)
+#define OPC_ADDI     (0b011010 << 10)
+#define OPC_JEQ      (0b011011 << 10)
+#define OPC_JNE      (0b011100 << 10)
+#define OPC_JLT      (0b011101 << 10)
+#define OPC_JGE      (0b011110 << 10)
+#define OPC_JGT      (0b011111 << 10)
+#define OPC_JLE      (0b100000 << 10)
+#define OPC_JZK      (0b100001 << 10)
+#define OPC_JNZK     (0b100010 << 10)
+#define OPC_GLOADI   (0b100011 << 10)
+#define OPC_GSTOREI  (0b100100 << 10)
+#define OPC_SHLI     (0b100101 << 10)
+#define OPC_SHRI     (0b100110 << 10)
+#define OPC_GCOPY    (0b100111 << 10)
+#define OPC_GFILL    (0b101000 << 10)
+#define OPC_GCMP     (0b101001 << 10)
+#define OPC_SPAWN    (0b101010 << 10)
+#define OPC_YIELD    (0b101011 << 10)
+#define OPC_JOIN     (0b101100 << 10)
+
+// Options every test VM is built with. main() runs the suite once with the
+// interpreter and once with the JIT compiling everything on first entry.
+vm_options test_options;
 
 // Helper to access the internal stack for testing purposes.
 // This requires a friend declaration in vm.h or making the stack public.
@@ -43,7 +87,7 @@ void test_arithmetic() {
         OPC_PUSHD16, 5,
         OPC_ADD
     };
-    vm vm_add(bytecode_add);
+    vm vm_add(bytecode_add, test_options);
     vm_add.run();
     assert(vm_add.pop().get_data() == 15);
 
@@ -53,7 +97,7 @@ void test_arithmetic() {
         OPC_PUSHD16, 5,
         OPC_SUB
     };
-    vm vm_sub(bytecode_sub);
+    vm vm_sub(bytecode_sub, test_options);
     vm_sub.run();
     assert(vm_sub.pop().get_data() == 5);
     
@@ -63,7 +107,7 @@ void test_arithmetic() {
         OPC_PUSHD16, 10,
         OPC_MUL
     };
-    vm vm_mul(bytecode_mul);
+    vm vm_mul(bytecode_mul, test_options);
     vm_mul.run();
     assert(vm_mul.pop().get_data() == 50);
 
@@ -73,7 +117,7 @@ void test_arithmetic() {
         OPC_PUSHD16, 5,
         OPC_DIV
     };
-    vm vm_div(bytecode_div);
+    vm vm_div(bytecode_div, test_options);
     vm_div.run();
     assert(vm_div.pop().get_data() == 2);
     std::cout << "Arithmetic Tests Passed!" << std::endl;
@@ -86,7 +130,7 @@ void test_stack_ops() {
         OPC_PUSHD16, 123,
         OPC_DUP
     };
-    vm vm_dup(bytecode_dup);
+    vm vm_dup(bytecode_dup, test_options);
     vm_dup.run();
     assert(vm_dup.pop().get_data() == 123);
     assert(vm_dup.pop().get_data() == 123);
@@ -97,10 +141,24 @@ void test_stack_ops() {
         OPC_PUSHD16, 2,
         OPC_POP
     };
-    vm vm_pop(bytecode_pop);
+    vm vm_pop(bytecode_pop, test_options);
     vm_pop.run();
     assert(vm_pop.pop().get_data() == 1);
 
+    // Test a stack filled exactly to its configured capacity
+    std::vector<uint16_t> bytecode_full = {
+        OPC_PUSHD16, 1,
+        OPC_PUSHD16, 2,
+        OPC_PUSHD16, 3,
+        OPC_ADD
+    };
+    vm_options small_stack = test_options;
+    small_stack.stack_capacity = 3;
+    vm vm_full(bytecode_full, small_stack);
+    vm_full.run();
+    assert(vm_full.pop().get_data() == 5);
+    assert(vm_full.pop().get_data() == 1);
+
     std::cout << "Stack Ops Tests Passed!" << std::endl;
 }
 
@@ -108,38 +166,49 @@ void test_control_flow() {
     std::cout << "Testing Control Flow..." << std::endl;
     // Test JMP
     std::vector<uint16_t> bytecode_jmp = {
-        OPC_JMP, 0,0,0,0,0,0,0,11, // JMP to address 11
+        OPC_JMP, 11,0,0,0,0,0,0,0, // JMP to address 11 (little-endian words)
         OPC_PUSHD16, 1, // Should be skipped
         OPC_PUSHD16, 99 // Target
     };
-    vm vm_jmp(bytecode_jmp);
+    vm vm_jmp(bytecode_jmp, test_options);
     vm_jmp.run();
     assert(vm_jmp.pop().get_data() == 99);
 
     // Test JZ (jump)
     std::vector<uint16_t> bytecode_jz_true = {
         OPC_PUSHD16, 0,
-        OPC_JZ, 0,0,0,0,0,0,0,13, // JZ to address 13
+        OPC_JZ, 13,0,0,0,0,0,0,0, // JZ to address 13
         OPC_PUSHD16, 1, // Skipped
         OPC_PUSHD16, 99 // Target
     };
-    vm vm_jz_true(bytecode_jz_true);
+    vm vm_jz_true(bytecode_jz_true, test_options);
     vm_jz_true.run();
     assert(vm_jz_true.pop().get_data() == 99);
     
     // Test CALL/RET
     std::vector<uint16_t> bytecode_call = {
-        OPC_CALL, 0,0,0,0,0,0,0,12, // Call address 12
+        OPC_CALL, 12,0,0,0,0,0,0,0, // Call address 12
         OPC_PUSHD16, 55,           // After return
         OPC_RET,                   // Should not be executed here
         OPC_PUSHD16, 123,          // In function
         OPC_RET                    // Return
     };
-    vm vm_call(bytecode_call);
+    vm vm_call(bytecode_call, test_options);
     vm_call.run();
     assert(vm_call.pop().get_data() == 55);
     assert(vm_call.pop().get_data() == 123);
-    
+
+    // Test JMP into the middle of an instruction (data word decoded as code)
+    std::vector<uint16_t> bytecode_mid = {
+        OPC_PUSHD16, 7,
+        OPC_JMP, 12,0,0,0,0,0,0,0, // JMP to the data word of the pushd16 below
+        OPC_PUSHD16, OPC_DUP       // Executed from address 12: DUP
+    };
+    vm vm_mid(bytecode_mid, test_options);
+    vm_mid.run();
+    assert(vm_mid.pop().get_data() == 7);
+    assert(vm_mid.pop().get_data() == 7);
+
     std::cout << "Control Flow Tests Passed!" << std::endl;
 }
 
@@ -147,19 +216,19 @@ void test_comparison() {
     std::cout << "Testing Comparison..." << std::endl;
     // Test EQ
     std::vector<uint16_t> bytecode_eq_true = { OPC_PUSHD16, 5, OPC_PUSHD16, 5, OPC_EQ };
-    vm vm_eq_true(bytecode_eq_true);
+    vm vm_eq_true(bytecode_eq_true, test_options);
     vm_eq_true.run();
     assert(vm_eq_true.pop().get_data() == 1);
 
     // Test LT
     std::vector<uint16_t> bytecode_lt_true = { OPC_PUSHD16, 5, OPC_PUSHD16, 10, OPC_LT };
-    vm vm_lt_true(bytecode_lt_true);
+    vm vm_lt_true(bytecode_lt_true, test_options);
     vm_lt_true.run();
     assert(vm_lt_true.pop().get_data() == 1);
 
     // Test GT
     std::vector<uint16_t> bytecode_gt_true = { OPC_PUSHD16, 10, OPC_PUSHD16, 5, OPC_GT };
-    vm vm_gt_true(bytecode_gt_true);
+    vm vm_gt_true(bytecode_gt_true, test_options);
     vm_gt_true.run();
     assert(vm_gt_true.pop().get_data() == 1);
 
@@ -176,10 +245,87 @@ void test_memory() {
         OPC_PUSHD16, 2,         // Address to load from
         OPC_GLOAD               // Load from address 2
     };
-    vm vm_gmem(bytecode_gmem);
+    vm vm_gmem(bytecode_gmem, test_options);
     vm_gmem.run();
     assert(vm_gmem.pop().get_data() == 123);
 
+    // Test GSTORE / GLOAD of a value wider than 64 bits next to a narrow one
+    std::vector<uint16_t> bytecode_gwide = {
+        OPC_PUSHD128, 1,2,3,4,5,6,7,8, // Value to store
+        OPC_PUSHD16, 3,                // Address
+        OPC_GSTORE,
+        OPC_PUSHD8, 9,
+        OPC_PUSHD16, 1,
+        OPC_GSTORE,
+        OPC_PUSHD16, 3,
+        OPC_GLOAD,
+        OPC_PUSHD16, 1,
+        OPC_GLOAD
+    };
+    vm vm_gwide(bytecode_gwide, test_options);
+    vm_gwide.run();
+    stack_data narrow = vm_gwide.pop();
+    assert(narrow.get_data() == 9 && narrow.get_d_type() == D_TYPE::BIT_8);
+    stack_data wide = vm_gwide.pop();
+    assert(wide.get_d_type() == D_TYPE::BIT_128);
+    assert((uint64_t)(wide.get_data() >> 64) == 0x0008000700060005ull);
+    assert((uint64_t)wide.get_data() == 0x0004000300020001ull);
+
+    // Test scattered high addresses: only the touched pages are allocated and
+    // untouched cells read as BIT_8 0
+    std::vector<uint16_t> bytecode_sparse = {
+        OPC_PUSHD16, 77,
+        OPC_PUSHD32, 0xE100, 0x05F5,            // Address 100,000,000
+        OPC_GSTORE,
+        OPC_PUSHD128, 9,0,0,0,1,0,0,0,
+        OPC_PUSHD64, 0,0,0,0x8000,              // Address 2^63
+        OPC_GSTORE,
+        OPC_PUSHD32, 0xE100, 0x05F5,
+        OPC_GLOAD,
+        OPC_PUSHD64, 0,0,0,0x8000,
+        OPC_GLOAD,
+        OPC_PUSHD32, 0xE101, 0x05F5,            // Same page, never stored
+        OPC_GLOAD,
+        OPC_PUSHD64, 0,0,0,0x4000,              // Page never touched
+        OPC_GLOAD
+    };
+    vm vm_sparse(bytecode_sparse, test_options);
+    vm_sparse.run();
+    stack_data untouched = vm_sparse.pop();
+    assert(untouched.get_data() == 0 && untouched.get_d_type() == D_TYPE::BIT_8);
+    assert(vm_sparse.pop().get_data() == 0);
+    assert(vm_sparse.pop().get_data() == (((__uint128_t)1 << 64) | 9));
+    assert(vm_sparse.pop().get_data() == 77);
+
+    // Test GFILL / GCOPY / GCMP across the page boundary at 4096, with
+    // overlapping copies in both directions
+    std::vector<uint16_t> bytecode_bulk = {
+        OPC_PUSHD16, 4090, OPC_PUSHD16, 7, OPC_PUSHD16, 20, OPC_GFILL,    // [4090, 4110) = 7
+        OPC_PUSHD16, 9, OPC_PUSHD16, 4100, OPC_GSTORE,                    // [4100] = 9
+        OPC_PUSHD16, 4095, OPC_PUSHD16, 4090, OPC_PUSHD16, 15, OPC_GCOPY, // backward: 9 moves to 4105
+        OPC_PUSHD16, 4080, OPC_PUSHD16, 4100, OPC_PUSHD16, 8, OPC_GCOPY,  // forward: 9 lands on 4085
+        OPC_PUSHD16, 4080, OPC_PUSHD16, 4100, OPC_PUSHD16, 8, OPC_GCMP,   // equal -> 0
+        OPC_PUSHD16, 4105, OPC_PUSHD16, 4106, OPC_PUSHD16, 1, OPC_GCMP,   // 9 > 7 -> 2
+        OPC_PUSHD32, 0xC350, 0, OPC_PUSHD16, 4090, OPC_PUSHD16, 1, OPC_GCMP, // 0 < 7 -> 1
+        OPC_PUSHD16, 4105, OPC_GLOAD,
+        OPC_PUSHD16, 4100, OPC_GLOAD,
+        OPC_PUSHD16, 4085, OPC_GLOAD,
+        OPC_PUSHD16, 4079, OPC_GLOAD,
+        OPC_PUSHD16, 4109, OPC_GLOAD
+    };
+    vm vm_bulk(bytecode_bulk, test_options);
+    vm_bulk.run();
+    stack_data filled = vm_bulk.pop();
+    assert(filled.get_data() == 7 && filled.get_d_type() == D_TYPE::BIT_16);
+    assert(vm_bulk.pop().get_data() == 0);
+    assert(vm_bulk.pop().get_data() == 9);
+    assert(vm_bulk.pop().get_data() == 7);
+    assert(vm_bulk.pop().get_data() == 9);
+    stack_data order = vm_bulk.pop();
+    assert(order.get_data() == 1 && order.get_d_type() == D_TYPE::BIT_8);
+    assert(vm_bulk.pop().get_data() == 2);
+    assert(vm_bulk.pop().get_data() == 0);
+
     // Test LSTORE / LLOAD
     uint16_t tag = 5;
     std::vector<uint16_t> bytecode_lmem = {
@@ -189,10 +335,62 @@ void test_memory() {
         OPC_PUSHD16, 1,              // Address to load
         (uint16_t)(OPC_LLOAD | tag)              // Load from loc(tag=5, addr=1)
     };
-     vm vm_lmem(bytecode_lmem);
+     vm vm_lmem(bytecode_lmem, test_options);
     vm_lmem.run();
     assert(vm_lmem.pop().get_data() == 456);
 
+    // Locals belong to the call frame: the callee's tag 5 is a fresh slot
+    std::vector<uint16_t> bytecode_lframe = {
+        OPC_PUSHD16, 11, OPC_PUSHD16, 0, (uint16_t)(OPC_LSTORE | 5),   // 0: l5[0] = 11
+        OPC_CALL, 18,0,0,0,0,0,0,0,                                  // 5
+        OPC_PUSHD16, 0, (uint16_t)(OPC_LLOAD | 5),                   // 14: still 11
+        0,                                                           // 17: halt
+        OPC_PUSHD16, 22, OPC_PUSHD16, 0, (uint16_t)(OPC_LSTORE | 5),  // 18: callee l5[0] = 22
+        OPC_RET
+    };
+    vm vm_lframe(bytecode_lframe, test_options);
+    vm_lframe.run();
+    assert(vm_lframe.pop().get_data() == 11);
+
+    // Recursive sum(n) = n + sum(n - 1) keeps n in a local across the call
+    std::vector<uint16_t> bytecode_lrec = {
+        OPC_PUSHD16, 4, OPC_CALL, 12,0,0,0,0,0,0,0, 0,               // 0
+        OPC_DUP, OPC_JZ, 43,0,0,0,0,0,0,0,                           // 12: sum
+        OPC_DUP, OPC_PUSHD16, 0, (uint16_t)(OPC_LSTORE | 1),         // 22
+        OPC_PUSHD16, 1, OPC_SUB, OPC_CALL, 12,0,0,0,0,0,0,0,         // 26
+        OPC_PUSHD16, 0, (uint16_t)(OPC_LLOAD | 1), OPC_ADD, OPC_RET, // 38
+        OPC_RET                                                      // 43
+    };
+    vm vm_lrec(bytecode_lrec, test_options);
+    vm_lrec.run();
+    assert(vm_lrec.pop().get_data() == 10);
+
+    // The arena returns to the same footprint after every frame, and growing a
+    // segment that is not on top moves it without losing values
+    local_arena arena;
+    stack_data local_out;
+    arena.store(1, 0, stack_data(D_TYPE::BIT_16, 1));
+    size_t footprint = 0;
+    for (int i = 0; i < 1000; i++) {
+        local_arena::frame_mark mark = arena.enter();
+        assert(!arena.load(1, 0, local_out));
+        arena.store(1, 3, stack_data(D_TYPE::BIT_16, i));
+        arena.store(2, 0, stack_data(D_TYPE::BIT_16, i + 1));
+        arena.store(1, 100, stack_data(D_TYPE::BIT_16, i + 2));
+        assert(arena.load(1, 3, local_out) && local_out.get_data() == (uint64_t)i);
+        assert(arena.load(1, 50, local_out) && local_out.get_data() == 0);
+        assert(arena.load(2, 0, local_out) && local_out.get_data() == (uint64_t)i + 1);
+        arena.leave(mark);
+        if (i == 0) {
+            footprint = arena.cell_footprint();
+        }
+        assert(arena.cell_footprint() == footprint);
+    }
+    assert(arena.load(1, 0, local_out) && local_out.get_data() == 1);
+    assert(!arena.store(1, local_arena::DEFAULT_SEGMENT_LIMIT, stack_data(D_TYPE::BIT_8, 0)));
+    assert(!arena.store(1, 100, stack_data(D_TYPE::BIT_8, 0), 100));
+    assert(arena.store(1, 99, stack_data(D_TYPE::BIT_8, 0), 100));
+
     std::cout << "Memory Tests Passed!" << std::endl;
 }
 
@@ -200,25 +398,55 @@ void test_push() {
     std::cout << "Testing Push Operations..." << std::endl;
     // Test PUSHD8
     std::vector<uint16_t> code_d8 = { OPC_PUSHD8, 0xAB };
-    vm vm_d8(code_d8);
+    vm vm_d8(code_d8, test_options);
     vm_d8.run();
     assert(vm_d8.pop().get_data() == 0xAB);
     
     // Test PUSHD16
     std::vector<uint16_t> code_d16 = { OPC_PUSHD16, 0xABCD };
-    vm vm_d16(code_d16);
+    vm vm_d16(code_d16, test_options);
     vm_d16.run();
     assert(vm_d16.pop().get_data() == 0xABCD);
 
     // Test PUSHD32
     std::vector<uint16_t> code_d32 = { OPC_PUSHD32, 0xCDAB, 0xEF89 };
-    vm vm_d32(code_d32);
+    vm vm_d32(code_d32, test_options);
     vm_d32.run();
     assert(vm_d32.pop().get_data() == 0xEF89CDAB);
 
     std::cout << "Push Tests Passed!" << std::endl;
 }
 
+// Writes "ab\nc" (stored at 0..3) to a pipe as a series of (address, count)
+// SYS_write calls and returns how many write/writev calls the VM made.
+size_t run_buffered_writes(const std::vector<std::pair<uint16_t, uint16_t>>& writes, flush_policy policy,
+                           size_t buffer_size, std::string& written) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+    std::vector<uint16_t> bytecode;
+    const char* text = "ab\nc";
+    for (uint16_t i = 0; i < 4; i++) {
+        bytecode.insert(bytecode.end(), {OPC_PUSHD8, (uint16_t)text[i], OPC_PUSHD16, i, OPC_GSTORE});
+    }
+    for (const auto& w : writes) {
+        bytecode.insert(bytecode.end(), {OPC_PUSHD16, w.second, OPC_PUSHD16, w.first,
+                                         OPC_PUSHD16, (uint16_t)fds[1], OPC_SYSCALL | 1, OPC_POP});
+    }
+    vm_options options = test_options;
+    options.output_buffer_size = buffer_size;
+    vm machine(bytecode, options);
+    machine.set_output_policy(fds[1], policy);
+    machine.run();
+
+    char buffer[64];
+    ssize_t n = read(fds[0], buffer, sizeof(buffer));
+    assert(n > 0);
+    written.assign(buffer, n);
+    close(fds[0]);
+    close(fds[1]);
+    return machine.output_syscall_count();
+}
+
 void test_syscall() {
     std::cout << "Testing Syscall..." << std::endl;
     // 1. Store "hello" in global memory
@@ -250,18 +478,881 @@ void test_syscall() {
         OPC_PUSHD16, 5,      // arg 3: count = 5
         OPC_PUSHD16, 0,      // arg 2: buffer address = 0
         OPC_PUSHD16, 1,      // arg 1: fd = 1 (stdout)
-        OPC_PUSHD16, 1,      // syscall number for write
-        OPC_SYSCALL
+        OPC_SYSCALL | 1      // syscall number for write
     };
 
-    vm vm_syscall(bytecode);
+    vm vm_syscall(bytecode, test_options);
     vm_syscall.run();
 
     assert(vm_syscall.pop().get_data() == 5);
+
+    // Small writes are coalesced per fd and flushed when run() returns
+    std::string written;
+    assert(run_buffered_writes({{0, 1}, {1, 1}, {2, 1}, {3, 1}}, flush_policy::FULL, 64, written) == 1);
+    assert(written == "ab\nc");
+    // Line policy flushes at the newline, then at halt
+    assert(run_buffered_writes({{0, 1}, {1, 1}, {2, 1}, {3, 1}}, flush_policy::LINE, 64, written) == 2);
+    assert(written == "ab\nc");
+    // A write larger than the buffer goes out together with the pending bytes in one writev
+    assert(run_buffered_writes({{0, 1}, {0, 4}}, flush_policy::FULL, 2, written) == 1);
+    assert(written == "aab\nc");
+    assert(run_buffered_writes({{0, 1}, {1, 3}}, flush_policy::UNBUFFERED, 64, written) == 2);
+    assert(written == "ab\nc");
+
+    // read(fd, 100, 64) fills global memory straight from a pipe, then returns 0 at EOF
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], "hi!", 3) == 3);
+    close(fds[1]);
+    std::vector<uint16_t> bytecode_read = {
+        OPC_PUSHD16, 64, OPC_PUSHD16, 100, OPC_PUSHD16, (uint16_t)fds[0], OPC_SYSCALL | 0,
+        OPC_PUSHD16, 64, OPC_PUSHD16, 200, OPC_PUSHD16, (uint16_t)fds[0], OPC_SYSCALL | 0,
+        OPC_PUSHD16, 102, OPC_GLOAD
+    };
+    vm vm_read(bytecode_read, test_options);
+    vm_read.run();
+    stack_data last = vm_read.pop();
+    assert(last.get_data() == '!' && last.get_d_type() == D_TYPE::BIT_8);
+    assert(vm_read.pop().get_data() == 0);
+    assert(vm_read.pop().get_data() == 3);
+    assert(vm_read.input_syscall_count() == 2);
+    close(fds[0]);
+
+    // Streaming mode serves small reads from a fixed buffer, one kernel read per refill
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], "abcdefghij", 10) == 10);
+    close(fds[1]);
+    input_buffer stream(4, fds[0]);
+    paged_memory memory;
+    std::string streamed;
+    uint8_t byte;
+    for (;;) {
+        long n = stream.read(fds[0], memory, 0, 3);
+        assert(n >= 0 && n <= 3);
+        if (n == 0) {
+            break;
+        }
+        for (long i = 0; i < n; i++) {
+            memory.read_bytes(i, 1, &byte);
+            streamed += (char)byte;
+        }
+    }
+    assert(streamed == "abcdefghij");
+    assert(stream.syscall_count() == 4); // 4 + 4 + 2 bytes, then EOF
+    close(fds[0]);
+
     std::cout << "Syscall Test Passed!" << std::endl;
 }
 
-int main() {
+// Pushes 1 if the fused branch `opcode` is taken for (a, b), 0 otherwise.
+uint64_t run_fused_branch(uint16_t opcode, uint16_t a, uint16_t b) {
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD16, a, OPC_PUSHD16, b,
+        opcode, 16,0,0,0,0,0,0,0,   // 4: taken -> 16
+        OPC_PUSHD16, 0, 0,          // 13: not taken, halt
+        OPC_PUSHD16, 1              // 16
+    };
+    vm machine(bytecode, test_options);
+    machine.run();
+    return machine.pop().get_data();
+}
+
+void test_superinstructions() {
+    std::cout << "Testing Superinstructions..." << std::endl;
+    // ADDI keeps the type of the value it adds to
+    std::vector<uint16_t> bytecode_addi = { OPC_PUSHD32, 5,0, OPC_ADDI, 10 };
+    vm vm_addi(bytecode_addi, test_options);
+    vm_addi.run();
+    stack_data sum = vm_addi.pop();
+    assert(sum.get_data() == 15);
+    assert(sum.get_d_type() == D_TYPE::BIT_32);
+
+    assert(run_fused_branch(OPC_JEQ, 5, 5) == 1 && run_fused_branch(OPC_JEQ, 5, 6) == 0);
+    assert(run_fused_branch(OPC_JNE, 5, 6) == 1 && run_fused_branch(OPC_JNE, 5, 5) == 0);
+    assert(run_fused_branch(OPC_JLT, 5, 6) == 1 && run_fused_branch(OPC_JLT, 6, 6) == 0);
+    assert(run_fused_branch(OPC_JGE, 6, 6) == 1 && run_fused_branch(OPC_JGE, 5, 6) == 0);
+    assert(run_fused_branch(OPC_JGT, 7, 6) == 1 && run_fused_branch(OPC_JGT, 6, 6) == 0);
+    assert(run_fused_branch(OPC_JLE, 6, 6) == 1 && run_fused_branch(OPC_JLE, 7, 6) == 0);
+
+    // JZK/JNZK test the top value without popping it
+    std::vector<uint16_t> bytecode_jzk = {
+        OPC_PUSHD16, 0,
+        OPC_JZK, 13,0,0,0,0,0,0,0,
+        OPC_PUSHD16, 9,            // Skipped
+        OPC_JNZK, 24,0,0,0,0,0,0,0, // 13: not taken
+        OPC_PUSHD16, 4             // 22
+    };
+    vm vm_jzk(bytecode_jzk, test_options);
+    vm_jzk.run();
+    assert(vm_jzk.pop().get_data() == 4);
+    assert(vm_jzk.pop().get_data() == 0);
+
+    // SHLI / SHRI keep the type and drop bits shifted out of 128 bits
+    std::vector<uint16_t> bytecode_shift = { OPC_PUSHD16, 3, OPC_SHLI | 127, OPC_DUP, OPC_SHRI | 125 };
+    vm vm_shift(bytecode_shift, test_options);
+    vm_shift.run();
+    stack_data shifted = vm_shift.pop();
+    assert(shifted.get_data() == 4);
+    assert(shifted.get_d_type() == D_TYPE::BIT_16);
+    assert(vm_shift.pop().get_data() == ((__uint128_t)1 << 127));
+
+    // GSTOREI / GLOADI
+    std::vector<uint16_t> bytecode_gi = { OPC_PUSHD16, 42, OPC_GSTOREI, 3, OPC_GLOADI, 3 };
+    vm vm_gi(bytecode_gi, test_options);
+    vm_gi.run();
+    assert(vm_gi.pop().get_data() == 42);
+
+    std::cout << "Superinstruction Tests Passed!" << std::endl;
+}
+
+// Runs the same bytecode under the interpreter and the JIT and checks that the
+// top `count` stack values (data and type) agree.
+void check_same_under_jit(const std::vector<uint16_t>& bytecode, int count, uint32_t threshold) {
+    vm_options interp_options;
+    vm_options jit_options;
+    jit_options.enable_jit = true;
+    jit_options.jit_threshold = threshold;
+    vm interp(bytecode, interp_options);
+    vm jitted(bytecode, jit_options);
+    interp.run();
+    jitted.run();
+    for (int i = 0; i < count; i++) {
+        stack_data a = interp.pop();
+        stack_data b = jitted.pop();
+        assert(a.get_data() == b.get_data());
+        assert(a.get_d_type() == b.get_d_type());
+    }
+}
+
+void test_jit() {
+    std::cout << "Testing JIT..." << std::endl;
+    // acc = sum over i = 50..1 of f(i), where f(x) = x*x/3 + 1 (+100 if below 7).
+    // f is called 50 times, so it is compiled after the threshold is passed.
+    std::vector<uint16_t> bytecode_calls = {
+        OPC_PUSHD16, 0, OPC_PUSHD16, 0, OPC_GSTORE,             // 0: acc = 0
+        OPC_PUSHD16, 50,                                        // 5: i = 50
+        OPC_DUP,                                                // 7: loop
+        OPC_CALL, 42,0,0,0,0,0,0,0,                             // 8: f(i)
+        OPC_PUSHD16, 0, OPC_GLOAD, OPC_ADD,                     // 17
+        OPC_PUSHD16, 0, OPC_GSTORE,                             // 21
+        OPC_PUSHD16, 1, OPC_SUB, OPC_DUP,                       // 24
+        OPC_JNZ, 7,0,0,0,0,0,0,0,                               // 28
+        OPC_POP, OPC_PUSHD16, 0, OPC_GLOAD, OPC_RET,            // 37
+        OPC_DUP, OPC_MUL, OPC_PUSHD16, 3, OPC_DIV,              // 42: f
+        OPC_PUSHD16, 1, OPC_ADD,                                // 47
+        OPC_DUP, OPC_PUSHD16, 7, OPC_LT,                        // 50
+        OPC_JZ, 66,0,0,0,0,0,0,0,                               // 54
+        OPC_PUSHD16, 100, OPC_ADD,                              // 63
+        OPC_RET                                                 // 66
+    };
+    uint64_t expected = 0;
+    for (uint64_t i = 50; i > 0; i--) {
+        uint64_t f = i * i / 3 + 1;
+        expected += f < 7 ? f + 100 : f;
+    }
+    vm_options jit_options;
+    jit_options.enable_jit = true;
+    jit_options.jit_threshold = 5;
+    vm vm_calls(bytecode_calls, jit_options);
+    vm_calls.run();
+    assert(vm_calls.pop().get_data() == expected);
+    check_same_under_jit(bytecode_calls, 1, 5);
+
+    // 128-bit arithmetic and comparisons, including carries across the 64-bit halves.
+    std::vector<uint16_t> bytecode_wide = {
+        OPC_PUSHD128, 0xFFFF,0xFFFF,0xFFFF,0xFFFF,1,0,0,0,
+        OPC_PUSHD64, 1,0,0,0,
+        OPC_ADD,                                    // carry into the high half
+        OPC_DUP,
+        OPC_PUSHD128, 0x1234,0x5678,0x9ABC,0xDEF0,0x1111,0x2222,0,0,
+        OPC_MUL,
+        OPC_DUP,
+        OPC_PUSHD32, 0,1,
+        OPC_SUB,
+        OPC_DUP,
+        OPC_PUSHD16, 7,
+        OPC_DIV,
+        OPC_DUP,
+        OPC_PUSHD8, 3,
+        OPC_GT,
+        OPC_PUSHD16, 5, OPC_PUSHD16, 5, OPC_EQ,
+        OPC_PUSHD128, 0,0,0,0,1,0,0,0, OPC_PUSHD64, 0xFFFF,0xFFFF,0xFFFF,0xFFFF, OPC_LT,
+        OPC_PUSHD128, 0,0,0,0,1,0,0,0, OPC_PUSHD16, 9, (uint16_t)(OPC_LSTORE | 3),
+        OPC_PUSHD16, 9, (uint16_t)(OPC_LLOAD | 3)
+    };
+    check_same_under_jit(bytecode_wide, 8, 0);
+
+    // 128-bit shifts below, across and beyond the 64-bit boundary
+    std::vector<uint16_t> bytecode_shift = {
+        OPC_PUSHD64, 0x1234,0x5678,0x9ABC,0xDEF0, OPC_DUP, OPC_SHLI | 12,
+        OPC_DUP, OPC_SHLI | 70, OPC_DUP, OPC_SHRI | 5, OPC_DUP, OPC_SHRI | 100,
+        OPC_PUSHD16, 1, OPC_SHLI | 127, OPC_DUP, OPC_SHRI | 127, OPC_PUSHD16, 9, OPC_SHLI | 300
+    };
+    check_same_under_jit(bytecode_shift, 8, 0);
+
+    // Compiled loops charge fuel per block and leave native code at slice
+    // boundaries, so budgets and interrupts still apply.
+    std::vector<uint16_t> bytecode_countdown = {
+        OPC_PUSHD32, 0x86A0, 1,                                 // 0: 100000
+        OPC_PUSHD16, 1, OPC_SUB, OPC_DUP, OPC_JNZ, 3,0,0,0,0,0,0,0  // 3: 4 per iteration
+    };
+    jit_options.jit_threshold = 0;
+    vm vm_fuel(bytecode_countdown, jit_options);
+    int slices = 1;
+    while (vm_fuel.run(10000) == vm_status::OUT_OF_FUEL) {
+        slices++;
+    }
+    assert(slices >= 40 && slices <= 41);
+    assert(vm_fuel.depth() == 1 && vm_fuel.pop().get_data() == 0);
+
+    vm vm_spin(std::vector<uint16_t>{OPC_JMP, 0,0,0,0,0,0,0,0}, jit_options);
+    std::thread interrupter([&vm_spin]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        vm_spin.interrupt();
+    });
+    assert(vm_spin.run() == vm_status::INTERRUPTED);
+    interrupter.join();
+
+    std::cout << "JIT Tests Passed!" << std::endl;
+}
+
+void test_module() {
+    std::cout << "Testing Module Files..." << std::endl;
+    // g[5] + g[6], with g[5..6] and g[0x10000] coming from the data section
+    std::vector<uint16_t> code = {
+        OPC_PUSHD16, 5, OPC_GLOAD, OPC_PUSHD16, 6, OPC_GLOAD, OPC_ADD
+    };
+    std::vector<module_data> data = {
+        {5, D_TYPE::BIT_16, {1000, 234}},
+        {0x10000, D_TYPE::BIT_128, {((__uint128_t)7 << 64) | 9}},
+        {4094, D_TYPE::BIT_8, {1, 2, 3, 0x1FF}}
+    };
+    std::vector<uint8_t> bytes = build_module(code, data, {{"main", 0}, {"end", 7}});
+
+    module_view view;
+    std::string error;
+    assert(parse_module(bytes.data(), bytes.size(), view, error));
+    assert(!view.legacy && view.code_size == code.size());
+    std::vector<module_symbol> symbols = view.symbol_table();
+    assert(symbols.size() == 2 && symbols[1].name == "end" && symbols[1].address == 7);
+
+    vm vm_module(view, test_options);
+    vm_module.run();
+    stack_data sum = vm_module.pop();
+    assert(sum.get_data() == 1234 && sum.get_d_type() == D_TYPE::BIT_16);
+    stack_data wide;
+    assert(vm_module.load_global(0x10000, wide));
+    assert(wide.get_data() == (((__uint128_t)7 << 64) | 9) && wide.get_d_type() == D_TYPE::BIT_128);
+    // A record crossing a page boundary, with values cut to the record width
+    stack_data byte;
+    assert(vm_module.load_global(4096, byte) && byte.get_data() == 3 && byte.get_d_type() == D_TYPE::BIT_8);
+    assert(vm_module.load_global(4097, byte) && byte.get_data() == 0xFF);
+
+    // Headerless bytecode is still accepted as a bare code section
+    std::vector<uint16_t> legacy = { OPC_PUSHD16, 42 };
+    assert(parse_module(reinterpret_cast<const uint8_t*>(legacy.data()), legacy.size() * 2, view, error));
+    assert(view.legacy && view.code_size == 2);
+
+    // Sections past the end of the file and unknown versions are rejected
+    std::vector<uint8_t> truncated(bytes.begin(), bytes.end() - 8);
+    assert(!parse_module(truncated.data(), truncated.size(), view, error));
+    std::vector<uint8_t> future = bytes;
+    future[4] = 2;
+    assert(!parse_module(future.data(), future.size(), view, error));
+
+    // Round trip through a mapped file
+    const char* path = "module_test.dvm";
+    FILE* file = std::fopen(path, "wb");
+    assert(file != nullptr);
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+    mapped_module mapped;
+    assert(mapped.open(path, error));
+    vm vm_mapped(mapped.view(), test_options);
+    vm_mapped.run();
+    assert(vm_mapped.pop().get_data() == 1234);
+    std::remove(path);
+
+    std::cout << "Module File Tests Passed!" << std::endl;
+}
+
+// Moves 40 x 4096 bytes through `fd` with read (syscall 0) or write (syscall 1),
+// keeping the running total in g[5000]. 160 KiB is more than a pipe holds, so
+// producers and consumers have to take turns.
+std::vector<uint16_t> make_pump(uint16_t syscall, int fd) {
+    return {
+        OPC_PUSHD16, 4096, OPC_PUSHD16, 0, OPC_PUSHD16, (uint16_t)fd, (uint16_t)(OPC_SYSCALL | syscall), // 0
+        OPC_GLOADI, 5000, OPC_ADD, OPC_DUP, OPC_GSTOREI, 5000,                                          // 7
+        OPC_PUSHD32, 0x8000, 0x2, OPC_LT,                                                              // 13: 163840
+        OPC_JNZ, 0,0,0,0,0,0,0,0                                                                       // 17
+    };
+}
+
+void test_event_loop() {
+    std::cout << "Testing Event Loop..." << std::endl;
+    vm_options host_options = test_options;
+    host_options.nonblocking_io = true;
+
+    // A read on an empty non-blocking pipe suspends run() at the syscall
+    int fds[2];
+    assert(pipe2(fds, O_NONBLOCK) == 0);
+    std::vector<uint16_t> bytecode_wait = {
+        OPC_PUSHD16, 7, OPC_PUSHD16, 10, OPC_PUSHD16, (uint16_t)fds[0], OPC_SYSCALL | 0
+    };
+    vm waiting(bytecode_wait, host_options);
+    assert(waiting.run() == vm_status::WAITING);
+    assert(waiting.waiting_fd() == fds[0] && !waiting.waiting_for_write());
+    assert(write(fds[1], "x", 1) == 1);
+    assert(waiting.run() == vm_status::HALTED);
+    assert(waiting.pop().get_data() == 1);
+    stack_data got;
+    assert(waiting.load_global(10, got) && got.get_data() == 'x');
+    close(fds[0]);
+    close(fds[1]);
+
+    // Many producer/consumer pairs over pipes and socketpairs on one thread
+    const int pairs = 64;
+    event_loop loop;
+    std::vector<std::unique_ptr<vm>> machines;
+    std::vector<int> open_fds;
+    for (int i = 0; i < pairs; i++) {
+        if (i % 2 == 0) {
+            assert(pipe2(fds, O_NONBLOCK) == 0);
+        } else {
+            assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+        }
+        open_fds.insert(open_fds.end(), {fds[0], fds[1]});
+        machines.emplace_back(new vm(make_pump(0, fds[0]), host_options));
+        machines.emplace_back(new vm(make_pump(1, fds[1]), host_options));
+    }
+    for (auto& machine : machines) {
+        loop.add(machine.get());
+    }
+    assert(loop.run() == machines.size());
+    assert(loop.waiting() == 0);
+    for (auto& machine : machines) {
+        assert(machine->load_global(5000, got) && got.get_data() == 163840);
+    }
+    for (int fd : open_fds) {
+        close(fd);
+    }
+
+    // Traps and interrupts leave the loop without counting as halted, and are reported to the caller
+    event_loop stopping;
+    vm halts(std::vector<uint16_t>{OPC_PUSHD8, 1}, host_options);
+    vm traps(std::vector<uint16_t>{OPC_POP}, host_options);
+    vm interrupted(std::vector<uint16_t>{OPC_JMP, 0,0,0,0,0,0,0,0}, host_options);
+    interrupted.interrupt();
+    stopping.add(&halts);
+    stopping.add(&traps);
+    stopping.add(&interrupted);
+    std::map<vm*, vm_status> reported;
+    assert(stopping.run([&](vm& machine, vm_status status) { reported[&machine] = status; }) == 1);
+    assert(reported.size() == 3 && reported[&halts] == vm_status::HALTED);
+    assert(reported[&traps] == vm_status::TRAPPED && reported[&interrupted] == vm_status::INTERRUPTED);
+
+    std::cout << "Event Loop Tests Passed!" << std::endl;
+}
+
+void test_shared_module() {
+    std::cout << "Testing Shared Modules..." << std::endl;
+    // Sums 1..n for the n pushed before run(), accumulating in g[0]
+    std::vector<uint16_t> code = {
+        OPC_DUP, OPC_GLOADI, 0, OPC_ADD, OPC_GSTOREI, 0,   // 0
+        OPC_PUSHD16, 1, OPC_SUB, OPC_JNZK, 0,0,0,0,0,0,0,0, // 6
+        OPC_POP, OPC_GLOADI, 0                             // 18
+    };
+    std::shared_ptr<const vm_module> module = vm_module::create(code);
+
+    // Instances on several threads share the decoded code but not their state
+    const int threads = 4;
+    const int runs = 50;
+    std::atomic<int> failures(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t]() {
+            for (int i = 0; i < runs; i++) {
+                uint64_t n = 100 + t * runs + i;
+                vm machine(module, test_options);
+                machine.push(stack_data(D_TYPE::BIT_64, n));
+                machine.run();
+                if (machine.depth() != 1 || machine.pop().get_data() != n * (n + 1) / 2) {
+                    failures++;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+    assert(failures == 0);
+    assert(module.use_count() == 1);
+
+    // Every instance starts from the module's data section
+    std::vector<uint8_t> bytes = build_module({OPC_GLOADI, 9, OPC_ADDI, 1, OPC_GSTOREI, 9}, {{9, D_TYPE::BIT_16, {41}}});
+    module_view view;
+    std::string error;
+    assert(parse_module(bytes.data(), bytes.size(), view, error));
+    std::shared_ptr<const vm_module> with_data = vm_module::create(view);
+    bytes.clear();
+    for (int i = 0; i < 2; i++) {
+        vm machine(with_data, test_options);
+        machine.run();
+        stack_data value;
+        assert(machine.load_global(9, value) && value.get_data() == 42);
+    }
+
+    std::cout << "Shared Module Tests Passed!" << std::endl;
+}
+
+void test_fibers() {
+    std::cout << "Testing Fibers..." << std::endl;
+    // The spawned fiber gets the argument on its own stack; join returns its TOS
+    std::vector<uint16_t> bytecode_join = {
+        OPC_PUSHD16, 20, OPC_SPAWN, 13,0,0,0,0,0,0,0,   // 0
+        OPC_JOIN, 0 /* halt */,                         // 11
+        OPC_ADDI, 1, OPC_RET                            // 13: fiber body
+    };
+    vm vm_join(bytecode_join, test_options);
+    assert(vm_join.run() == vm_status::HALTED);
+    assert(vm_join.depth() == 1 && vm_join.pop().get_data() == 21);
+    assert(vm_join.fiber_id() == 0);
+
+    // Two workers append their argument to a log at g[1..] and yield after each
+    // entry, so their entries interleave in spawn order.
+    std::vector<uint16_t> bytecode_yield = {
+        OPC_PUSHD8, 1, OPC_SPAWN, 32,0,0,0,0,0,0,0, OPC_POP,   // 0
+        OPC_PUSHD8, 2, OPC_SPAWN, 32,0,0,0,0,0,0,0, OPC_POP,   // 12
+        OPC_PUSHD8, 1, OPC_JOIN, OPC_POP,                      // 24
+        OPC_PUSHD8, 2, OPC_JOIN, 0 /* halt */,                 // 28
+        // 32: worker, twice: g[g[0] + 1] = tag; g[0]++; yield
+        OPC_DUP, OPC_GLOADI, 0, OPC_ADDI, 1, OPC_GSTORE, OPC_GLOADI, 0, OPC_ADDI, 1, OPC_GSTOREI, 0, OPC_YIELD,
+        OPC_DUP, OPC_GLOADI, 0, OPC_ADDI, 1, OPC_GSTORE, OPC_GLOADI, 0, OPC_ADDI, 1, OPC_GSTOREI, 0, OPC_YIELD,
+        OPC_RET                                                // 58
+    };
+    vm vm_yield(bytecode_yield, test_options);
+    vm_yield.run();
+    assert(vm_yield.depth() == 1 && vm_yield.pop().get_data() == 2);
+    const uint64_t expected_log[] = {4, 1, 2, 1, 2};
+    for (uint64_t i = 0; i < 5; i++) {
+        stack_data value;
+        assert(vm_yield.load_global(i, value) && value.get_data() == expected_log[i]);
+    }
+
+    // Fiber 1 spins until fiber 2 sets g[5]; only preemption lets fiber 2 run
+    std::vector<uint16_t> bytecode_preempt = {
+        OPC_PUSHD8, 0, OPC_SPAWN, 25,0,0,0,0,0,0,0,            // 0
+        OPC_PUSHD8, 0, OPC_SPAWN, 40,0,0,0,0,0,0,0, OPC_POP,   // 11
+        OPC_JOIN, 0 /* halt */,                                // 23
+        OPC_POP, OPC_GLOADI, 5, OPC_JZ, 26,0,0,0,0,0,0,0,      // 25: fiber 1
+        OPC_PUSHD16, 7, OPC_RET,                               // 37
+        OPC_POP, OPC_PUSHD8, 1, OPC_GSTOREI, 5, OPC_RET        // 40: fiber 2
+    };
+    vm_options options = test_options;
+    options.fiber_time_slice = 50;
+    vm vm_preempt(bytecode_preempt, options);
+    vm_preempt.run();
+    assert(vm_preempt.depth() == 1 && vm_preempt.pop().get_data() == 7);
+
+    // spawn ends a block, so the 5 instructions before it are charged as well:
+    // 7 instructions per iteration, and the budget may overrun by one block
+    std::vector<uint16_t> bytecode_spawn_fuel = {
+        OPC_GLOADI, 0, OPC_ADDI, 1, OPC_GSTOREI, 0,            // 0
+        OPC_PUSHD8, 0, OPC_SPAWN, 27,0,0,0,0,0,0,0, OPC_POP,   // 6
+        OPC_JMP, 0,0,0,0,0,0,0,0,                              // 18
+        OPC_RET                                                // 27: fiber body
+    };
+    vm vm_spawn_fuel(bytecode_spawn_fuel, test_options);
+    assert(vm_spawn_fuel.run(700) == vm_status::OUT_OF_FUEL);
+    stack_data iterations;
+    assert(vm_spawn_fuel.load_global(0, iterations));
+    assert(iterations.get_data() >= 50 && iterations.get_data() <= 101);
+
+    std::cout << "Fiber Tests Passed!" << std::endl;
+}
+
+void test_scheduler() {
+    std::cout << "Testing Scheduler..." << std::endl;
+    // Same sum program as test_shared_module: 7 instructions per iteration
+    std::vector<uint16_t> code = {
+        OPC_DUP, OPC_GLOADI, 0, OPC_ADD, OPC_GSTOREI, 0,   // 0
+        OPC_PUSHD16, 1, OPC_SUB, OPC_JNZK, 0,0,0,0,0,0,0,0, // 6
+        OPC_POP, OPC_GLOADI, 0                             // 18
+    };
+    std::shared_ptr<const vm_module> module = vm_module::create(code);
+
+    // run(max_instructions) stops at a branch once the budget is spent and
+    // resumes there on the next call
+    vm sliced(module, test_options);
+    sliced.push(stack_data(D_TYPE::BIT_64, 1000));
+    int runs = 1;
+    while (sliced.run(500) == vm_status::OUT_OF_FUEL) {
+        runs++;
+    }
+    assert(sliced.depth() == 1 && sliced.pop().get_data() == 500500);
+    assert(runs >= 14 && runs <= 15);  // 7002 instructions in slices of 500
+
+    // Jobs of very different lengths, sliced across several workers
+    std::atomic<int> correct(0);
+    const int jobs = 200;
+    {
+        vm_scheduler scheduler(3, 1000);
+        for (int i = 0; i < jobs; i++) {
+            uint64_t n = i % 10 == 0 ? 20000 : 10 + i;
+            std::unique_ptr<vm> machine(new vm(module, test_options));
+            machine->push(stack_data(D_TYPE::BIT_64, n));
+            scheduler.submit(std::move(machine), [&correct, n](vm& done, vm_status status) {
+                if (status == vm_status::HALTED && done.depth() == 1 && done.pop().get_data() == n * (n + 1) / 2) {
+                    correct++;
+                }
+            });
+        }
+        scheduler.wait();
+        vm_scheduler::stats stats = scheduler.statistics();
+        assert(stats.jobs == jobs);
+        assert(stats.slices > stats.jobs);  // the long jobs needed several slices
+        assert(scheduler.worker_count() == 3);
+    }
+    assert(correct == jobs);
+
+    std::cout << "Scheduler Tests Passed!" << std::endl;
+}
+
+void test_traps() {
+    std::cout << "Testing Traps and Interrupts..." << std::endl;
+    // Errors stop run() with TRAPPED instead of exiting, and stay trapped
+    vm vm_div(std::vector<uint16_t>{OPC_PUSHD16, 1, OPC_PUSHD16, 0, OPC_DIV, OPC_PUSHD16, 9}, test_options);
+    assert(vm_div.run() == vm_status::TRAPPED);
+    assert(vm_div.trap() == vm_trap::DIVISION_BY_ZERO);
+    assert(vm_div.pc_address() == 4);
+    assert(vm_div.run() == vm_status::TRAPPED);
+    assert(vm_div.depth() == 2);
+
+    vm vm_underflow(std::vector<uint16_t>{OPC_PUSHD16, 1, OPC_ADD}, test_options);
+    assert(vm_underflow.run() == vm_status::TRAPPED && vm_underflow.trap() == vm_trap::STACK_UNDERFLOW);
+
+    vm_options small = test_options;
+    small.stack_capacity = 2;
+    vm vm_overflow(std::vector<uint16_t>{OPC_PUSHD8, 1, OPC_PUSHD8, 2, OPC_PUSHD8, 3}, small);
+    assert(vm_overflow.run() == vm_status::TRAPPED && vm_overflow.trap() == vm_trap::STACK_OVERFLOW);
+
+    vm vm_global(std::vector<uint16_t>{OPC_PUSHD128, 0,0,0,0,1,0,0,0, OPC_GLOAD}, test_options);
+    assert(vm_global.run() == vm_status::TRAPPED && vm_global.trap() == vm_trap::GLOBAL_RANGE);
+
+    // Stores and bulk operations keep their operands on the stack when they trap
+    vm vm_gstore(std::vector<uint16_t>{OPC_PUSHD8, 7, OPC_PUSHD128, 0,0,0,0,1,0,0,0, OPC_GSTORE}, test_options);
+    assert(vm_gstore.run() == vm_status::TRAPPED && vm_gstore.trap() == vm_trap::GLOBAL_RANGE);
+    assert(vm_gstore.pc_address() == 11 && vm_gstore.depth() == 2);
+    assert(vm_gstore.pop().get_d_type() == D_TYPE::BIT_128 && vm_gstore.pop().get_data() == 7);
+    vm vm_gfill(std::vector<uint16_t>{OPC_PUSHD8, 1, OPC_PUSHD8, 2, OPC_PUSHD128, 0,0,0,0,1,0,0,0, OPC_GFILL},
+                test_options);
+    assert(vm_gfill.run() == vm_status::TRAPPED && vm_gfill.trap() == vm_trap::GLOBAL_RANGE);
+    assert(vm_gfill.depth() == 3);
+    vm_gfill.pop();
+    assert(vm_gfill.pop().get_data() == 2 && vm_gfill.pop().get_data() == 1);
+
+    vm vm_local(std::vector<uint16_t>{OPC_PUSHD8, 0, OPC_LLOAD | 3}, test_options);
+    assert(vm_local.run() == vm_status::TRAPPED && vm_local.trap() == vm_trap::LOCAL_RANGE);
+    // Local stores past the segment limit trap instead of growing the arena without bound
+    vm vm_huge_local(std::vector<uint16_t>{
+        OPC_PUSHD8, 7, OPC_PUSHD32, 0x2800, 0xEE6B, OPC_LSTORE | 1   // address 4,000,000,000
+    }, test_options);
+    assert(vm_huge_local.run() == vm_status::TRAPPED && vm_huge_local.trap() == vm_trap::LOCAL_RANGE);
+    vm_options limited = test_options;
+    limited.local_segment_limit = 16;
+    vm vm_limit(std::vector<uint16_t>{
+        OPC_PUSHD8, 7, OPC_PUSHD8, 15, OPC_LSTORE | 1,
+        OPC_PUSHD8, 7, OPC_PUSHD8, 16, OPC_LSTORE | 1
+    }, limited);
+    assert(vm_limit.run() == vm_status::TRAPPED && vm_limit.trap() == vm_trap::LOCAL_RANGE);
+    assert(vm_limit.depth() == 2 && vm_limit.pop().get_data() == 16);
+
+    // Fiber errors: joining an unknown fiber, and a join cycle; the fiber id stays on the stack
+    vm vm_bad_join(std::vector<uint16_t>{OPC_PUSHD8, 5, OPC_JOIN}, test_options);
+    assert(vm_bad_join.run() == vm_status::TRAPPED && vm_bad_join.trap() == vm_trap::BAD_FIBER);
+    assert(vm_bad_join.depth() == 1 && vm_bad_join.pop().get_data() == 5);
+    vm vm_deadlock(std::vector<uint16_t>{
+        OPC_PUSHD8, 0, OPC_SPAWN, 13,0,0,0,0,0,0,0,   // 0
+        OPC_JOIN, 0 /* halt */,                       // 11
+        OPC_JOIN, OPC_RET                             // 13: fiber 1 joins fiber 0
+    }, test_options);
+    assert(vm_deadlock.run() == vm_status::TRAPPED && vm_deadlock.trap() == vm_trap::DEADLOCK);
+    // The failed join leaves fiber 1's operand on its stack
+    assert(vm_deadlock.fiber_id() == 1 && vm_deadlock.depth() == 1 && vm_deadlock.pop().get_data() == 0);
+
+    // SYS_exit halts with an exit code instead of ending the process
+    vm vm_exit(std::vector<uint16_t>{OPC_PUSHD8, 3, OPC_SYSCALL | 60, OPC_PUSHD8, 1}, test_options);
+    assert(vm_exit.run() == vm_status::HALTED);
+    assert(vm_exit.exited() && vm_exit.exit_code() == 3 && vm_exit.depth() == 0);
+    assert(vm_exit.run() == vm_status::HALTED && vm_exit.depth() == 0);
+
+    // Another thread can interrupt an endless loop; the VM resumes afterwards
+    vm vm_loop(std::vector<uint16_t>{OPC_GLOADI, 0, OPC_ADDI, 1, OPC_GSTOREI, 0, OPC_JMP, 0,0,0,0,0,0,0,0}, test_options);
+    std::thread interrupter([&vm_loop]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        vm_loop.interrupt();
+    });
+    assert(vm_loop.run() == vm_status::INTERRUPTED);
+    interrupter.join();
+    stack_data before, after;
+    assert(vm_loop.load_global(0, before) && before.get_data() > 0);
+    assert(vm_loop.run(4000) == vm_status::OUT_OF_FUEL);
+    // 4 instructions per iteration; the budget may overrun by one basic block
+    assert(vm_loop.load_global(0, after));
+    assert(after.get_data() >= before.get_data() + 1000 && after.get_data() <= before.get_data() + 1001);
+
+    // Straight-line code is charged when it falls into a label, and long blocks are split at 255:
+    // a loop with a 1000-instruction body doesn't run 1000 instructions per 255 charged
+    std::vector<uint16_t> bytecode_long = {OPC_PUSHD64, 0, 0, 0, 0};
+    for (int i = 0; i < 200; i++) {
+        bytecode_long.insert(bytecode_long.end(), {OPC_ADDI, 1});
+    }
+    const uint16_t loop_address = static_cast<uint16_t>(bytecode_long.size());
+    for (int i = 0; i < 1000; i++) {
+        bytecode_long.insert(bytecode_long.end(), {OPC_ADDI, 1});
+    }
+    bytecode_long.insert(bytecode_long.end(), {OPC_JMP, loop_address, 0, 0, 0, 0, 0, 0, 0});
+    vm vm_prefix(bytecode_long, test_options);
+    assert(vm_prefix.run(100) == vm_status::OUT_OF_FUEL);
+    assert(vm_prefix.pop().get_data() == 200);
+    vm vm_long(bytecode_long, test_options);
+    assert(vm_long.run(10000) == vm_status::OUT_OF_FUEL);
+    assert(vm_long.pop().get_data() <= 10000 + 255);
+
+    std::cout << "Trap and Interrupt Tests Passed!" << std::endl;
+}
+
+void test_snapshot() {
+    std::cout << "Testing Snapshots..." << std::endl;
+    // Fills g[0..10000) and a wide cell on another page, then stops inside a call
+    // with a local and a caller value live.
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD16, 0, OPC_PUSHD16, 42, OPC_PUSHD16, 10000, OPC_GFILL,  // 0
+        OPC_PUSHD128, 1,2,3,4,5,6,7,8, OPC_PUSHD16, 20000, OPC_GSTORE,   // 7
+        OPC_PUSHD8, 5,                                                   // 19
+        OPC_CALL, 31,0,0,0,0,0,0,0,                                      // 21
+        0 /* halt */,                                                    // 30
+        OPC_PUSHD8, 9, OPC_PUSHD8, 3, OPC_LSTORE | 1,                    // 31: l1[3] = 9
+        OPC_PUSHD8, 3, OPC_LLOAD | 1, OPC_ADD,                           // 36: breakpoint
+        OPC_PUSHD16, 9999, OPC_GLOAD, OPC_ADD,                           // 40
+        OPC_PUSHD16, 20000, OPC_GLOAD, OPC_RET                           // 44
+    };
+    std::shared_ptr<const vm_module> module = vm_module::create(bytecode);
+    assert(module->with_breakpoint(37) == nullptr); // pushd8's data word
+    std::shared_ptr<const vm_module> stopped = module->with_breakpoint(36);
+    assert(stopped != nullptr);
+
+    vm original(stopped, test_options);
+    assert(original.run() == vm_status::BREAKPOINT);
+    assert(original.pc_address() == 36 && original.depth() == 1);
+
+    const char* path = "snapshot_test.snap";
+    std::string error;
+    assert(original.save_snapshot(path, error));
+
+    auto check_result = [](vm& machine, uint64_t expected) {
+        assert(machine.run() == vm_status::HALTED);
+        stack_data wide = machine.pop();
+        assert(wide.get_d_type() == D_TYPE::BIT_128 && (uint64_t)(wide.get_data() >> 64) == 0x0008000700060005ull);
+        assert(machine.pop().get_data() == expected);
+    };
+
+    std::unique_ptr<vm> resumed = vm::restore_snapshot(path, test_options, error);
+    assert(resumed != nullptr);
+    stack_data cell;
+    assert(resumed->load_global(0, cell) && cell.get_data() == 42);
+    check_result(*resumed, 5 + 9 + 42);
+
+    // Writes to restored memory stay private to that VM and never reach the file
+    std::unique_ptr<vm> modified = vm::restore_snapshot(path, test_options, error);
+    assert(modified != nullptr);
+    assert(modified->store_global(9999, stack_data(D_TYPE::BIT_8, 1)));
+    assert(modified->store_global(4096 * 100, stack_data(D_TYPE::BIT_8, 1)));
+    check_result(*modified, 5 + 9 + 1);
+    std::unique_ptr<vm> again = vm::restore_snapshot(path, test_options, error);
+    assert(again != nullptr);
+    assert(again->load_global(4096 * 100, cell) && cell.get_data() == 0);
+    check_result(*again, 5 + 9 + 42);
+
+    // Fibers: stop inside the spawned fiber, resume and join it
+    std::vector<uint16_t> bytecode_fiber = {
+        OPC_PUSHD16, 20, OPC_SPAWN, 13,0,0,0,0,0,0,0,   // 0
+        OPC_JOIN, 0 /* halt */,                         // 11
+        OPC_ADDI, 1, OPC_RET                            // 13: fiber body
+    };
+    vm fiber_original(vm_module::create(bytecode_fiber)->with_breakpoint(13), test_options);
+    assert(fiber_original.run() == vm_status::BREAKPOINT && fiber_original.fiber_id() == 1);
+    assert(fiber_original.save_snapshot(path, error));
+    std::unique_ptr<vm> fiber_resumed = vm::restore_snapshot(path, test_options, error);
+    assert(fiber_resumed != nullptr && fiber_resumed->fiber_id() == 1);
+    assert(fiber_resumed->run() == vm_status::HALTED);
+    assert(fiber_resumed->depth() == 1 && fiber_resumed->pop().get_data() == 21);
+
+    // A corrupted stack capacity is rejected before anything is allocated.
+    // The capacity follows exit_requested, exit_status and pc at the start of the state section.
+    snapshot_header header;
+    std::ifstream header_in(path, std::ios::binary);
+    assert(header_in.read(reinterpret_cast<char*>(&header), sizeof(header)));
+    header_in.close();
+    for (uint64_t capacity : {UINT64_MAX, uint64_t(1) << 40, uint64_t(vm::MAX_STACK_CAPACITY) + 1}) {
+        FILE* corrupt = std::fopen(path, "r+b");
+        assert(corrupt != nullptr);
+        std::fseek(corrupt, header.state.offset + 1 + 4 + 16, SEEK_SET);
+        assert(std::fwrite(&capacity, sizeof(capacity), 1, corrupt) == 1);
+        std::fclose(corrupt);
+        assert(vm::restore_snapshot(path, test_options, error) == nullptr);
+        assert(error == "corrupt snapshot state");
+    }
+
+    // Truncated and foreign files are rejected, and trapped VMs can't be saved
+    FILE* file = std::fopen(path, "r+b");
+    assert(file != nullptr);
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fclose(file);
+    assert(truncate(path, size / 2) == 0);
+    assert(vm::restore_snapshot(path, test_options, error) == nullptr);
+    assert(truncate(path, 0) == 0);
+    assert(vm::restore_snapshot(path, test_options, error) == nullptr);
+    assert(vm::restore_snapshot("no_such_snapshot.snap", test_options, error) == nullptr);
+
+    vm trapped(std::vector<uint16_t>{OPC_POP}, test_options);
+    assert(trapped.run() == vm_status::TRAPPED);
+    assert(!trapped.save_snapshot(path, error));
+    std::remove(path);
+
+    std::cout << "Snapshot Tests Passed!" << std::endl;
+}
+
+void test_profiler() {
+    std::cout << "Testing Profiler..." << std::endl;
+    // 200 iterations of main calling a hot function (153 instructions per call)
+    // and a cold one (9 per call)
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD16, 200,                                         // 0
+        OPC_CALL, 34,0,0,0,0,0,0,0,                               // 2
+        OPC_CALL, 50,0,0,0,0,0,0,0,                               // 11
+        OPC_PUSHD8, 1, OPC_SUB, OPC_JNZK, 2,0,0,0,0,0,0,0,        // 20
+        OPC_POP, 0 /* halt */,                                    // 32
+        OPC_PUSHD8, 50, OPC_PUSHD8, 1, OPC_SUB, OPC_JNZK, 36,0,0,0,0,0,0,0, OPC_POP, OPC_RET, // 34: hot
+        OPC_PUSHD8, 2, OPC_PUSHD8, 1, OPC_SUB, OPC_JNZK, 52,0,0,0,0,0,0,0, OPC_POP, OPC_RET   // 50: cold
+    };
+    vm_profiler profiler(101);
+    vm machine(bytecode, test_options);
+    machine.set_profiler(&profiler);
+    assert(machine.run() == vm_status::HALTED && machine.depth() == 0);
+    assert(profiler.samples() > 250 && profiler.samples() < 420);
+
+    std::ostringstream collapsed;
+    profiler.write_collapsed(collapsed, {{"hot", 34}});
+    std::map<std::string, uint64_t> stacks;
+    std::istringstream lines(collapsed.str());
+    std::string stack;
+    uint64_t count, total = 0;
+    while (lines >> stack >> count) {
+        stacks[stack] = count;
+        total += count;
+    }
+    assert(total == profiler.samples());
+    assert(stacks["main;hot"] > total * 8 / 10);
+    assert(stacks["main;hot"] > 5 * stacks["main;fn_50"]);
+    for (const auto& entry : stacks) {
+        assert(entry.first == "main" || entry.first == "main;hot" || entry.first == "main;fn_50");
+    }
+
+    std::ostringstream report;
+    profiler.write_report(report, {{"hot", 34}});
+    assert(report.str().find("36-39           hot+2") != std::string::npos); // the hot loop body
+
+    // Sampling splits time slices but fibers still switch every fiber_time_slice
+    std::vector<uint16_t> bytecode_preempt = {
+        OPC_PUSHD8, 0, OPC_SPAWN, 25,0,0,0,0,0,0,0,
+        OPC_PUSHD8, 0, OPC_SPAWN, 40,0,0,0,0,0,0,0, OPC_POP,
+        OPC_JOIN, 0,
+        OPC_POP, OPC_GLOADI, 5, OPC_JZ, 26,0,0,0,0,0,0,0,
+        OPC_PUSHD16, 7, OPC_RET,
+        OPC_POP, OPC_PUSHD8, 1, OPC_GSTOREI, 5, OPC_RET
+    };
+    vm_options options = test_options;
+    options.fiber_time_slice = 500;
+    vm_profiler fiber_profiler(7);
+    vm vm_preempt(bytecode_preempt, options);
+    vm_preempt.set_profiler(&fiber_profiler);
+    assert(vm_preempt.run() == vm_status::HALTED);
+    assert(vm_preempt.depth() == 1 && vm_preempt.pop().get_data() == 7);
+    assert(fiber_profiler.samples() > 0);
+
+    std::cout << "Profiler Tests Passed!" << std::endl;
+}
+
+void test_trace() {
+    std::cout << "Testing Trace..." << std::endl;
+    // Count down from 3, then call a function that divides by zero (17 instructions)
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD8, 3,                                 // 0
+        OPC_PUSHD8, 1, OPC_SUB, OPC_DUP,               // 2: loop
+        OPC_JNZ, 2,0,0,0,0,0,0,0,                      // 6
+        OPC_CALL, 25,0,0,0,0,0,0,0,                    // 15
+        0 /* halt */,                                  // 24
+        OPC_PUSHD8, 7, OPC_PUSHD8, 0, OPC_DIV, OPC_RET // 25: f
+    };
+    const std::vector<module_symbol> symbols = {{"loop", 2}, {"f", 25}};
+
+    // The capacity is rounded up to 8; fuel limits and the JIT don't change what is recorded
+    vm_options options = test_options;
+    options.trace_capacity = 5;
+    options.enable_jit = true;
+    options.jit_threshold = 0;
+    vm machine(bytecode, options);
+    assert(machine.tracing());
+    assert(machine.run(4) == vm_status::OUT_OF_FUEL);
+    assert(machine.run() == vm_status::TRAPPED && machine.trap() == vm_trap::DIVISION_BY_ZERO);
+    // Oversized capacities are clamped instead of overflowing the rounding
+    vm_options huge_options = test_options;
+    huge_options.trace_capacity = SIZE_MAX;
+    vm huge(bytecode, huge_options);
+    assert(huge.tracing());
+
+    const char* path = "trace_test.trace";
+    std::string error;
+    assert(machine.write_trace(path, symbols, error));
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::remove(path);
+    trace_view trace;
+    assert(parse_trace(bytes.data(), bytes.size(), trace, error));
+    assert(trace.total == 17 && trace.count == 8);
+    assert(trace.trap == static_cast<uint8_t>(vm_trap::DIVISION_BY_ZERO));
+    assert(trace.module.code_size == bytecode.size() && trace.module.symbol_count == 2);
+    const uint32_t addresses[8] = {2, 4, 5, 6, 15, 25, 27, 29};
+    for (size_t i = 0; i < 8; i++) {
+        assert(trace.records[i].pc == addresses[i]);
+    }
+    const trace_record& last = trace.records[7];
+    assert(last.opcode == OP_DIV && last.depth == 3 && last.tos == 0 && last.d_type == D_TYPE::BIT_8);
+    assert(trace.records[6].tos == 7 && trace.records[6].depth == 2);
+
+    std::map<uint64_t, std::string> labels = address_labels(symbols);
+    std::string text;
+    assert(disassemble(trace.module.code, trace.module.code_size, 6, labels, text) == 9 && text == "jnz loop");
+    assert(disassemble(trace.module.code, trace.module.code_size, 15, labels, text) == 9 && text == "call f");
+    assert(disassemble(trace.module.code, trace.module.code_size, 25, labels, text) == 2 && text == "pushd8 7");
+    assert(address_location(labels, 29) == "f+4" && address_location(labels, 0) == "0");
+
+    // Corrupt files are rejected
+    bytes[0] = 'X';
+    assert(!parse_trace(bytes.data(), bytes.size(), trace, error));
+
+    // Without tracing nothing is recorded
+    vm untraced(bytecode, test_options);
+    assert(!untraced.tracing());
+    assert(untraced.run() == vm_status::TRAPPED);
+    assert(!untraced.write_trace(path, symbols, error));
+
+    std::cout << "Trace Tests Passed!" << std::endl;
+}
+
+void run_suite() {
     test_arithmetic();
     test_stack_ops();
     test_control_flow();
@@ -269,6 +1360,27 @@ int main() {
     test_memory();
     test_push();
     test_syscall();
+    test_superinstructions();
+    test_module();
+    test_event_loop();
+    test_shared_module();
+    test_fibers();
+    test_scheduler();
+    test_traps();
+    test_snapshot();
+    test_profiler();
+    test_trace();
+}
+
+int main() {
+    std::cout << "=== Interpreter ===" << std::endl;
+    run_suite();
+
+    std::cout << "=== JIT ===" << std::endl;
+    test_options.enable_jit = true;
+    test_options.jit_threshold = 0;
+    run_suite();
+    test_jit();
 
     std::cout << "\nAll tests passed successfully!" << std::endl;
     return 0;
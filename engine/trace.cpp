@@ -0,0 +1,95 @@
+#include "trace.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+size_t align_to(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+bool in_file(const module_section& section, size_t file_size) {
+    return section.offset % 8 == 0 && section.offset <= file_size && section.size <= file_size - section.offset;
+}
+
+} // namespace
+
+bool vm::write_trace(const std::string& path, const std::vector<module_symbol>& symbols, std::string& error) const {
+    if (!trace_ring) {
+        error = "tracing is not enabled";
+        return false;
+    }
+    // 링 버퍼의 명령어 인덱스를 바이트코드 주소로 바꾸고 오래된 것부터 늘어놓습니다.
+    uint64_t count = std::min<uint64_t>(trace_count, trace_mask + 1);
+    std::vector<trace_record> records(count);
+    for (uint64_t i = 0; i < count; i++) {
+        trace_record record = trace_ring[(trace_count - count + i) & trace_mask];
+        record.pc = static_cast<uint32_t>(program.addresses[record.pc]);
+        records[i] = record;
+    }
+    std::vector<uint8_t> image = build_module(module->bytecode(), {}, symbols);
+
+    trace_header header = {};
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.module = {sizeof(header), image.size()};
+    header.records = {align_to(header.module.offset + header.module.size, 8), count * sizeof(trace_record)};
+    header.total = trace_count;
+    header.trap = static_cast<uint8_t>(trap_reason);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        error = "could not open " + path;
+        return false;
+    }
+    static const char zeros[8] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(image.data()), image.size());
+    out.write(zeros, header.records.offset - header.module.offset - header.module.size);
+    out.write(reinterpret_cast<const char*>(records.data()), header.records.size);
+    out.close();
+    if (!out) {
+        std::remove(path.c_str());
+        error = "could not write " + path;
+        return false;
+    }
+    return true;
+}
+
+bool parse_trace(const uint8_t* bytes, size_t size, trace_view& out, std::string& error) {
+    trace_header header;
+    if (size < sizeof(header)) {
+        error = "not a trace file";
+        return false;
+    }
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        error = "not a trace file";
+        return false;
+    }
+    if (header.version != TRACE_VERSION) {
+        error = "unsupported trace version " + std::to_string(header.version);
+        return false;
+    }
+    if (!in_file(header.module, size) || !in_file(header.records, size) ||
+        header.records.size % sizeof(trace_record) != 0) {
+        error = "trace section out of range";
+        return false;
+    }
+    if (!parse_module(bytes + header.module.offset, header.module.size, out.module, error)) {
+        return false;
+    }
+    if (out.module.legacy) {
+        error = "trace has no module header";
+        return false;
+    }
+    out.records = reinterpret_cast<const trace_record*>(bytes + header.records.offset);
+    out.count = header.records.size / sizeof(trace_record);
+    out.total = header.total;
+    out.trap = header.trap;
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "module_file.h"
+
+// 실행 추적 기록 하나. run()은 명령어를 실행하기 직전의 상태를 링 버퍼에 씁니다.
+// 링 버퍼에서 pc는 디코딩된 명령어 인덱스이고, 추적 파일에서는 바이트코드 워드 주소입니다.
+struct trace_record {
+    uint32_t pc;
+    uint8_t opcode;
+    uint8_t d_type;   // TOS의 폭
+    uint16_t depth;   // 스택 깊이 (65535에서 포화)
+    uint64_t tos;     // TOS의 하위 64비트 (빈 스택이면 보호 슬롯의 0)
+};
+
+static_assert(sizeof(trace_record) == 16, "trace_record layout");
+
+// dirtvm 추적 파일 형식 (리틀 엔디언, 모든 섹션은 8바이트 정렬)
+//
+//   trace_header             56 bytes
+//   module section           코드와 심볼만 담은 모듈 이미지 (module_file.h). 디스어셈블에 씁니다.
+//   records section          trace_record 배열. 오래된 것부터이며 마지막이 멈춘 명령어입니다.
+
+static const char TRACE_MAGIC[4] = {'D', 'T', 'R', 'C'};
+static const uint32_t TRACE_VERSION = 1;
+
+struct trace_header {
+    char magic[4];
+    uint32_t version;
+    module_section module;
+    module_section records;
+    uint64_t total;    // 기록한 명령어 수. 링 버퍼보다 많으면 앞부분은 덮어써졌습니다.
+    uint8_t trap;      // 덤프할 때의 vm_trap
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(trace_header) == 56, "trace_header layout");
+
+// 검증된 추적 파일의 섹션들을 가리킵니다. 원본 바이트가 살아 있는 동안만 유효합니다.
+struct trace_view {
+    module_view module;
+    const trace_record* records = nullptr;
+    size_t count = 0;
+    uint64_t total = 0;
+    uint8_t trap = 0;
+};
+
+bool parse_trace(const uint8_t* bytes, size_t size, trace_view& out, std::string& error);
+
+#endif // TRACE_H
@@ -1,250 +1,694 @@
 #include "vm.h"
+#include "opcode.h"
+#include "jit.h"
+#include "module_file.h"
+#include "profile.h"
 #include <iostream> // For debugging, can be removed later
 #include <algorithm> // For std::max
 
-// Helper function to read a 128-bit address from the bytecode
-__uint128_t read_address(const std::vector<uint16_t>& bytecode, __uint128_t& pc) {
-    __uint128_t address = 0;
-    for (int i = 0; i < 8; ++i) {
-        if (static_cast<size_t>(pc + i) < bytecode.size()) {
-            address |= (__uint128_t)bytecode[pc + i] << (16 * i);
-        } else {
-            std::cerr << "Unexpected end of bytecode when reading an address" << std::endl;
-            return 0;
-        }
+std::shared_ptr<const vm_module> vm_module::create(const uint16_t* bytecode, size_t size) {
+    std::shared_ptr<vm_module> module(new vm_module());
+    module->decoded = decode_bytecode(bytecode, size);
+    module->code_words.assign(bytecode, bytecode + size);
+    return module;
+}
+
+std::shared_ptr<const vm_module> vm_module::create(const module_view& view) {
+    std::shared_ptr<vm_module> module(new vm_module());
+    module->decoded = decode_bytecode(view.code, view.code_size);
+    module->data_section.assign(view.data, view.data + view.data_size);
+    module->code_words.assign(view.code, view.code + view.code_size);
+    return module;
+}
+
+std::shared_ptr<const vm_module> vm_module::with_breakpoint(uint64_t address) const {
+    // 주 명령어열이 보조 명령어열보다 앞에 있으므로 처음 찾은 인덱스가 원래 명령어입니다.
+    const std::vector<uint64_t>& addresses = decoded.addresses;
+    auto it = std::find(addresses.begin(), addresses.end(), address);
+    if (it == addresses.end()) {
+        return nullptr;
     }
-    pc += 8;
-    return address;
+    std::shared_ptr<vm_module> copy(new vm_module(*this));
+    copy->decoded.code[it - addresses.begin()].opcode = OP_BREAK;
+    return copy;
 }
 
-vm::vm(std::vector<uint16_t> bytecode)
-    : raw_bytecode(std::move(bytecode)), pc(0) {
+vm::vm(const std::vector<uint16_t>& bytecode, vm_options options)
+    : vm(vm_module::create(bytecode.data(), bytecode.size()), options) {}
+
+vm::vm(const uint16_t* bytecode, size_t size, vm_options options)
+    : vm(vm_module::create(bytecode, size), options) {}
+
+vm::vm(const module_view& view, vm_options options)
+    : vm(vm_module::create(view), options) {}
 
+vm::vm(std::shared_ptr<const vm_module> shared, vm_options options)
+    : pc(0),
+      stack(new stack_data[options.stack_capacity + 1]),
+      stack_capacity(options.stack_capacity),
+      stack_size(0),
+      local_segment_limit(options.local_segment_limit),
+      module(std::move(shared)),
+      program(module->program()),
+      output(options.output_buffer_size),
+      input(options.input_stream_size),
+      nonblocking_io(options.nonblocking_io),
+      fiber_stack_capacity(options.fiber_stack_capacity),
+      fiber_time_slice(options.fiber_time_slice) {
+    stack[0] = stack_data(D_TYPE::BIT_8, 0);
+    if (options.enable_jit) {
+        jit.reset(new jit_compiler(program, options.jit_threshold));
+    }
+    if (options.trace_capacity != 0) {
+        size_t requested = std::min(options.trace_capacity, MAX_TRACE_CAPACITY);
+        size_t capacity = 1;
+        while (capacity < requested) {
+            capacity <<= 1;
+        }
+        trace_ring.reset(new trace_record[capacity]);
+        trace_mask = capacity - 1;
+    }
+    module_view view;
+    view.data = module->data().data();
+    view.data_size = module->data().size();
+    view.for_each_data([this](const data_record& record, const uint8_t* values) {
+        global_memory.write(record.address, static_cast<D_TYPE>(record.d_type), values, record.count);
+    });
 }
 
 vm::~vm() {
     // Destructor
 }
 
+const char* trap_message(vm_trap trap) {
+    switch (trap) {
+        case vm_trap::NONE: return "no error";
+        case vm_trap::STACK_UNDERFLOW: return "stack underflow at data stack";
+        case vm_trap::STACK_OVERFLOW: return "stack overflow at data stack";
+        case vm_trap::DIVISION_BY_ZERO: return "division by zero";
+        case vm_trap::GLOBAL_RANGE: return "global memory address beyond 64 bits";
+        case vm_trap::LOCAL_RANGE: return "local memory access out of range";
+        case vm_trap::BAD_FIBER: return "join of an unknown fiber or of itself";
+        case vm_trap::DEADLOCK: return "deadlock: every fiber is waiting in join";
+    }
+    return "unknown error";
+}
+
+uint64_t vm::pc_address() const {
+    return pc < program.addresses.size() ? program.addresses[static_cast<size_t>(pc)] : program.addresses.back();
+}
+
+void vm::set_profiler(vm_profiler* sampler) {
+    profiler = sampler;
+    if (profiler) {
+        profiler->bind(program);
+    }
+}
+
+const char* vm::dispatch_name() {
+#ifdef DIRTVM_THREADED_DISPATCH
+    return "threaded";
+#else
+    return "switch";
+#endif
+}
+
+// 스택 원소는 stack[1..stack_size]에 저장됩니다. stack[0]은 run()의 TOS 캐시가
+// 빈 스택에서 읽고 쓰는 보호 슬롯입니다.
 void vm::push(stack_data data) {
-    stack.push(data);
+    if (stack_size == stack_capacity) {
+        raise(vm_trap::STACK_OVERFLOW);
+        return;
+    }
+    stack[++stack_size] = data;
 }
 
 stack_data vm::pop() {
-    if (stack.empty()) {
-        // Error: stack underflow
-        // This should be handled more gracefully
-        std::cerr << "stack underflow at data stack" << std::endl;
-        exit(1);
-    }
-    stack_data val = stack.top();
-    stack.pop();
-    return val;
+    if (stack_size == 0) {
+        raise(vm_trap::STACK_UNDERFLOW);
+        return stack[0];
+    }
+    return stack[stack_size--];
+}
+
+stack_data& vm::peek(size_t depth) {
+    if (stack_size <= depth) {
+        raise(vm_trap::STACK_UNDERFLOW);
+        return stack[0];
+    }
+    return stack[stack_size - depth];
 }
 
 stack_data& vm::top() {
-     if (stack.empty()) {
-        // Error: stack underflow
-        // This should be handled more gracefully
-        std::cerr << "stack underflow at data stack" << std::endl;
-        exit(1);
+    if (stack_size == 0) {
+        raise(vm_trap::STACK_UNDERFLOW);
+        return stack[0];
     }
-    return stack.top();
+    return stack[stack_size];
+}
+
+// 디스패치 매크로. threaded 모드에서는 핸들러마다 자신의 간접 분기를 가지므로
+// 분기 예측기가 명령어 쌍 단위로 패턴을 학습할 수 있습니다.
+#ifdef DIRTVM_THREADED_DISPATCH
+#define VM_CASE(label, opc) label:
+#define VM_DEFAULT(label) label:
+#define VM_NEXT()                                   \
+    do {                                            \
+        insn = ip++;                                \
+        TRACE_RECORD();                             \
+        goto *dispatch_table[insn->opcode];         \
+    } while (0)
+#else
+#define VM_CASE(label, opc) case opc:
+#define VM_DEFAULT(label) default:
+#define VM_NEXT() continue
+#endif
+
+// 분기 명령어마다 지나온 기본 블록의 길이만큼 시간 할당량을 줄입니다. 할당량은 파이버의
+// 시간 조각과 run()에 남은 연료 중 작은 쪽이며, 다 쓰면 분기를 마친 뒤 preempt로 갑니다.
+#define VM_TICK() do { if ((slice_left -= insn->block_length) < 0) goto preempt; } while (0)
+
+// 실행 오류. trapped에서 pc를 오류가 난 명령어로 남기고 TRAPPED를 반환합니다.
+#define VM_TRAP(reason) do { trap_reason = (reason); goto trapped; } while (0)
+
+// 새 시간 조각을 시작합니다. 프로파일 중에는 표본 간격에서도 조각을 끊습니다.
+#define SLICE_BEGIN()                                                               \
+    do {                                                                            \
+        slice_size = static_cast<int64_t>(std::min<uint64_t>(fiber_time_slice, fuel)); \
+        if (profiler) {                                                             \
+            slice_size = std::min<int64_t>(slice_size, profiler->next_interval());  \
+        }                                                                           \
+        slice_left = slice_size;                                                    \
+    } while (0)
+
+// 지금 조각에서 쓴 명령어 수를 연료에서 뺍니다.
+#define SLICE_CHARGE() do { fuel -= std::min<uint64_t>(fuel, slice_size - slice_left); } while (0)
+
+// 파이버가 바뀐 뒤 새 파이버의 스택과 pc를 읽어 옵니다.
+#define FIBER_RELOAD()                                              \
+    do {                                                            \
+        base = stack.get();                                         \
+        limit = base + stack_capacity;                              \
+        STACK_RELOAD();                                             \
+        ip = code + static_cast<size_t>(pc);                        \
+    } while (0)
+
+// 피연산자 스택 매크로. run() 안에서는 최상위 값을 tos 지역 변수에 캐시하고,
+// 그 아래 원소들은 base[1..depth-1]에 둡니다. sp는 &base[depth]입니다.
+#define STACK_DEPTH() (sp - base)
+#define STACK_NEED(n) do { if (STACK_DEPTH() < (n)) goto stack_underflow; } while (0)
+#define STACK_ROOM() do { if (sp == limit) goto stack_overflow; } while (0)
+#define STACK_PUSH(value) do { STACK_ROOM(); *sp++ = tos; tos = (value); } while (0)
+#define STACK_DROP() do { tos = *--sp; } while (0)
+// 멤버 함수(pop/push)를 쓰는 코드를 부르기 전후와 run()을 떠날 때 캐시를 동기화합니다.
+#define STACK_SPILL() do { *sp = tos; stack_size = STACK_DEPTH(); TRACE_SYNC(); } while (0)
+
+// 실행 추적. 다음 기록 위치는 지역 변수에 두고 멤버에는 STACK_SPILL 때만 씁니다.
+#define TRACE_RECORD()                                                              \
+    do {                                                                            \
+        if (tracing && insn->operand != CHARGE_OPERAND) {                           \
+            trace_record& record = trace_ring_base[trace_next++ & trace_mask];      \
+            record.pc = static_cast<uint32_t>(insn - code);                         \
+            record.opcode = insn->opcode;                                           \
+            record.d_type = tos.get_d_type();                                       \
+            record.depth = static_cast<uint16_t>(std::min<ptrdiff_t>(STACK_DEPTH(), 0xFFFF)); \
+            record.tos = static_cast<uint64_t>(tos.get_data());                     \
+        }                                                                           \
+    } while (0)
+#define TRACE_SYNC() do { if (tracing) trace_count = trace_next; } while (0)
+#define STACK_RELOAD() do { sp = base + stack_size; tos = *sp; } while (0)
+
+// 컴파일된 네이티브 코드로 들어갔다가, 네이티브 코드가 돌려준 명령어부터 이어서 실행합니다.
+#define JIT_ENTER(fn)                                               \
+    do {                                                            \
+        STACK_SPILL();                                              \
+        jit_state state{base + stack_size, base, limit, this, slice_left}; \
+        uint32_t next = (fn)(&state);                               \
+        stack_size = state.sp - base;                               \
+        slice_left = state.fuel;                                    \
+        STACK_RELOAD();                                             \
+        ip = code + next;                                           \
+    } while (0)
+
+vm_status vm::run(uint64_t max_instructions) {
+    return trace_ring ? execute<true>(max_instructions) : execute<false>(max_instructions);
 }
 
+template <bool tracing>
+vm_status vm::execute(uint64_t max_instructions) {
+#ifdef DIRTVM_THREADED_DISPATCH
+    static void* const dispatch_table[65] = {
+        &&op_halt,    &&op_add,     &&op_sub,      &&op_mul,      &&op_div,     &&op_unknown,  &&op_pop,     &&op_dup,
+        &&op_jmp,     &&op_jz,      &&op_jnz,      &&op_call,     &&op_ret,     &&op_eq,       &&op_lt,      &&op_gt,
+        &&op_gload,   &&op_gstore,  &&op_lload,    &&op_lstore,   &&op_pushd8,  &&op_pushd16,  &&op_pushd32, &&op_pushd64,
+        &&op_pushd128,&&op_syscall, &&op_addi,     &&op_jeq,      &&op_jne,     &&op_jlt,      &&op_jge,     &&op_jgt,
+        &&op_jle,     &&op_jzk,     &&op_jnzk,     &&op_gloadi,   &&op_gstorei, &&op_shli,     &&op_shri,    &&op_gcopy,
+        &&op_gfill,   &&op_gcmp,    &&op_spawn,    &&op_yield,    &&op_join,    &&op_unknown,  &&op_unknown, &&op_unknown,
+        &&op_unknown, &&op_unknown, &&op_unknown,  &&op_unknown,  &&op_unknown, &&op_unknown,  &&op_unknown, &&op_unknown,
+        &&op_unknown, &&op_unknown, &&op_unknown,  &&op_unknown,  &&op_unknown, &&op_unknown,  &&op_unknown, &&op_unknown,
+        &&op_break,
+    };
+#endif
+    if (trap_reason != vm_trap::NONE) {
+        return vm_status::TRAPPED;
+    }
+    const instruction* code = program.code.data();
+    const __uint128_t* wide = program.wide_immediates.data();
+    const instruction* ip = code + (pc < program.code.size() ? static_cast<size_t>(pc) : program.halt_index);
+    const instruction* insn;
+
+    stack_data* base = stack.get();
+    stack_data* limit = base + stack_capacity;
+    stack_data* sp;
+    stack_data tos;
+    STACK_RELOAD();
+    trace_record* const trace_ring_base = trace_ring.get();
+    uint64_t trace_next = trace_count;
+    (void)trace_ring_base;
+    (void)trace_next;
+    uint64_t fuel = max_instructions;
+    int64_t slice_size, slice_left;
+    uint64_t fiber_elapsed = 0; // 현재 파이버가 지난 전환 뒤로 쓴 명령어 수 (조각 경계에서 셉니다)
+    SLICE_BEGIN();
 
-void vm::run() {
-    while (static_cast<size_t>(pc) < raw_bytecode.size()) {
-        uint16_t instruction = raw_bytecode[pc++];
-        uint8_t opcode = instruction >> 10;
-        uint16_t operand1 = instruction & 0x03FF;
-
-        switch (opcode) {
-            case 0b000001: { // add
-                stack_data b = pop();
-                stack_data a = pop();
-                push(stack_data(a.get_d_type(), a.get_data() + b.get_data()));
-                break;
-            }
-            case 0b000010: { // sub
-                stack_data b = pop();
-                stack_data a = pop();
-                push(stack_data(a.get_d_type(), a.get_data() - b.get_data()));
-                break;
-            }
-            case 0b000011: { // mul
-                stack_data b = pop();
-                stack_data a = pop();
-                push(stack_data(a.get_d_type(), a.get_data() * b.get_data()));
-                break;
-            }
-            case 0b000100: { // div
-                stack_data b = pop();
-                stack_data a = pop();
-                if (b.get_data() == 0) {
-                    // Division by zero error
-                    std::cerr << "Division by zero error" << std::endl;
-                    exit(1);
-                }
-                push(stack_data(a.get_d_type(), a.get_data() / b.get_data()));
-                break;
-            }
-            case 0b000110: { // pop
-                pop();
-                break;
-            }
-            case 0b000111: { // dup
-                push(top());
-                break;
-            }
-            case 0b001000: { // jmp
-                pc = read_address(raw_bytecode, pc);
-                continue; // pc가 이미 설정되었으므로 루프의 끝에서 pc++를 건너뜁니다.
-            }
-            case 0b001001: { // jz
-                __uint128_t dest = read_address(raw_bytecode, pc);
-                stack_data val = pop();
-                if (val.get_data() == 0) {
-                    pc = dest;
-                    continue;
-                }
-                break;
-            }
-            case 0b001010: { // jnz
-                __uint128_t dest = read_address(raw_bytecode, pc);
-                stack_data val = pop();
-                if (val.get_data() != 0) {
-                    pc = dest;
-                    continue;
-                }
-                break;
-            }
-            case 0b001011: { // call
-                __uint128_t dest = read_address(raw_bytecode, pc);
-                call_stack.push(pc);
-                pc = dest;
-                continue; // pc가 이미 설정되었으므로 루프의 끝에서 pc++를 건너뜁니다.
-            }
-            case 0b001100: { // ret
+    // 네이티브 코드는 추적을 남기지 않으므로 추적 중에는 인터프리터만 씁니다.
+    jit_compiler* const jit_engine = jit.get();
+    if (!tracing && jit_engine) {
+        // 처음 시작할 때만 호출로 셉니다. 대기 후 재개할 때는 이미 컴파일된 진입점만 씁니다.
+        jit_function fn = pc == 0 ? jit_engine->on_call(ip - code) : jit_engine->entry(ip - code);
+        if (fn) {
+            JIT_ENTER(fn);
+        }
+    }
+
+#ifdef DIRTVM_THREADED_DISPATCH
+    VM_NEXT();
+#else
+    for (;;) {
+    vm_dispatch:
+        insn = ip++;
+        TRACE_RECORD();
+        switch (insn->opcode) {
+#endif
+            VM_CASE(op_halt, OP_HALT) {
+                pc = insn - code;
+                STACK_SPILL();
+                output.flush_all();
+                return vm_status::HALTED;
+            }
+            VM_CASE(op_add, OP_ADD) {
+                STACK_NEED(2);
+                stack_data a = *--sp;
+                tos = stack_data(a.get_d_type(), a.get_data() + tos.get_data());
+                VM_NEXT();
+            }
+            VM_CASE(op_sub, OP_SUB) {
+                STACK_NEED(2);
+                stack_data a = *--sp;
+                tos = stack_data(a.get_d_type(), a.get_data() - tos.get_data());
+                VM_NEXT();
+            }
+            VM_CASE(op_mul, OP_MUL) {
+                STACK_NEED(2);
+                stack_data a = *--sp;
+                tos = stack_data(a.get_d_type(), a.get_data() * tos.get_data());
+                VM_NEXT();
+            }
+            VM_CASE(op_div, OP_DIV) {
+                STACK_NEED(2);
+                if (tos.get_data() == 0) {
+                    VM_TRAP(vm_trap::DIVISION_BY_ZERO);
+                }
+                stack_data a = *--sp;
+                tos = stack_data(a.get_d_type(), a.get_data() / tos.get_data());
+                VM_NEXT();
+            }
+            VM_CASE(op_pop, OP_POP) {
+                STACK_NEED(1);
+                STACK_DROP();
+                VM_NEXT();
+            }
+            VM_CASE(op_dup, OP_DUP) {
+                STACK_NEED(1);
+                STACK_PUSH(tos);
+                VM_NEXT();
+            }
+            VM_CASE(op_jmp, OP_JMP) {
+                ip = code + insn->target;
+                VM_TICK();
+                VM_NEXT();
+            }
+            VM_CASE(op_jz, OP_JZ) {
+                STACK_NEED(1);
+                __uint128_t val = tos.get_data();
+                STACK_DROP();
+                if (val == 0) {
+                    ip = code + insn->target;
+                }
+                VM_TICK();
+                VM_NEXT();
+            }
+            VM_CASE(op_jnz, OP_JNZ) {
+                STACK_NEED(1);
+                __uint128_t val = tos.get_data();
+                STACK_DROP();
+                if (val != 0) {
+                    ip = code + insn->target;
+                }
+                VM_TICK();
+                VM_NEXT();
+            }
+            VM_CASE(op_call, OP_CALL) {
+                call_stack.push_back({static_cast<uint32_t>(ip - code), local_memory.enter()});
+                ip = code + insn->target;
+                VM_TICK();
+                if (!tracing && jit_engine) {
+                    if (jit_function fn = jit_engine->on_call(insn->target)) {
+                        JIT_ENTER(fn);
+                    }
+                }
+                VM_NEXT();
+            }
+            VM_CASE(op_ret, OP_RET) {
                 if (call_stack.empty()) {
+                    if (current_fiber != 0) {
+                        // spawn된 파이버의 본문이 끝났습니다.
+                        STACK_SPILL();
+                        if (!finish_fiber()) {
+                            goto trapped;
+                        }
+                        FIBER_RELOAD();
+                        VM_NEXT();
+                    }
                     // Return from main program body, treat as HALT
-                    return;
-                }
-                pc = call_stack.top();
-                call_stack.pop();
-                break;
-            }
-            case 0b001101: { // eq
-                stack_data b = pop();
-                stack_data a = pop();
-                push(stack_data(D_TYPE::BIT_8, a.get_data() == b.get_data()));
-                break;
-            }
-            case 0b001110: { // lt
-                stack_data b = pop();
-                stack_data a = pop();
-                push(stack_data(D_TYPE::BIT_8, a.get_data() < b.get_data()));
-                break;
-            }
-            case 0b001111: { // gt
-                stack_data b = pop();
-                stack_data a = pop();
-                push(stack_data(D_TYPE::BIT_8, a.get_data() > b.get_data()));
-                break;
-            }
-            case 0b010000: { // gload
-                stack_data addr = pop();
-                __uint128_t address = addr.get_data();
-                if (address >= global_memory.size()) {
-                    // Error: out of bounds global memory access
-                    exit(1);
-                }
-                push(global_memory[static_cast<size_t>(address)]);
-                break;
-            }
-            case 0b010001: { // gstore
-                stack_data addr = pop();
-                stack_data val = pop();
-                __uint128_t address = addr.get_data();
-                if (address >= global_memory.size()) {
-                    global_memory.resize(static_cast<size_t>(address) + 1, stack_data(D_TYPE::BIT_8, 0));
-                }
-                global_memory[static_cast<size_t>(address)] = val;
-                break;
-            }
-            case 0b010010: { // lload
-                uint16_t tag = operand1;
-                stack_data addr = pop();
-                __uint128_t address = addr.get_data();
-                if (tag >= local_memory.size() || address >= local_memory[tag].size()) {
-                    // Error: out of bounds local memory access
-                    exit(1);
-                }
-                push(local_memory[tag][static_cast<size_t>(address)]);
-                break;
-            }
-            case 0b010011: { // lstore
-                uint16_t tag = operand1;
-                stack_data addr = pop();
-                stack_data val = pop();
-                __uint128_t address = addr.get_data();
-                if (tag >= local_memory.size()) {
-                    local_memory.resize(tag + 1);
-                }
-                if (address >= local_memory[tag].size()) {
-                    local_memory[tag].resize(static_cast<size_t>(address) + 1, stack_data(D_TYPE::BIT_8, 0));
-                }
-                local_memory[tag][static_cast<size_t>(address)] = val;
-                break;
-            }
-            case 0b010100: { // pushd8
-                push(stack_data(D_TYPE::BIT_8, raw_bytecode[pc] & 0xFF));
-                pc += 1; // Consume data word
-                break;
-            }
-            case 0b010101: { // pushd16
-                push(stack_data(D_TYPE::BIT_16, raw_bytecode[pc]));
-                pc += 1; // 데이터 1워드.
-                break;
-            }
-            case 0b010110: { // pushd32
-                __uint128_t data = 0;
-                for(int i = 1; i >= 0; i--) {
-                    data <<= 16;
-                    data |= raw_bytecode[pc + i];
-                }
-                push(stack_data(D_TYPE::BIT_32, data));
-                pc += 2; // 데이터 2워드.
-                break;
-            }
-            case 0b010111: { // pushd64
-                __uint128_t data = 0;
-                for(int i = 0; i < 4; i++) {
-                    data <<= 16;
-                    data |= raw_bytecode[pc + (3-i)];
-                }
-                push(stack_data(D_TYPE::BIT_64, data));
-                pc += 4; // 데이터 4워드.
-                break;
-            }
-            case 0b011000: { // pushd128
-                __uint128_t data = 0;
-                 for(int i = 0; i < 8; i++) {
-                    data <<= 16;
-                    data |= raw_bytecode[pc + (7-i)];
-                }
-                push(stack_data(D_TYPE::BIT_128, data));
-                pc += 8; // 데이터 8워드.
-                break;
-            }
-            case 0b011001: { // syscall
-                handle_syscall(operand1);
-                break;
-            }
-            default:
+                    pc = ip - code;
+                    STACK_SPILL();
+                    output.flush_all();
+                    return vm_status::HALTED;
+                }
+                // 호출된 함수의 지역 메모리를 한 번에 버립니다.
+                const call_frame& frame = call_stack.back();
+                local_memory.leave(frame.locals);
+                ip = code + frame.return_index;
+                call_stack.pop_back();
+                VM_TICK();
+                if (!tracing && jit_engine) {
+                    if (jit_function fn = jit_engine->entry(ip - code)) {
+                        JIT_ENTER(fn);
+                    }
+                }
+                VM_NEXT();
+            }
+            VM_CASE(op_eq, OP_EQ) {
+                STACK_NEED(2);
+                stack_data a = *--sp;
+                tos = stack_data(D_TYPE::BIT_8, a.get_data() == tos.get_data());
+                VM_NEXT();
+            }
+            VM_CASE(op_lt, OP_LT) {
+                STACK_NEED(2);
+                stack_data a = *--sp;
+                tos = stack_data(D_TYPE::BIT_8, a.get_data() < tos.get_data());
+                VM_NEXT();
+            }
+            VM_CASE(op_gt, OP_GT) {
+                STACK_NEED(2);
+                stack_data a = *--sp;
+                tos = stack_data(D_TYPE::BIT_8, a.get_data() > tos.get_data());
+                VM_NEXT();
+            }
+            VM_CASE(op_gload, OP_GLOAD) {
+                STACK_NEED(1);
+                // tos의 주소를 넘기지 않아야 tos가 레지스터에 남습니다.
+                stack_data loaded;
+                if (!load_global(tos.get_data(), loaded)) {
+                    VM_TRAP(vm_trap::GLOBAL_RANGE);
+                }
+                tos = loaded;
+                VM_NEXT();
+            }
+            VM_CASE(op_gstore, OP_GSTORE) {
+                STACK_NEED(2);
+                if (!store_global(tos.get_data(), sp[-1])) {
+                    VM_TRAP(vm_trap::GLOBAL_RANGE);
+                }
+                --sp;
+                STACK_DROP();
+                VM_NEXT();
+            }
+            VM_CASE(op_lload, OP_LLOAD) {
+                STACK_NEED(1);
+                stack_data loaded;
+                if (!load_local(insn->operand, tos.get_data(), loaded)) {
+                    VM_TRAP(vm_trap::LOCAL_RANGE);
+                }
+                tos = loaded;
+                VM_NEXT();
+            }
+            VM_CASE(op_lstore, OP_LSTORE) {
+                STACK_NEED(2);
+                if (!store_local(insn->operand, tos.get_data(), sp[-1])) {
+                    VM_TRAP(vm_trap::LOCAL_RANGE);
+                }
+                --sp;
+                STACK_DROP();
+                VM_NEXT();
+            }
+            VM_CASE(op_pushd8, OP_PUSHD8) {
+                STACK_PUSH(stack_data(D_TYPE::BIT_8, insn->imm));
+                VM_NEXT();
+            }
+            VM_CASE(op_pushd16, OP_PUSHD16) {
+                STACK_PUSH(stack_data(D_TYPE::BIT_16, insn->imm));
+                VM_NEXT();
+            }
+            VM_CASE(op_pushd32, OP_PUSHD32) {
+                STACK_PUSH(stack_data(D_TYPE::BIT_32, insn->imm));
+                VM_NEXT();
+            }
+            VM_CASE(op_pushd64, OP_PUSHD64) {
+                STACK_PUSH(stack_data(D_TYPE::BIT_64, insn->imm));
+                VM_NEXT();
+            }
+            VM_CASE(op_pushd128, OP_PUSHD128) {
+                STACK_PUSH(stack_data(D_TYPE::BIT_128, wide[insn->imm]));
+                VM_NEXT();
+            }
+            VM_CASE(op_syscall, OP_SYSCALL) {
+                STACK_SPILL();
+                if (!handle_syscall(insn->operand)) {
+                    if (trap_reason != vm_trap::NONE) {
+                        goto trapped;
+                    }
+                    if (exit_requested) {
+                        // SYS_exit. 다시 run()해도 끝난 상태로 남습니다.
+                        pc = program.halt_index;
+                        output.flush_all();
+                        return vm_status::HALTED;
+                    }
+                    // 다시 run()하면 같은 syscall부터 실행합니다.
+                    pc = insn - code;
+                    return vm_status::WAITING;
+                }
+                STACK_RELOAD();
+                VM_NEXT();
+            }
+            // 슈퍼 명령어. 각각 원래 명령어 쌍과 같은 결과를 냅니다.
+            VM_CASE(op_addi, OP_ADDI) {
+                STACK_NEED(1);
+                tos = stack_data(tos.get_d_type(), tos.get_data() + insn->imm);
+                VM_NEXT();
+            }
+#define VM_COMPARE_BRANCH(label, opc, cond)                         \
+            VM_CASE(label, opc) {                                   \
+                STACK_NEED(2);                                      \
+                __uint128_t b = tos.get_data();                     \
+                __uint128_t a = (--sp)->get_data();                 \
+                STACK_DROP();                                       \
+                if (cond) {                                         \
+                    ip = code + insn->target;                       \
+                }                                                   \
+                VM_TICK();                                          \
+                VM_NEXT();                                          \
+            }
+            VM_COMPARE_BRANCH(op_jeq, OP_JEQ, a == b)
+            VM_COMPARE_BRANCH(op_jne, OP_JNE, a != b)
+            VM_COMPARE_BRANCH(op_jlt, OP_JLT, a < b)
+            VM_COMPARE_BRANCH(op_jge, OP_JGE, !(a < b))
+            VM_COMPARE_BRANCH(op_jgt, OP_JGT, a > b)
+            VM_COMPARE_BRANCH(op_jle, OP_JLE, !(a > b))
+#undef VM_COMPARE_BRANCH
+            VM_CASE(op_jzk, OP_JZK) {
+                STACK_NEED(1);
+                if (tos.get_data() == 0) {
+                    ip = code + insn->target;
+                }
+                VM_TICK();
+                VM_NEXT();
+            }
+            VM_CASE(op_jnzk, OP_JNZK) {
+                STACK_NEED(1);
+                if (tos.get_data() != 0) {
+                    ip = code + insn->target;
+                }
+                VM_TICK();
+                VM_NEXT();
+            }
+            VM_CASE(op_gloadi, OP_GLOADI) {
+                stack_data val;
+                if (!load_global(insn->imm, val)) {
+                    VM_TRAP(vm_trap::GLOBAL_RANGE);
+                }
+                STACK_PUSH(val);
+                VM_NEXT();
+            }
+            VM_CASE(op_gstorei, OP_GSTOREI) {
+                STACK_NEED(1);
+                stack_data val = tos;
+                STACK_DROP();
+                store_global(insn->imm, val);
+                VM_NEXT();
+            }
+            VM_CASE(op_shli, OP_SHLI) {
+                STACK_NEED(1);
+                __uint128_t value = insn->operand < 128 ? tos.get_data() << insn->operand : 0;
+                tos = stack_data(tos.get_d_type(), value);
+                VM_NEXT();
+            }
+            VM_CASE(op_shri, OP_SHRI) {
+                STACK_NEED(1);
+                __uint128_t value = insn->operand < 128 ? tos.get_data() >> insn->operand : 0;
+                tos = stack_data(tos.get_d_type(), value);
+                VM_NEXT();
+            }
+            // 대량 메모리 연산. 스택: ... dst src/value count (count가 TOS)
+            // 오류가 나면 피연산자를 스택에 남겨 둡니다.
+            VM_CASE(op_gcopy, OP_GCOPY) {
+                STACK_NEED(3);
+                if (!copy_global(sp[-2].get_data(), sp[-1].get_data(), tos.get_data())) {
+                    VM_TRAP(vm_trap::GLOBAL_RANGE);
+                }
+                sp -= 2;
+                STACK_DROP();
+                VM_NEXT();
+            }
+            VM_CASE(op_gfill, OP_GFILL) {
+                STACK_NEED(3);
+                if (!fill_global(sp[-2].get_data(), tos.get_data(), sp[-1])) {
+                    VM_TRAP(vm_trap::GLOBAL_RANGE);
+                }
+                sp -= 2;
+                STACK_DROP();
+                VM_NEXT();
+            }
+            VM_CASE(op_gcmp, OP_GCMP) {
+                STACK_NEED(3);
+                uint8_t order;
+                if (!compare_global(sp[-2].get_data(), sp[-1].get_data(), tos.get_data(), order)) {
+                    VM_TRAP(vm_trap::GLOBAL_RANGE);
+                }
+                sp -= 2;
+                tos = stack_data(D_TYPE::BIT_8, order);
+                VM_NEXT();
+            }
+            // 파이버. 스택: spawn은 인자 하나를 새 파이버의 스택으로 옮기고 그 id를 남깁니다.
+            VM_CASE(op_spawn, OP_SPAWN) {
+                STACK_NEED(1);
+                uint64_t id;
+                if (!spawn_fiber(insn->target, tos, id)) {
+                    goto trapped;
+                }
+                tos = stack_data(D_TYPE::BIT_64, id);
+                VM_TICK();
+                VM_NEXT();
+            }
+            VM_CASE(op_yield, OP_YIELD) {
+                pc = ip - code;
+                STACK_SPILL();
+                yield_fiber();
+                FIBER_RELOAD();
+                SLICE_CHARGE();
+                SLICE_BEGIN();
+                fiber_elapsed = 0;
+                VM_NEXT();
+            }
+            VM_CASE(op_join, OP_JOIN) {
+                STACK_NEED(1);
+                __uint128_t id = tos.get_data();
+                pc = ip - code;
+                STACK_SPILL();
+                // 파이버 번호는 join_fiber가 검사를 통과한 뒤에 내립니다.
+                if (!join_fiber(id)) {
+                    goto trapped;
+                }
+                FIBER_RELOAD();
+                VM_NEXT();
+            }
+            VM_CASE(op_break, OP_BREAK) {
+                pc = insn - code;
+                STACK_SPILL();
+                output.flush_all();
+                return vm_status::BREAKPOINT;
+            }
+            VM_DEFAULT(op_unknown) {
                 // Unknown opcode
-                std::cerr << "Unknown opcode: " << std::hex << (int)opcode << std::endl;
-                continue; // or exit, or throw an exception
+                std::cerr << "Unknown opcode: " << std::hex << (int)insn->opcode << std::dec << std::endl;
+                VM_NEXT(); // or exit, or throw an exception
+            }
+#ifndef DIRTVM_THREADED_DISPATCH
+        }
+    }
+#endif
+
+preempt:
+    // 시간 조각 경계. 표본을 남기고, 연료와 중단 요청을 확인하고 다음 파이버로 넘어갑니다.
+    // 다시 run()하면 분기 다음 명령어부터 이어서 실행합니다.
+    if (profiler) {
+        profiler->sample(program, insn - code, ip - code, call_stack);
+    }
+    SLICE_CHARGE();
+    if (fuel == 0 || interrupt_requested.load(std::memory_order_relaxed)) {
+        pc = ip - code;
+        STACK_SPILL();
+        output.flush_all();
+        if (fuel == 0) {
+            return vm_status::OUT_OF_FUEL;
         }
+        interrupt_requested.store(false, std::memory_order_relaxed);
+        return vm_status::INTERRUPTED;
     }
+    fiber_elapsed += slice_size - slice_left;
+    if (!run_queue.empty() && fiber_elapsed >= fiber_time_slice) {
+        fiber_elapsed = 0;
+        pc = ip - code;
+        STACK_SPILL();
+        yield_fiber();
+        FIBER_RELOAD();
+    }
+    SLICE_BEGIN();
+    if (!tracing && jit_engine) {
+        // 네이티브 코드가 연료를 다 써서 나왔다면 루프 머리에서 다시 들어갑니다.
+        if (jit_function fn = jit_engine->entry(ip - code)) {
+            JIT_ENTER(fn);
+        }
+    }
+#ifdef DIRTVM_THREADED_DISPATCH
+    VM_NEXT();
+#else
+    goto vm_dispatch;
+#endif
+
+stack_underflow:
+    trap_reason = vm_trap::STACK_UNDERFLOW;
+    goto trapped;
+
+stack_overflow:
+    trap_reason = vm_trap::STACK_OVERFLOW;
+    goto trapped;
+
+trapped:
+    pc = insn - code;
+    STACK_SPILL();
+    output.flush_all();
+    return vm_status::TRAPPED;
 }
@@ -1,29 +1,322 @@
-#include <stack>
+#ifndef VM_H
+#define VM_H
+
 #include <vector>
+#include <string>
+#include <deque>
+#include <memory>
+#include <atomic>
 #include <cstdint>
+#include <cstddef>
 
 #include "object.h"
+#include "decode.h"
+#include "output.h"
+#include "input.h"
+#include "trace.h"
+
+// GCC/Clang의 labels-as-values를 사용하는 direct-threaded 디스패치가 기본입니다.
+// -DDIRTVM_SWITCH_DISPATCH로 빌드하면 이식 가능한 switch 디스패치를 사용합니다.
+#if defined(__GNUC__) && !defined(DIRTVM_SWITCH_DISPATCH)
+#define DIRTVM_THREADED_DISPATCH 1
+#endif
+
+struct vm_options {
+    size_t stack_capacity = 16384; // 피연산자 스택의 최대 원소 수
+    bool enable_jit = false;       // x86-64 베이스라인 JIT 사용
+    uint32_t jit_threshold = 1000; // 함수를 컴파일하기 전까지의 호출 횟수
+    size_t output_buffer_size = output_buffer::DEFAULT_CAPACITY; // fd별 SYS_write 버퍼 크기
+    size_t input_stream_size = 0;  // 0이 아니면 stdin을 이 크기의 고정 버퍼로 스트리밍합니다.
+    size_t local_segment_limit = local_arena::DEFAULT_SEGMENT_LIMIT; // 지역 메모리 태그 하나의 최대 셀 수
+    // 호스트 모드. read/write가 EAGAIN이면 run()이 WAITING을 반환하고, 호스트가 fd가 준비된 뒤
+    // 다시 run()을 부르면 그 시스템 콜부터 이어서 실행합니다. fd는 O_NONBLOCK이어야 합니다.
+    bool nonblocking_io = false;
+    size_t fiber_stack_capacity = 1024; // spawn으로 만든 파이버의 피연산자 스택 원소 수
+    uint32_t fiber_time_slice = 10000;  // 파이버를 선점하기 전까지 실행할 명령어 수
+    // 0이 아니면 마지막으로 실행한 명령어 이만큼(2의 거듭제곱으로 올림)을 링 버퍼에 기록합니다.
+    // 추적 중에는 JIT 코드로 들어가지 않습니다.
+    size_t trace_capacity = 0;
+};
+
+class jit_compiler;
+struct module_view;
+struct snapshot_codec;
+class vm_profiler;
+
+// run()이 돌아온 이유
+enum class vm_status {
+    HALTED,      // halt, 최상위 ret 또는 SYS_exit (exit_code())
+    WAITING,     // 호스트 모드에서 fd를 기다리는 중 (waiting_fd())
+    OUT_OF_FUEL, // run()에 준 명령어 수를 다 썼음. 다시 run()하면 이어서 실행합니다.
+    INTERRUPTED, // interrupt()로 멈춤. 다시 run()하면 이어서 실행합니다.
+    TRAPPED,     // 실행 오류 (trap()). 이 VM은 더 실행할 수 없습니다.
+    BREAKPOINT,  // 중단점 명령어에 닿음. pc는 중단점을 가리킵니다.
+};
+
+// TRAPPED의 원인
+enum class vm_trap : uint8_t {
+    NONE,
+    STACK_UNDERFLOW,
+    STACK_OVERFLOW,
+    DIVISION_BY_ZERO,
+    GLOBAL_RANGE,   // 64비트를 넘는 전역 주소나 범위
+    LOCAL_RANGE,    // 현재 프레임에 없는 지역 태그나 주소
+    BAD_FIBER,      // 없는 파이버나 자기 자신을 join
+    DEADLOCK,       // 모든 파이버가 join에서 기다림
+};
+
+const char* trap_message(vm_trap trap);
+
+// 한 번 디코딩해 여러 VM이 함께 쓰는 불변 프로그램. 만든 뒤에는 바뀌지 않으므로
+// 여러 스레드의 VM이 잠금 없이 공유할 수 있습니다. 데이터 섹션은 VM을 만들 때마다 적재합니다.
+class vm_module {
+public:
+    static std::shared_ptr<const vm_module> create(const uint16_t* bytecode, size_t size);
+    static std::shared_ptr<const vm_module> create(const std::vector<uint16_t>& bytecode) {
+        return create(bytecode.data(), bytecode.size());
+    }
+    // 코드는 디코딩하고 데이터 섹션은 복사하므로, 반환된 모듈은 view의 원본보다 오래 살아도 됩니다.
+    static std::shared_ptr<const vm_module> create(const module_view& view);
+
+    const decoded_program& program() const { return decoded; }
+    // 데이터 섹션 (module_file.h의 data_record 연속)
+    const std::vector<uint8_t>& data() const { return data_section; }
+    // 디코딩하기 전의 코드. 스냅샷은 이 코드를 함께 저장합니다.
+    const std::vector<uint16_t>& bytecode() const { return code_words; }
+
+    // address의 명령어를 중단점으로 바꾼 사본을 만듭니다. 그 명령어에 닿으면 run()이
+    // BREAKPOINT를 반환하며, 중단점을 넘어 계속 실행할 수는 없으므로 스냅샷을 찍을 때 씁니다.
+    // address가 명령어의 시작이 아니면 nullptr를 반환합니다.
+    std::shared_ptr<const vm_module> with_breakpoint(uint64_t address) const;
+
+private:
+    decoded_program decoded;
+    std::vector<uint8_t> data_section;
+    std::vector<uint16_t> code_words;
+
+    vm_module() {}
+};
+
+// call이 만드는 프레임. 돌아갈 곳과 호출 직전의 지역 메모리 상태를 기억합니다.
+struct call_frame {
+    uint32_t return_index;           // 돌아갈 명령어 인덱스
+    local_arena::frame_mark locals;  // ret에서 지역 메모리를 되돌릴 표식
+};
+
+enum class fiber_state : uint8_t {
+    READY,    // 실행 대기열에 있음
+    RUNNING,
+    JOINING,  // 다른 파이버가 끝나기를 기다림
+    DONE,
+};
+
+// spawn이 만드는 그린 스레드. 실행 중인 파이버의 상태는 vm의 멤버에 있고,
+// 멈춰 있는 파이버의 상태만 여기에 보관합니다. 전역 메모리와 입출력은 모두 함께 씁니다.
+struct fiber {
+    __uint128_t pc = 0;
+    std::unique_ptr<stack_data[]> stack;
+    size_t stack_capacity = 0;
+    size_t stack_size = 0;
+    std::vector<call_frame> call_stack;
+    local_arena local_memory;
+    fiber_state state = fiber_state::READY;
+    std::vector<uint64_t> joiners;  // 이 파이버의 결과를 기다리는 파이버들
+    stack_data result;              // 끝날 때의 TOS (빈 스택이면 BIT_8 0)
+};
 
 class vm
 {
 private:
-    __uint128_t pc;
-    std::stack<stack_data> stack;
-    std::stack<__uint128_t> call_stack;
-    std::vector<stack_data> global_memory;
-    
-    std::vector<std::vector<stack_data>> local_memory;
-    std::vector<uint16_t> raw_bytecode;
+    friend struct snapshot_codec;
 
+    __uint128_t pc; // 디코딩된 명령어 인덱스
+    std::unique_ptr<stack_data[]> stack; // 미리 할당된 연속 버퍼 (0번은 보호 슬롯)
+    size_t stack_capacity;
+    size_t stack_size;
+    std::vector<call_frame> call_stack;
+    paged_memory global_memory;
 
-    void push(stack_data);
-    void handle_syscall(uint16_t operand1);
+    local_arena local_memory;
+    size_t local_segment_limit;
+    std::shared_ptr<const vm_module> module;
+    const decoded_program& program;
+    std::unique_ptr<jit_compiler> jit;
+    output_buffer output;
+    input_buffer input;
+    bool nonblocking_io;
+    struct {
+        int fd = -1;
+        bool write = false;
+    } waiting_io;
+
+    // 파이버. 첫 spawn 때 만들어지며 0번이 원래의 실행 흐름입니다. id는 fibers의 인덱스입니다.
+    std::vector<fiber> fibers;
+    std::deque<uint64_t> run_queue;
+    uint64_t current_fiber = 0;
+    size_t fiber_stack_capacity;
+    uint32_t fiber_time_slice;
+
+    vm_trap trap_reason = vm_trap::NONE;
+    bool exit_requested = false;
+    int exit_status = 0;
+    std::atomic<bool> interrupt_requested{false};
+    vm_profiler* profiler = nullptr;
+
+    // 실행 추적 링 버퍼. trace_count는 지금까지 기록한 수이며 다음 기록은 trace_count & trace_mask에 갑니다.
+    std::unique_ptr<trace_record[]> trace_ring;
+    uint64_t trace_mask = 0;
+    uint64_t trace_count = 0;
+
+    // run()의 본체. 추적 여부에 따라 두 벌을 만들어, 추적하지 않을 때는 기록 코드가 없습니다.
+    template <bool tracing>
+    vm_status execute(uint64_t max_instructions);
+
+    bool handle_syscall(uint16_t operand1);
+    bool wait_for(int fd, bool write);
+    stack_data& peek(size_t depth);
+
+    // 파이버 전환. 부르기 전에 pc와 스택 크기를 저장해 두어야 하며, 돌아오면
+    // 현재 파이버가 바뀌었을 수 있으므로 run()은 스택과 pc를 다시 읽습니다.
+    // false를 반환하면 trap_reason이 설정되어 있습니다.
+    bool spawn_fiber(uint32_t entry, stack_data argument, uint64_t& id);
+    void yield_fiber();
+    bool join_fiber(__uint128_t id);
+    bool finish_fiber();
+    void switch_fiber(uint64_t next);
+    bool schedule_next();
+    // 실행 오류를 기록합니다. 항상 false를 반환하므로 실패를 알리는 반환값으로 씁니다.
+    bool raise(vm_trap reason) {
+        trap_reason = reason;
+        return false;
+    }
 
 public:
-    vm(std::vector<uint16_t> raw_bytecode);
-    void run();
+    vm(const std::vector<uint16_t>& raw_bytecode, vm_options options = vm_options());
+    // 바이트코드를 복사하지 않고 디코딩합니다. 생성자가 끝나면 원본은 필요 없습니다.
+    vm(const uint16_t* raw_bytecode, size_t size, vm_options options = vm_options());
+    // 모듈의 코드를 디코딩하고 데이터 섹션으로 전역 메모리를 초기화합니다.
+    vm(const module_view& module, vm_options options = vm_options());
+    // 공유 모듈을 참조하는 인스턴스. 코드는 복사하지 않고 상태(스택, 메모리, JIT)만 따로 가집니다.
+    vm(std::shared_ptr<const vm_module> module, vm_options options = vm_options());
+    static constexpr uint64_t UNLIMITED = UINT64_MAX;
+    // 스냅샷으로 저장하고 복원할 수 있는 피연산자 스택의 최대 원소 수
+    static constexpr size_t MAX_STACK_CAPACITY = size_t(1) << 24;
+    // 추적 링 버퍼의 최대 기록 수. trace_capacity가 이보다 크면 이 값으로 줄입니다.
+    static constexpr size_t MAX_TRACE_CAPACITY = size_t(1) << 24;
+    // 최대 max_instructions개 남짓의 명령어를 실행합니다. 명령어 수는 기본 블록 단위로
+    // 분기에서 세므로 한 블록(최대 255개)만큼 더 실행할 수 있습니다.
+    vm_status run(uint64_t max_instructions = UNLIMITED);
+
+    // 다른 스레드에서 불러도 됩니다. 실행 중인 run()은 다음 시간 조각 경계
+    // (fiber_time_slice개 이내의 명령어)에서 INTERRUPTED를 반환합니다.
+    void interrupt() { interrupt_requested.store(true, std::memory_order_relaxed); }
+
+    vm_trap trap() const { return trap_reason; }
+    // 오류가 난 명령어(또는 멈춘 지점)의 바이트코드 워드 주소
+    uint64_t pc_address() const;
+    // SYS_exit으로 끝났는지와 그 종료 코드
+    bool exited() const { return exit_requested; }
+    int exit_code() const { return exit_status; }
     ~vm();
 
+    // 실행 상태(pc, 스택, 호출 스택, 전역/지역 메모리, 파이버)와 코드를 파일로 저장합니다.
+    // run()이 돌아온 뒤에만 부를 수 있고, 쌓인 출력은 먼저 내보냅니다. 입력 버퍼에 읽어 둔
+    // 데이터와 JIT 코드는 저장하지 않습니다. 실패하면 false와 오류 메시지를 반환합니다.
+    bool save_snapshot(const std::string& path, std::string& error);
+    // 스냅샷에서 VM을 만듭니다. 전역 메모리 페이지는 파일을 MAP_PRIVATE로 매핑해 그대로
+    // 가리키므로 복원 비용이 메모리 크기에 비례하지 않고, 쓰기는 복사 후 쓰기로 처리되어
+    // 파일에 반영되지 않습니다. 스택 용량은 스냅샷의 것을 쓰고, 나머지는 options를 따릅니다.
+    static std::unique_ptr<vm> restore_snapshot(const std::string& path, vm_options options, std::string& error);
+
+    // 실행 전에 인자를 넣고 실행 뒤 결과를 꺼낼 때 씁니다. 스택이 넘치거나 비어 있으면
+    // 실행 오류로 기록하고, pop/top은 보호 슬롯(BIT_8 0)을 돌려줍니다.
+    void push(stack_data);
     stack_data pop();
     stack_data& top();
-};
\ No newline at end of file
+    size_t depth() const { return stack_size; }
+
+    // 전역 메모리 접근. 전역 주소는 64비트 안이어야 하며, 벗어나면 false를 반환합니다.
+    // 저장된 적 없는 주소는 BIT_8 0으로 읽힙니다.
+    bool load_global(__uint128_t address, stack_data& out) const {
+        if ((address >> 64) != 0) {
+            return false;
+        }
+        out = global_memory.load(static_cast<uint64_t>(address));
+        return true;
+    }
+
+    bool store_global(__uint128_t address, stack_data value) {
+        if ((address >> 64) != 0) {
+            return false;
+        }
+        global_memory.store(static_cast<uint64_t>(address), value);
+        return true;
+    }
+
+    // 전역 메모리 대량 연산. [address, address + count) 범위가 64비트 주소 공간을
+    // 벗어나면 아무것도 하지 않고 false를 반환합니다.
+    bool copy_global(__uint128_t dst, __uint128_t src, __uint128_t count) {
+        if (!global_range(dst, count) || !global_range(src, count)) {
+            return false;
+        }
+        global_memory.copy(static_cast<uint64_t>(dst), static_cast<uint64_t>(src), static_cast<uint64_t>(count));
+        return true;
+    }
+
+    bool fill_global(__uint128_t dst, __uint128_t count, stack_data value) {
+        if (!global_range(dst, count)) {
+            return false;
+        }
+        global_memory.fill(static_cast<uint64_t>(dst), static_cast<uint64_t>(count), value);
+        return true;
+    }
+
+    // result: 같으면 0, a 쪽이 작으면 1, 크면 2
+    bool compare_global(__uint128_t a, __uint128_t b, __uint128_t count, uint8_t& result) const {
+        if (!global_range(a, count) || !global_range(b, count)) {
+            return false;
+        }
+        int order = global_memory.compare(static_cast<uint64_t>(a), static_cast<uint64_t>(b), static_cast<uint64_t>(count));
+        result = order == 0 ? 0 : (order < 0 ? 1 : 2);
+        return true;
+    }
+
+    static bool global_range(__uint128_t address, __uint128_t count) {
+        return (address >> 64) == 0 && (count >> 64) == 0 && address + count <= ((__uint128_t)1 << 64);
+    }
+
+    // 지역 메모리 접근. 태그는 현재 호출 프레임 안에서만 유효합니다.
+    // load는 현재 프레임에 없는 태그나 저장된 범위를 벗어난 주소에 대해 false를 반환합니다.
+    bool load_local(uint16_t tag, __uint128_t address, stack_data& out) const {
+        return local_memory.load(tag, address, out);
+    }
+
+    bool store_local(uint16_t tag, __uint128_t address, stack_data value) {
+        return local_memory.store(tag, address, value, local_segment_limit);
+    }
+
+    // SYS_write 출력 버퍼. run()이 끝나거나 SYS_exit, 오류로 끝날 때 비워집니다.
+    void set_output_policy(int fd, flush_policy policy) { output.set_policy(fd, policy); }
+    size_t output_syscall_count() const { return output.syscall_count(); }
+    size_t input_syscall_count() const { return input.syscall_count(); }
+
+    // 추적 링 버퍼를 오래된 것부터 파일로 씁니다. 코드와 symbols를 함께 담으므로
+    // dirtvm_cli --show-trace로 어셈블리와 맞춰 볼 수 있습니다. 추적하지 않는 VM이면 false입니다.
+    bool write_trace(const std::string& path, const std::vector<module_symbol>& symbols, std::string& error) const;
+    bool tracing() const { return trace_ring != nullptr; }
+
+    // 표본 추출 프로파일러를 붙입니다 (nullptr이면 뗍니다). 붙어 있는 동안 시간 조각을
+    // 프로파일러의 표본 간격으로 나누며, 파이버는 그래도 fiber_time_slice마다 바뀝니다.
+    void set_profiler(vm_profiler* sampler);
+
+    // 지금 실행 중인 파이버 (spawn한 적이 없으면 0)
+    uint64_t fiber_id() const { return current_fiber; }
+
+    // 마지막 WAITING에서 기다리는 fd와 방향
+    int waiting_fd() const { return waiting_io.fd; }
+    bool waiting_for_write() const { return waiting_io.write; }
+
+    static const char* dispatch_name();
+};
+
+#endif // VM_H
@@ -0,0 +1,376 @@
+#include "optimizer.h"
+#include "../engine/opcode.h"
+#include "../engine/decode.h"
+#include "../engine/object.h"
+
+#include <map>
+#include <set>
+
+namespace {
+
+uint64_t read_words(const std::vector<uint16_t>& bytecode, size_t address, int words) {
+    uint64_t value = 0;
+    for (int i = words - 1; i >= 0; --i) {
+        value = (value << 16) | bytecode[address + i];
+    }
+    return value;
+}
+
+__uint128_t read_u128(const std::vector<uint16_t>& bytecode, size_t address) {
+    return ((__uint128_t)read_words(bytecode, address + 4, 4) << 64) | read_words(bytecode, address, 4);
+}
+
+void append_words(std::vector<uint16_t>& bytecode, __uint128_t value, int words) {
+    for (int i = 0; i < words; i++) {
+        bytecode.push_back(static_cast<uint16_t>(value >> (16 * i)));
+    }
+}
+
+bool is_push(uint8_t opcode) {
+    return opcode >= OP_PUSHD8 && opcode <= OP_PUSHD128;
+}
+
+// pushd8..pushd128은 D_TYPE과 같은 순서입니다.
+D_TYPE push_type(uint8_t opcode) {
+    return static_cast<D_TYPE>(opcode - OP_PUSHD8);
+}
+
+uint8_t push_opcode(D_TYPE type) {
+    return static_cast<uint8_t>(OP_PUSHD8 + type);
+}
+
+// 값이 해당 타입의 push 명령어로 다시 표현될 수 있는지 확인합니다.
+bool fits(__uint128_t value, D_TYPE type) {
+    switch (type) {
+        case BIT_8: return value <= 0xFF;
+        case BIT_16: return value <= 0xFFFF;
+        case BIT_32: return value <= 0xFFFFFFFFu;
+        case BIT_64: return (value >> 64) == 0;
+        default: return true;
+    }
+}
+
+bool ends_block(uint8_t opcode) {
+    return is_branch_opcode(opcode) || opcode == OP_RET || opcode == OP_HALT;
+}
+
+// 블록 하나를 앞에서부터 훑으며, 스택 최상단에 쌓인 상수들을 내보내지 않고 들고 다닙니다.
+// 상수를 소비하는 명령어를 만나면 그 자리에서 계산하거나 더 싼 명령어로 바꾸고,
+// 그럴 수 없을 때만 상수들을 push로 내보냅니다.
+class block_optimizer {
+public:
+    explicit block_optimizer(optimizer_stats& stats) : stats(stats) {}
+
+    std::vector<ir_instruction> run(const std::vector<ir_instruction>& code) {
+        for (const auto& insn : code) {
+            step(insn);
+        }
+        flush();
+        return std::move(out);
+    }
+
+private:
+    struct constant {
+        __uint128_t value;
+        D_TYPE type;
+    };
+
+    optimizer_stats& stats;
+    std::vector<constant> pending;   // 아직 내보내지 않은 스택 최상단의 상수들 (마지막이 TOS)
+    std::vector<ir_instruction> out;
+
+    // 쌓아 둔 상수 중 위쪽 keep개를 남기고 나머지를 순서대로 내보냅니다.
+    void flush(size_t keep = 0) {
+        size_t count = pending.size() - keep;
+        for (size_t i = 0; i < count; i++) {
+            out.push_back({push_opcode(pending[i].type), 0, pending[i].value, 0});
+        }
+        pending.erase(pending.begin(), pending.begin() + count);
+    }
+
+    void emit(const ir_instruction& insn) {
+        flush();
+        out.push_back(insn);
+    }
+
+    void step(const ir_instruction& insn) {
+        if (is_push(insn.opcode)) {
+            pending.push_back({insn.imm, push_type(insn.opcode)});
+            return;
+        }
+        switch (insn.opcode) {
+            case OP_POP:
+                // push c; pop
+                if (!pending.empty()) {
+                    pending.pop_back();
+                    stats.folded += 2;
+                    return;
+                }
+                break;
+            case OP_DUP:
+                // 상수의 복사본은 같은 상수입니다.
+                if (!pending.empty()) {
+                    pending.push_back(pending.back());
+                    stats.folded += 1;
+                    return;
+                }
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+            case OP_EQ: case OP_LT: case OP_GT:
+                if (fold_binary(insn.opcode) || reduce_binary(insn.opcode)) {
+                    return;
+                }
+                break;
+            case OP_JZ:
+            case OP_JNZ:
+                if (!pending.empty()) {
+                    bool taken = (pending.back().value == 0) == (insn.opcode == OP_JZ);
+                    pending.pop_back();
+                    if (taken) {
+                        emit({OP_JMP, 0, 0, insn.target});
+                        stats.folded += 1;
+                    } else {
+                        stats.folded += 2;
+                    }
+                    return;
+                }
+                if (fuse_branch(insn)) {
+                    return;
+                }
+                break;
+            case OP_GLOAD:
+            case OP_GSTORE:
+                // 주소가 상수이면 즉시값 형태로 바꿉니다.
+                if (!pending.empty() && pending.back().value <= 0xFFFF) {
+                    __uint128_t address = pending.back().value;
+                    pending.pop_back();
+                    emit({static_cast<uint8_t>(insn.opcode == OP_GLOAD ? OP_GLOADI : OP_GSTOREI), 0, address, 0});
+                    stats.fused++;
+                    return;
+                }
+                break;
+            default:
+                break;
+        }
+        emit(insn);
+    }
+
+    // 두 피연산자가 모두 상수이면 결과 상수 하나로 바꿉니다.
+    bool fold_binary(uint8_t opcode) {
+        if (pending.size() < 2) {
+            return false;
+        }
+        constant b = pending[pending.size() - 1];
+        constant a = pending[pending.size() - 2];
+        constant result{0, a.type};
+        switch (opcode) {
+            case OP_ADD: result.value = a.value + b.value; break;
+            case OP_SUB: result.value = a.value - b.value; break;
+            case OP_MUL: result.value = a.value * b.value; break;
+            case OP_DIV:
+                if (b.value == 0) {
+                    return false; // 0으로 나누기 오류는 실행 시점에 보고합니다.
+                }
+                result.value = a.value / b.value;
+                break;
+            case OP_EQ: result = {a.value == b.value, BIT_8}; break;
+            case OP_LT: result = {a.value < b.value, BIT_8}; break;
+            case OP_GT: result = {a.value > b.value, BIT_8}; break;
+            default: return false;
+        }
+        if (!fits(result.value, result.type)) {
+            return false;
+        }
+        pending.pop_back();
+        pending.back() = result;
+        stats.folded += 2;
+        return true;
+    }
+
+    // 오른쪽 피연산자만 상수일 때: add -> addi, 2의 거듭제곱 mul/div -> shli/shri
+    bool reduce_binary(uint8_t opcode) {
+        if (pending.empty()) {
+            return false;
+        }
+        __uint128_t b = pending.back().value;
+        if (opcode == OP_ADD && b <= 0xFFFF) {
+            flush(1);
+            pending.pop_back();
+            emit({OP_ADDI, 0, b, 0});
+            stats.fused++;
+            return true;
+        }
+        if ((opcode == OP_MUL || opcode == OP_DIV) && b != 0 && (b & (b - 1)) == 0) {
+            uint16_t shift = 0;
+            while ((b >> shift) != 1) {
+                shift++;
+            }
+            flush(1);
+            pending.pop_back();
+            emit({static_cast<uint8_t>(opcode == OP_MUL ? OP_SHLI : OP_SHRI), shift, 0, 0});
+            stats.strength_reduced++;
+            return true;
+        }
+        return false;
+    }
+
+    // 비교/dup 바로 뒤의 jz/jnz를 슈퍼 명령어 하나로 합칩니다.
+    bool fuse_branch(const ir_instruction& insn) {
+        if (out.empty()) {
+            return false;
+        }
+        bool on_zero = insn.opcode == OP_JZ;
+        uint8_t fused;
+        switch (out.back().opcode) {
+            case OP_EQ: fused = on_zero ? OP_JNE : OP_JEQ; break;
+            case OP_LT: fused = on_zero ? OP_JGE : OP_JLT; break;
+            case OP_GT: fused = on_zero ? OP_JLE : OP_JGT; break;
+            case OP_DUP: fused = on_zero ? OP_JZK : OP_JNZK; break;
+            default: return false;
+        }
+        out.back() = {fused, 0, 0, insn.target};
+        stats.fused++;
+        return true;
+    }
+};
+
+size_t count_instructions(const ir_program& program) {
+    size_t count = 0;
+    for (const auto& block : program.blocks) {
+        count += block.code.size();
+    }
+    return count;
+}
+
+} // namespace
+
+bool lift_bytecode(const std::vector<uint16_t>& bytecode, ir_program& out) {
+    struct decoded {
+        size_t address;
+        ir_instruction insn;
+        __uint128_t target;
+    };
+    std::vector<decoded> linear;
+    std::set<size_t> leaders = {0};
+    size_t size = bytecode.size();
+
+    // 1) 순차 디코딩. 분기 대상, 분기/ret/halt 다음 명령어가 블록의 시작입니다.
+    size_t address = 0;
+    while (address < size) {
+        uint16_t raw = bytecode[address];
+        ir_instruction insn{static_cast<uint8_t>(raw >> 10), static_cast<uint16_t>(raw & 0x03FF), 0, 0};
+        size_t width = instruction_width(insn.opcode);
+        if (address + width > size) {
+            return false;
+        }
+        switch (insn.opcode) {
+            case OP_PUSHD8: insn.imm = bytecode[address + 1] & 0xFF; break;
+            case OP_PUSHD16:
+            case OP_ADDI:
+            case OP_GLOADI:
+            case OP_GSTOREI: insn.imm = bytecode[address + 1]; break;
+            case OP_PUSHD32: insn.imm = read_words(bytecode, address + 1, 2); break;
+            case OP_PUSHD64: insn.imm = read_words(bytecode, address + 1, 4); break;
+            case OP_PUSHD128: insn.imm = read_u128(bytecode, address + 1); break;
+            default: break;
+        }
+        __uint128_t target = 0;
+        if (is_branch_opcode(insn.opcode)) {
+            target = read_u128(bytecode, address + 1);
+            if (target < size) {
+                leaders.insert(static_cast<size_t>(target));
+            }
+        }
+        linear.push_back({address, insn, target});
+        address += width;
+        if (ends_block(insn.opcode)) {
+            leaders.insert(address);
+        }
+    }
+
+    // 2) 블록으로 나눕니다.
+    std::map<size_t, uint32_t> block_of;
+    out.blocks.clear();
+    for (const auto& item : linear) {
+        if (leaders.count(item.address)) {
+            block_of[item.address] = static_cast<uint32_t>(out.blocks.size());
+            out.blocks.push_back({item.address, {}});
+        }
+        out.blocks.back().code.push_back(item.insn);
+    }
+    for (size_t leader : leaders) {
+        // 명령어 중간으로 분기하는 프로그램은 워드 배치에 의존하므로 다루지 않습니다.
+        if (leader < size && !block_of.count(leader)) {
+            return false;
+        }
+    }
+
+    // 3) 분기 대상을 블록 인덱스로 바꿉니다. 범위 밖은 프로그램 끝(halt)입니다.
+    uint32_t end = static_cast<uint32_t>(out.blocks.size());
+    size_t index = 0;
+    for (auto& block : out.blocks) {
+        for (auto& insn : block.code) {
+            const decoded& item = linear[index++];
+            if (is_branch_opcode(insn.opcode)) {
+                insn.target = item.target < size ? block_of.at(static_cast<size_t>(item.target)) : end;
+            }
+        }
+    }
+    return true;
+}
+
+void optimize_program(ir_program& program, optimizer_stats* stats) {
+    optimizer_stats local;
+    optimizer_stats& s = stats ? *stats : local;
+    s.instructions_before += count_instructions(program);
+    for (auto& block : program.blocks) {
+        block.code = block_optimizer(s).run(block.code);
+    }
+    s.instructions_after += count_instructions(program);
+}
+
+std::vector<uint16_t> lower_program(const ir_program& program) {
+    // 블록 주소를 먼저 정한 뒤 분기 주소를 채웁니다.
+    std::vector<uint64_t> addresses;
+    uint64_t address = 0;
+    for (const auto& block : program.blocks) {
+        addresses.push_back(address);
+        for (const auto& insn : block.code) {
+            address += instruction_width(insn.opcode);
+        }
+    }
+    addresses.push_back(address);
+
+    std::vector<uint16_t> bytecode;
+    bytecode.reserve(address);
+    for (const auto& block : program.blocks) {
+        for (const auto& insn : block.code) {
+            bytecode.push_back(static_cast<uint16_t>((insn.opcode << 10) | (insn.operand & 0x03FF)));
+            if (is_branch_opcode(insn.opcode)) {
+                append_words(bytecode, addresses[insn.target], 8);
+                continue;
+            }
+            switch (insn.opcode) {
+                case OP_PUSHD8:
+                case OP_PUSHD16:
+                case OP_ADDI:
+                case OP_GLOADI:
+                case OP_GSTOREI: append_words(bytecode, insn.imm, 1); break;
+                case OP_PUSHD32: append_words(bytecode, insn.imm, 2); break;
+                case OP_PUSHD64: append_words(bytecode, insn.imm, 4); break;
+                case OP_PUSHD128: append_words(bytecode, insn.imm, 8); break;
+                default: break;
+            }
+        }
+    }
+    return bytecode;
+}
+
+std::vector<uint16_t> optimize_bytecode(const std::vector<uint16_t>& bytecode, optimizer_stats* stats) {
+    ir_program program;
+    if (!lift_bytecode(bytecode, program)) {
+        return bytecode;
+    }
+    optimize_program(program, stats);
+    return lower_program(program);
+}
@@ -0,0 +1,47 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 바이트코드를 기본 블록 단위의 IR로 올려 최적화한 뒤 다시 바이트코드로 내립니다.
+// 분기 대상은 주소 대신 블록 인덱스로 들고 있으므로, 명령어 수가 바뀌어도
+// 내릴 때 주소를 다시 계산하면 됩니다.
+
+struct ir_instruction {
+    uint8_t opcode;       // OPCODE 값
+    uint16_t operand;     // 10-bit 피연산자 (지역 태그, 시스템 콜 번호, 시프트 양)
+    __uint128_t imm;      // push/addi/gloadi/gstorei의 즉시값
+    uint32_t target;      // 분기 대상 블록 인덱스 (blocks.size()는 프로그램 끝)
+};
+
+struct basic_block {
+    uint64_t address;                 // 원래 바이트코드에서의 시작 주소
+    std::vector<ir_instruction> code;
+};
+
+struct ir_program {
+    std::vector<basic_block> blocks;  // 원래 순서를 유지합니다. 마지막 블록 다음은 halt입니다.
+};
+
+struct optimizer_stats {
+    size_t instructions_before = 0;
+    size_t instructions_after = 0;
+    size_t folded = 0;            // 상수 접기와 push/pop 제거로 없어진 명령어
+    size_t strength_reduced = 0;  // mul/div -> shli/shri
+    size_t fused = 0;             // 슈퍼 명령어로 합쳐진 쌍
+};
+
+// 명령어 경계가 아닌 곳으로 분기하거나 명령어가 잘려 있으면 false를 반환합니다.
+bool lift_bytecode(const std::vector<uint16_t>& bytecode, ir_program& out);
+
+// 블록마다 상수 접기, 복사 전파, 죽은 push/pop 제거, 강도 감소를 수행합니다.
+void optimize_program(ir_program& program, optimizer_stats* stats = nullptr);
+
+std::vector<uint16_t> lower_program(const ir_program& program);
+
+// lift -> optimize -> lower. 올릴 수 없는 프로그램은 그대로 반환합니다.
+std::vector<uint16_t> optimize_bytecode(const std::vector<uint16_t>& bytecode, optimizer_stats* stats = nullptr);
+
+#endif // OPTIMIZER_H
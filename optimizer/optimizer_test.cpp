@@ -0,0 +1,151 @@
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include "optimizer.h"
+#include "../engine/vm.h"
+
+#define OPC_ADD      (0b000001 << 10)
+#define OPC_SUB      (0b000010 << 10)
+#define OPC_MUL      (0b000011 << 10)
+#define OPC_DIV      (0b000100 << 10)
+#define OPC_POP      (0b000110 << 10)
+#define OPC_DUP      (0b000111 << 10)
+#define OPC_JMP      (0b001000 << 10)
+#define OPC_JZ       (0b001001 << 10)
+#define OPC_JNZ      (0b001010 << 10)
+#define OPC_LT       (0b001110 << 10)
+#define OPC_GLOAD    (0b010000 << 10)
+#define OPC_GSTORE   (0b010001 << 10)
+#define OPC_PUSHD8   (0b010100 << 10)
+#define OPC_PUSHD16  (0b010101 << 10)
+#define OPC_PUSHD128 (0b011000 << 10)
+#define OPC_ADDI     (0b011010 << 10)
+#define OPC_JLT      (0b011101 << 10)
+#define OPC_GLOADI   (0b100011 << 10)
+#define OPC_GSTOREI  (0b100100 << 10)
+#define OPC_SHLI     (0b100101 << 10)
+#define OPC_SHRI     (0b100110 << 10)
+
+// Runs the original and optimized bytecode and checks that the top `count`
+// stack values (data and type) agree.
+void check_same_result(const std::vector<uint16_t>& original, const std::vector<uint16_t>& optimized, int count) {
+    vm before(original);
+    vm after(optimized);
+    before.run();
+    after.run();
+    for (int i = 0; i < count; i++) {
+        stack_data a = before.pop();
+        stack_data b = after.pop();
+        assert(a.get_data() == b.get_data());
+        assert(a.get_d_type() == b.get_d_type());
+    }
+}
+
+void test_constant_folding() {
+    std::cout << "Testing Constant Folding..." << std::endl;
+    // (2 + 3) * 4 < 21 -> pushd8 1
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD16, 2, OPC_PUSHD16, 3, OPC_ADD, OPC_PUSHD16, 4, OPC_MUL,
+        OPC_DUP, OPC_PUSHD8, 21, OPC_LT
+    };
+    std::vector<uint16_t> optimized = optimize_bytecode(bytecode);
+    assert((optimized == std::vector<uint16_t>{OPC_PUSHD16, 20, OPC_PUSHD8, 1}));
+    check_same_result(bytecode, optimized, 2);
+
+    // The result keeps the left operand's type, so 200 + 100 as BIT_8 is not
+    // folded into a pushd8; it becomes an addi instead.
+    std::vector<uint16_t> bytecode_wide = { OPC_PUSHD8, 200, OPC_PUSHD8, 100, OPC_ADD };
+    assert((optimize_bytecode(bytecode_wide) == std::vector<uint16_t>{OPC_PUSHD8, 200, OPC_ADDI, 100}));
+    check_same_result(bytecode_wide, optimize_bytecode(bytecode_wide), 1);
+
+    // Division by a constant zero is left for the VM to report
+    std::vector<uint16_t> bytecode_div0 = { OPC_PUSHD16, 2, OPC_PUSHD16, 0, OPC_DIV };
+    assert(optimize_bytecode(bytecode_div0) == bytecode_div0);
+
+    std::cout << "Constant Folding Tests Passed!" << std::endl;
+}
+
+void test_dead_push_pop() {
+    std::cout << "Testing Dead Push/Pop..." << std::endl;
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD16, 7, OPC_PUSHD16, 1, OPC_POP, OPC_PUSHD128, 1,2,3,4,5,6,7,8, OPC_POP
+    };
+    optimizer_stats stats;
+    std::vector<uint16_t> optimized = optimize_bytecode(bytecode, &stats);
+    assert((optimized == std::vector<uint16_t>{OPC_PUSHD16, 7}));
+    assert(stats.instructions_before == 5 && stats.instructions_after == 1);
+    std::cout << "Dead Push/Pop Tests Passed!" << std::endl;
+}
+
+void test_strength_reduction() {
+    std::cout << "Testing Strength Reduction..." << std::endl;
+    // g[0] = g[1] * 8 / 4 + 1
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD16, 3, OPC_PUSHD16, 1, OPC_GSTORE,
+        OPC_PUSHD16, 1, OPC_GLOAD, OPC_PUSHD16, 8, OPC_MUL, OPC_PUSHD8, 4, OPC_DIV,
+        OPC_PUSHD16, 1, OPC_ADD,
+        OPC_DUP, OPC_PUSHD16, 0, OPC_GSTORE
+    };
+    optimizer_stats stats;
+    std::vector<uint16_t> optimized = optimize_bytecode(bytecode, &stats);
+    assert((optimized == std::vector<uint16_t>{
+        OPC_PUSHD16, 3, OPC_GSTOREI, 1,
+        OPC_GLOADI, 1, OPC_SHLI | 3, OPC_SHRI | 2, OPC_ADDI, 1,
+        OPC_DUP, OPC_GSTOREI, 0
+    }));
+    assert(stats.strength_reduced == 2);
+    check_same_result(bytecode, optimized, 1);
+    std::cout << "Strength Reduction Tests Passed!" << std::endl;
+}
+
+void test_branches() {
+    std::cout << "Testing Branches..." << std::endl;
+    // sum = 0; for (i = 0; i < 10; i++) sum += i * 2
+    std::vector<uint16_t> bytecode = {
+        OPC_PUSHD16, 0, OPC_PUSHD16, 0, OPC_GSTORE,          // 0: sum = 0
+        OPC_PUSHD16, 0,                                      // 5: i = 0
+        OPC_DUP, OPC_PUSHD16, 2, OPC_MUL,                    // 7: loop
+        OPC_PUSHD16, 0, OPC_GLOAD, OPC_ADD,
+        OPC_PUSHD16, 0, OPC_GSTORE,
+        OPC_PUSHD16, 1, OPC_ADD,
+        OPC_DUP, OPC_PUSHD16, 10, OPC_LT,
+        OPC_JNZ, 7,0,0,0,0,0,0,0,
+        OPC_PUSHD16, 0, OPC_GLOAD
+    };
+    optimizer_stats stats;
+    std::vector<uint16_t> optimized = optimize_bytecode(bytecode, &stats);
+    assert(optimized.size() < bytecode.size());
+    assert(stats.instructions_after < stats.instructions_before);
+    check_same_result(bytecode, optimized, 2);
+
+    // A constant condition becomes an unconditional jump (or disappears)
+    std::vector<uint16_t> bytecode_const = {
+        OPC_PUSHD8, 0, OPC_JZ, 15,0,0,0,0,0,0,0,   // 0: always taken
+        OPC_PUSHD16, 1, OPC_PUSHD16, 2,            // 11: skipped
+        OPC_PUSHD8, 1, OPC_JZ, 28,0,0,0,0,0,0,0,   // 15: never taken
+        OPC_PUSHD16, 3,                            // 26
+        OPC_PUSHD16, 4                             // 28
+    };
+    std::vector<uint16_t> optimized_const = optimize_bytecode(bytecode_const);
+    assert(optimized_const[0] == OPC_JMP);
+    check_same_result(bytecode_const, optimized_const, 2);
+
+    // Jumping into the middle of an instruction disables the optimizer
+    std::vector<uint16_t> bytecode_mid = {
+        OPC_PUSHD16, 7, OPC_PUSHD16, 1, OPC_POP,
+        OPC_JMP, 15,0,0,0,0,0,0,0,
+        OPC_PUSHD16, OPC_DUP
+    };
+    assert(optimize_bytecode(bytecode_mid) == bytecode_mid);
+
+    std::cout << "Branch Tests Passed!" << std::endl;
+}
+
+int main() {
+    test_constant_folding();
+    test_dead_push_pop();
+    test_strength_reduction();
+    test_branches();
+    std::cout << "\nAll optimizer tests passed successfully!" << std::endl;
+    return 0;
+}